@@ -0,0 +1,26 @@
+# Automatically generated by configure - do not modify!
+shared=
+build_suffix=
+prefix=/usr/local
+libdir=${prefix}/lib
+incdir=${prefix}/include
+rpath=
+source_path=src
+LIBPREF=lib
+LIBSUF=.a
+extralibs_avutil="-pthread -lm -latomic -lX11"
+extralibs_avcodec="-pthread -lm -latomic"
+extralibs_avformat="-lm -latomic -lxml2 -lbz2 -lz"
+extralibs_avdevice="-lm -latomic"
+extralibs_avfilter="-pthread -lm -latomic"
+extralibs_postproc="-lm -latomic"
+extralibs_swscale="-lm -latomic"
+extralibs_swresample="-lm -latomic"
+avdevice_deps="avfilter swscale avformat avcodec swresample avutil"
+avfilter_deps="swscale swresample avutil"
+swscale_deps="avutil"
+postproc_deps="avutil"
+avformat_deps="avcodec avutil"
+avcodec_deps="avutil"
+swresample_deps="avutil"
+avutil_deps=""
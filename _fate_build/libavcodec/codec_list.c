@@ -0,0 +1,22 @@
+static const FFCodec * const codec_list[] = {
+    &ff_h263_encoder,
+    &ff_mpeg2video_encoder,
+    &ff_mpeg4_encoder,
+    &ff_pgmyuv_encoder,
+    &ff_rawvideo_encoder,
+    &ff_wrapped_avframe_encoder,
+    &ff_aac_encoder,
+    &ff_mp2_encoder,
+    &ff_pcm_alaw_encoder,
+    &ff_pcm_s16le_encoder,
+    &ff_h263_decoder,
+    &ff_mpeg2video_decoder,
+    &ff_mpeg4_decoder,
+    &ff_pgmyuv_decoder,
+    &ff_rawvideo_decoder,
+    &ff_wrapped_avframe_decoder,
+    &ff_aac_decoder,
+    &ff_mp2_decoder,
+    &ff_pcm_alaw_decoder,
+    &ff_pcm_s16le_decoder,
+    NULL };
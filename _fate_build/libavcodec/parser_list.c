@@ -0,0 +1,8 @@
+static const AVCodecParser * const parser_list[] = {
+    &ff_aac_parser,
+    &ff_ac3_parser,
+    &ff_h263_parser,
+    &ff_mpeg4video_parser,
+    &ff_mpegaudio_parser,
+    &ff_mpegvideo_parser,
+    NULL };
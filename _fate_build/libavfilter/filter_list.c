@@ -0,0 +1,24 @@
+static const AVFilter * const filter_list[] = {
+    &ff_af_aformat,
+    &ff_af_anull,
+    &ff_af_aresample,
+    &ff_af_asetpts,
+    &ff_af_atrim,
+    &ff_asrc_sine,
+    &ff_vf_crop,
+    &ff_vf_format,
+    &ff_vf_hflip,
+    &ff_vf_null,
+    &ff_vf_rotate,
+    &ff_vf_scale,
+    &ff_vf_setpts,
+    &ff_vf_showinfo,
+    &ff_vf_transpose,
+    &ff_vf_trim,
+    &ff_vf_vflip,
+    &ff_vsrc_testsrc,
+    &ff_asrc_abuffer,
+    &ff_vsrc_buffer,
+    &ff_asink_abuffer,
+    &ff_vsink_buffer,
+    NULL };
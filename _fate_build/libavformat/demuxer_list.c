@@ -0,0 +1,17 @@
+static const FFInputFormat * const demuxer_list[] = {
+    &ff_aac_demuxer,
+    &ff_ac3_demuxer,
+    &ff_dash_demuxer,
+    &ff_eac3_demuxer,
+    &ff_h264_demuxer,
+    &ff_hls_demuxer,
+    &ff_image2_demuxer,
+    &ff_m4v_demuxer,
+    &ff_matroska_demuxer,
+    &ff_mov_demuxer,
+    &ff_mpegts_demuxer,
+    &ff_mpegvideo_demuxer,
+    &ff_pcm_s16le_demuxer,
+    &ff_rawvideo_demuxer,
+    &ff_wav_demuxer,
+    NULL };
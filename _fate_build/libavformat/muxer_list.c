@@ -0,0 +1,23 @@
+static const FFOutputFormat * const muxer_list[] = {
+    &ff_adts_muxer,
+    &ff_crc_muxer,
+    &ff_dash_muxer,
+    &ff_framecrc_muxer,
+    &ff_framemd5_muxer,
+    &ff_hls_muxer,
+    &ff_image2_muxer,
+    &ff_ismv_muxer,
+    &ff_latm_muxer,
+    &ff_m4v_muxer,
+    &ff_md5_muxer,
+    &ff_matroska_muxer,
+    &ff_mov_muxer,
+    &ff_mp4_muxer,
+    &ff_mpeg2video_muxer,
+    &ff_mpegts_muxer,
+    &ff_null_muxer,
+    &ff_pcm_s16le_muxer,
+    &ff_rawvideo_muxer,
+    &ff_segment_muxer,
+    &ff_wav_muxer,
+    NULL };
@@ -0,0 +1,9 @@
+static const URLProtocol * const url_protocols[] = {
+    &ff_async_protocol,
+    &ff_cache_protocol,
+    &ff_crypto_protocol,
+    &ff_file_protocol,
+    &ff_parallel_protocol,
+    &ff_pipe_protocol,
+    &ff_uring_protocol,
+    NULL };
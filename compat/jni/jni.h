@@ -0,0 +1,73 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Minimal stand-in for the JNI header, declaring only what the JNI based
+ * protocols use, in the C layout of the real one. It is not meant for
+ * linking; "make checkjni" uses it to compile those sources on hosts
+ * without a JDK or the Android NDK.
+ */
+
+#ifndef COMPAT_JNI_JNI_H
+#define COMPAT_JNI_JNI_H
+
+#include <stdint.h>
+
+typedef uint8_t  jboolean;
+typedef int8_t   jbyte;
+typedef int32_t  jint;
+typedef int64_t  jlong;
+typedef jint     jsize;
+
+struct _jobject;
+typedef struct _jobject *jobject;
+typedef jobject jclass;
+typedef jobject jstring;
+typedef jobject jthrowable;
+typedef jobject jarray;
+typedef jarray  jbyteArray;
+
+struct _jfieldID;
+typedef struct _jfieldID *jfieldID;
+struct _jmethodID;
+typedef struct _jmethodID *jmethodID;
+
+#define JNI_FALSE 0
+#define JNI_TRUE  1
+
+struct JNINativeInterface;
+typedef const struct JNINativeInterface *JNIEnv;
+
+struct JNINativeInterface {
+    jobject    (*NewGlobalRef)(JNIEnv *env, jobject obj);
+    void       (*DeleteGlobalRef)(JNIEnv *env, jobject obj);
+    void       (*DeleteLocalRef)(JNIEnv *env, jobject obj);
+    jobject    (*NewObject)(JNIEnv *env, jclass clazz, jmethodID method, ...);
+    jobject    (*CallObjectMethod)(JNIEnv *env, jobject obj, jmethodID method, ...);
+    jint       (*CallIntMethod)(JNIEnv *env, jobject obj, jmethodID method, ...);
+    jlong      (*CallLongMethod)(JNIEnv *env, jobject obj, jmethodID method, ...);
+    void       (*CallVoidMethod)(JNIEnv *env, jobject obj, jmethodID method, ...);
+    jbyteArray (*NewByteArray)(JNIEnv *env, jsize len);
+    void       (*GetByteArrayRegion)(JNIEnv *env, jbyteArray array,
+                                     jsize start, jsize len, jbyte *buf);
+    jboolean   (*ExceptionCheck)(JNIEnv *env);
+    jobject    (*NewDirectByteBuffer)(JNIEnv *env, void *address, jlong capacity);
+};
+
+#endif /* COMPAT_JNI_JNI_H */
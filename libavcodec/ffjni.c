@@ -23,6 +23,7 @@
 #include <jni.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "libavutil/bprint.h"
 #include "libavutil/error.h"
@@ -38,6 +39,15 @@ static pthread_key_t current_env;
 static pthread_once_t once = PTHREAD_ONCE_INIT;
 static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
 
+typedef struct FFJniRegistryEntry {
+    const struct FFJniField *jfields_mapping;
+    void *jfields;
+} FFJniRegistryEntry;
+
+static FFJniRegistryEntry *jfields_registry;
+static int nb_jfields_registry;
+static pthread_mutex_t jfields_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static void jni_detach_env(void *data)
 {
     if (java_vm) {
@@ -410,3 +420,54 @@ int ff_jni_reset_jfields(JNIEnv *env, void *jfields, const struct FFJniField *jf
 
     return 0;
 }
+
+int ff_jni_get_jfields(JNIEnv *env, void *jfields, size_t jfields_size, const struct FFJniField *jfields_mapping, void *log_ctx)
+{
+    int i, ret = 0;
+    void *cached = NULL;
+    FFJniRegistryEntry *entries;
+
+    pthread_mutex_lock(&jfields_registry_lock);
+
+    for (i = 0; i < nb_jfields_registry; i++) {
+        if (jfields_registry[i].jfields_mapping == jfields_mapping) {
+            cached = jfields_registry[i].jfields;
+            break;
+        }
+    }
+
+    if (!cached) {
+        cached = av_mallocz(jfields_size);
+        if (!cached) {
+            ret = AVERROR(ENOMEM);
+            goto done;
+        }
+
+        /* failures are not cached, a later call from a thread with the
+         * application class loader may still succeed */
+        if ((ret = ff_jni_init_jfields(env, cached, jfields_mapping, 1, log_ctx)) < 0) {
+            av_freep(&cached);
+            goto done;
+        }
+
+        entries = av_realloc_array(jfields_registry, nb_jfields_registry + 1, sizeof(*entries));
+        if (!entries) {
+            ff_jni_reset_jfields(env, cached, jfields_mapping, 1, log_ctx);
+            av_freep(&cached);
+            ret = AVERROR(ENOMEM);
+            goto done;
+        }
+
+        jfields_registry = entries;
+        jfields_registry[nb_jfields_registry].jfields_mapping = jfields_mapping;
+        jfields_registry[nb_jfields_registry].jfields = cached;
+        nb_jfields_registry++;
+    }
+
+    memcpy(jfields, cached, jfields_size);
+
+done:
+    pthread_mutex_unlock(&jfields_registry_lock);
+
+    return ret;
+}
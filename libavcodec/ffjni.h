@@ -143,4 +143,26 @@ int ff_jni_init_jfields(JNIEnv *env, void *jfields, const struct FFJniField *jfi
  */
 int ff_jni_reset_jfields(JNIEnv *env, void *jfields, const struct FFJniField *jfields_mapping, int global, void *log_ctx);
 
+/*
+ * Retrieve class references, field ids and method ids to an arbitrary structure
+ * from a process-wide registry.
+ *
+ * The first call for a given mapping resolves it like ff_jni_init_jfields with
+ * global class references, which are then kept for the lifetime of the
+ * process. Subsequent calls only copy the cached values, so the caller must
+ * not release them with ff_jni_reset_jfields. This function is thread-safe.
+ *
+ * @param env JNI environment
+ * @param jfields a pointer to an arbitrary structure where the different
+ * fields are declared and where the FFJNIField mapping table offsets are
+ * pointing to
+ * @param jfields_size size of the structure pointed to by jfields
+ * @param jfields_mapping null terminated array of FFJNIFields describing
+ * the class/field/method to be retrieved, its address is used as the
+ * registry key so it must have static storage duration
+ * @param log_ctx context used for logging, can be NULL
+ * @return 0 on success, < 0 otherwise
+ */
+int ff_jni_get_jfields(JNIEnv *env, void *jfields, size_t jfields_size, const struct FFJniField *jfields_mapping, void *log_ctx);
+
 #endif /* AVCODEC_FFJNI_H */
@@ -28,6 +28,8 @@
 #include "avcodec.h"
 #include "codec_internal.h"
 #include "decode.h"
+#include "svgutils.h"
+#include "thread.h"
 #include "libavutil/opt.h"
 
 
@@ -41,6 +43,10 @@ struct JNISVGFields {
 
     jmethodID svg_decode_method;
 
+    jmethodID svg_parse_direct_method;
+
+    jmethodID svg_render_direct_method;
+
     jmethodID svg_width_method;
 
     jmethodID svg_height_method;
@@ -54,7 +60,8 @@ static const struct FFJniField jfields_svg_mapping[] = {
         { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "<init>", "()V", FF_JNI_METHOD, OFFSET(svg_init_method), 1 },
         { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "decodeClose", "()V", FF_JNI_METHOD, OFFSET(svg_close_method), 1 },
         { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "decodeData", "([B)Landroid/graphics/Bitmap;", FF_JNI_METHOD, OFFSET(svg_decode_method), 1 },
-        { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "decodeData", "([B)Landroid/graphics/Bitmap;", FF_JNI_METHOD, OFFSET(svg_decode_method), 1 },
+        { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "parseDirect", "(Ljava/nio/ByteBuffer;)I", FF_JNI_METHOD, OFFSET(svg_parse_direct_method), 0 },
+        { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "renderDirect", "(Ljava/nio/ByteBuffer;III)I", FF_JNI_METHOD, OFFSET(svg_render_direct_method), 0 },
         { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "getDocumentWidth", "()I", FF_JNI_METHOD, OFFSET(svg_width_method), 1 },
         { "com/solarized/firedown/ffmpegutils/FFmpegSVGDecoder", "getDocumentHeight", "()I", FF_JNI_METHOD, OFFSET(svg_height_method), 1 },
     { NULL }
@@ -69,6 +76,18 @@ typedef struct LibASVGContext {
 
     jobject thiz;
 
+    int direct;
+
+    int width;
+
+    int height;
+
+    int keep_ar;
+
+    int fit;
+
+    SVGFrameCache cache;
+
 } LibASVGContext;
 
 
@@ -80,6 +99,8 @@ static int libasvg_decode_close(AVCodecContext *avctx)
 
     av_log(c, AV_LOG_DEBUG, "libasvg_close\n");
 
+    ff_svg_cache_uninit(&c->cache);
+
     if (!c->thiz) {
         return 0;
     }
@@ -100,8 +121,6 @@ static int libasvg_decode_close(AVCodecContext *avctx)
 
     c->thiz = NULL;
 
-    ff_jni_reset_jfields(env, &c->jfields, jfields_svg_mapping, 1, c);
-
     return ret;
 }
 
@@ -121,7 +140,7 @@ static int libasvg_decode_init(AVCodecContext *avctx)
         return AVERROR(EINVAL);
     }
 
-    ret = ff_jni_init_jfields(env, &c->jfields, jfields_svg_mapping, 1, c);
+    ret = ff_jni_get_jfields(env, &c->jfields, sizeof(c->jfields), jfields_svg_mapping, c);
 
     if (ret < 0) {
         av_log(c, AV_LOG_ERROR, "failed to initialize jni fields\n");
@@ -146,8 +165,8 @@ static int libasvg_decode_init(AVCodecContext *avctx)
     done:
 
     if(ret < 0) {
-        ff_jni_reset_jfields(env, &c->jfields, jfields_svg_mapping, 1, c);
         (*env)->DeleteGlobalRef(env, c->thiz);
+        c->thiz = NULL;
     }
 
     (*env)->DeleteLocalRef(env, object);
@@ -158,104 +177,218 @@ static int libasvg_decode_init(AVCodecContext *avctx)
 
 }
 
-static int libasvg_decode_frame(AVCodecContext *avctx, AVFrame *frame,
-                                int *got_frame, AVPacket *pkt)
+/*
+ * Zero-copy path: the packet is handed to parseDirect() as a direct
+ * ByteBuffer, and renderDirect(pixels, width, height, stride) rasterizes
+ * straight into the RGBA frame buffer returned by ff_thread_get_buffer(), scaled
+ * to the requested output size.
+ */
+static int libasvg_decode_direct(AVCodecContext *avctx, JNIEnv *env,
+                                 AVFrame *frame, AVPacket *pkt)
 {
+    LibASVGContext *c = avctx->priv_data;
+    jobject input = NULL;
+    jobject pixels = NULL;
+    int width, height;
     int ret;
+
+    input = (*env)->NewDirectByteBuffer(env, pkt->data, pkt->size);
+
+    if (!input || ff_jni_exception_check(env, 1, c) < 0) {
+        ret = AVERROR_EXTERNAL;
+        goto end;
+    }
+
+    ret = (*env)->CallIntMethod(env, c->thiz, c->jfields.svg_parse_direct_method, input);
+
+    if (ff_jni_exception_check(env, 1, c) < 0 || ret < 0) {
+        av_log(avctx, AV_LOG_ERROR, "Error parsing svg\n");
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    width  = (*env)->CallIntMethod(env, c->thiz, c->jfields.svg_width_method);
+    height = (*env)->CallIntMethod(env, c->thiz, c->jfields.svg_height_method);
+
+    if (ff_jni_exception_check(env, 1, c) < 0) {
+        ret = AVERROR_EXTERNAL;
+        goto end;
+    }
+
+    ff_svg_target_size(width, height, c->width, c->height, c->keep_ar, c->fit,
+                       &width, &height);
+
+    ret = ff_set_dimensions(avctx, width, height);
+
+    if (ret < 0)
+        goto end;
+
+    avctx->pix_fmt = AV_PIX_FMT_RGBA;
+
+    ret = ff_thread_get_buffer(avctx, frame, 0);
+
+    if (ret < 0)
+        goto end;
+
+    pixels = (*env)->NewDirectByteBuffer(env, frame->data[0],
+                                         (jlong)frame->linesize[0] * height);
+
+    if (!pixels || ff_jni_exception_check(env, 1, c) < 0) {
+        ret = AVERROR_EXTERNAL;
+        goto end;
+    }
+
+    ret = (*env)->CallIntMethod(env, c->thiz, c->jfields.svg_render_direct_method,
+                                pixels, width, height, frame->linesize[0]);
+
+    if (ff_jni_exception_check(env, 1, c) < 0 || ret < 0) {
+        av_log(avctx, AV_LOG_ERROR, "Error rendering svg\n");
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+
+    (*env)->DeleteLocalRef(env, pixels);
+    (*env)->DeleteLocalRef(env, input);
+
+    return ret;
+}
+
+static int libasvg_decode_bitmap(AVCodecContext *avctx, JNIEnv *env,
+                                 AVFrame *frame, AVPacket *pkt)
+{
     LibASVGContext *c = avctx->priv_data;
-    JNIEnv *env = NULL;
     jbyteArray array = NULL;
     jobject bitmap = NULL;
     AndroidBitmapInfo bitmapInfo;
     void* bitmapPixels = NULL;
-    *got_frame = 0;
-
-    av_log(c, AV_LOG_DEBUG, "libasvg_decode_frame\n");
-
-    env = ff_jni_get_env(c);
-
-    if (!env) {
-        return AVERROR(EINVAL);
-    }
+    int ret;
 
     array = (*env)->NewByteArray(env, pkt->size);
 
     if(array == NULL) {
         av_log(c, AV_LOG_ERROR, "Error during decode, no memory\n");
+        ret = AVERROR(ENOMEM);
         goto end;
     }
 
     (*env)->SetByteArrayRegion(env, array, 0, pkt->size, (jbyte *) pkt->data);
 
-    av_log(c, AV_LOG_DEBUG, "libasvg_decode_frame, pkt->size: %d\n", pkt->size);
-
-
     bitmap = (*env)->CallObjectMethod(env, c->thiz,
                                            c->jfields.svg_decode_method, array);
 
-    if(!bitmap) {
+    if(!bitmap || ff_jni_exception_check(env, 1, c) < 0) {
         av_log(avctx, AV_LOG_ERROR, "Error rendering svg\n");
         ret = AVERROR_INVALIDDATA;
         goto end;
     }
 
-
-
-    AndroidBitmap_getInfo(env, bitmap, &bitmapInfo);
+    if (AndroidBitmap_getInfo(env, bitmap, &bitmapInfo) < 0) {
+        ret = AVERROR_EXTERNAL;
+        goto end;
+    }
 
     av_log(c, AV_LOG_DEBUG, "libasvg_decode_frame, width: %d height: %d\n", bitmapInfo.width, bitmapInfo.height);
 
     ret = ff_set_dimensions(avctx, bitmapInfo.width, bitmapInfo.height);
 
-
     if (ret < 0)
         goto end;
 
     avctx->pix_fmt = AV_PIX_FMT_RGBA;
 
-    ret = ff_get_buffer(avctx, frame, 0);
+    ret = ff_thread_get_buffer(avctx, frame, 0);
 
     if (ret < 0)
         goto end;
 
-    frame->pict_type = AV_PICTURE_TYPE_I;
-    frame->flags |= AV_FRAME_FLAG_KEY;
-
-    AndroidBitmap_lockPixels(env, bitmap, &bitmapPixels);
+    if (AndroidBitmap_lockPixels(env, bitmap, &bitmapPixels) < 0) {
+        ret = AVERROR_EXTERNAL;
+        goto end;
+    }
 
-    av_image_fill_arrays(frame->data, frame->linesize,
-                         (const unsigned char *) bitmapPixels, AV_PIX_FMT_RGBA,
-                         bitmapInfo.width, bitmapInfo.height, 1);
+    /* the pixels are only valid while locked, copy them into the frame */
+    av_image_copy_plane(frame->data[0], frame->linesize[0],
+                        bitmapPixels, bitmapInfo.stride,
+                        bitmapInfo.width * 4, bitmapInfo.height);
 
     AndroidBitmap_unlockPixels(env, bitmap);
 
-    //Hack set correct dimens
+    ret = 0;
+
+end:
+
+    (*env)->DeleteLocalRef(env, bitmap);
+    (*env)->DeleteLocalRef(env, array);
+
+    return ret;
+}
+
+static int libasvg_decode_frame(AVCodecContext *avctx, AVFrame *frame,
+                                int *got_frame, AVPacket *pkt)
+{
+    int ret;
+    LibASVGContext *c = avctx->priv_data;
+    JNIEnv *env = NULL;
+    *got_frame = 0;
 
+    av_log(c, AV_LOG_DEBUG, "libasvg_decode_frame, pkt->size: %d\n", pkt->size);
 
-    avctx->coded_width = (*env)->CallIntMethod(env, c->thiz,
-                                           c->jfields.svg_width_method);
+    env = ff_jni_get_env(c);
 
-    avctx->coded_height = (*env)->CallIntMethod(env, c->thiz,
-                                           c->jfields.svg_height_method);
+    if (!env) {
+        return AVERROR(EINVAL);
+    }
 
+    ret = ff_svg_cache_get(avctx, &c->cache, pkt, frame);
 
-    *got_frame = 1;
-    ret = 0;
+    if (ret < 0)
+        return ret;
 
-    av_log(c, AV_LOG_DEBUG, "libasvg_decode_frame end");
+    if (ret) {
+        *got_frame = 1;
+        return pkt->size;
+    }
 
-end:
+    if (c->direct && c->jfields.svg_parse_direct_method && c->jfields.svg_render_direct_method) {
+        ret = libasvg_decode_direct(avctx, env, frame, pkt);
+    } else {
+        ret = libasvg_decode_bitmap(avctx, env, frame, pkt);
+    }
 
-    (*env)->DeleteLocalRef(env, bitmap);
-    (*env)->DeleteLocalRef(env, array);
+    if (ret < 0)
+        return ret;
+
+    frame->pict_type = AV_PICTURE_TYPE_I;
+    frame->flags |= AV_FRAME_FLAG_KEY;
 
+    ret = ff_svg_cache_add(&c->cache, pkt, frame);
 
-    return ret;
+    if (ret < 0)
+        return ret;
+
+    *got_frame = 1;
+
+    av_log(c, AV_LOG_DEBUG, "libasvg_decode_frame end\n");
+
+    return pkt->size;
 }
 
 #define OFFSET(x) offsetof(LibASVGContext, x)
 #define DEC (AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_VIDEO_PARAM)
 static const AVOption options[] = {
+    { "direct", "render into the frame buffer through direct ByteBuffers when supported", OFFSET(direct), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, DEC },
+    { "width", "Width to render to (0 for default), direct mode only", OFFSET(width), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, DEC },
+    { "height", "Height to render to (0 for default), direct mode only", OFFSET(height), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, DEC },
+    { "keep_ar", "Keep aspect ratio with custom width/height", OFFSET(keep_ar), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, DEC },
+    { "fit", "How to fit the document into width/height", OFFSET(fit), AV_OPT_TYPE_INT, { .i64 = SVG_FIT_FILL }, SVG_FIT_FILL, SVG_FIT_SHRINK, DEC, .unit = "fit" },
+        { "fill",    "Render at width/height, see keep_ar", 0, AV_OPT_TYPE_CONST, { .i64 = SVG_FIT_FILL },    0, 0, DEC, .unit = "fit" },
+        { "contain", "Scale to fit inside width/height",    0, AV_OPT_TYPE_CONST, { .i64 = SVG_FIT_CONTAIN }, 0, 0, DEC, .unit = "fit" },
+        { "shrink",  "Like contain, but never upscale",     0, AV_OPT_TYPE_CONST, { .i64 = SVG_FIT_SHRINK },  0, 0, DEC, .unit = "fit" },
+    { "cache_size", "Number of rendered frames to reuse for identical packets (0 to disable)", OFFSET(cache.max_entries), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1024, DEC },
     { NULL },
 };
 
@@ -272,7 +405,7 @@ const FFCodec ff_libasvg_decoder = {
     .p.priv_class   = &libasvg_decoder_class,
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_SVG,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS,
     .p.wrapper_name = "libasvg",
     .init           = libasvg_decode_init,
     FF_CODEC_DECODE_CB(libasvg_decode_frame),
@@ -22,6 +22,8 @@
 #include "avcodec.h"
 #include "codec_internal.h"
 #include "decode.h"
+#include "svgutils.h"
+#include "thread.h"
 #include "libavutil/opt.h"
 #include "librsvg-2.0/librsvg/rsvg.h"
 
@@ -31,6 +33,9 @@ typedef struct LibRSVGContext {
     int width;
     int height;
     int keep_ar;
+    int fit;
+
+    SVGFrameCache cache;
 } LibRSVGContext;
 
 static int librsvg_decode_frame(AVCodecContext *avctx, AVFrame *frame,
@@ -52,6 +57,14 @@ static int librsvg_decode_frame(AVCodecContext *avctx, AVFrame *frame,
 
     *got_frame = 0;
 
+    ret = ff_svg_cache_get(avctx, &s->cache, pkt, frame);
+    if (ret < 0)
+        return ret;
+    if (ret) {
+        *got_frame = 1;
+        return 0;
+    }
+
     handle = rsvg_handle_new_from_data(pkt->data, pkt->size, &error);
     if (error) {
         av_log(avctx, AV_LOG_ERROR, "Error parsing svg: %s\n", error->message);
@@ -65,25 +78,14 @@ static int librsvg_decode_frame(AVCodecContext *avctx, AVFrame *frame,
         viewport.width = s->width ? s->width : 100;
         viewport.height = s->height ? s->height : 100;
     }
-    dimensions.width = (int)viewport.width;
-    dimensions.height = (int)viewport.height;
+    ff_svg_target_size(viewport.width, viewport.height, s->width, s->height,
+                       s->keep_ar, s->fit, &dimensions.width, &dimensions.height);
 #else
-    rsvg_handle_get_dimensions(handle, &dimensions);
     rsvg_handle_get_dimensions(handle, &unscaled_dimensions);
+    ff_svg_target_size(unscaled_dimensions.width, unscaled_dimensions.height,
+                       s->width, s->height, s->keep_ar, s->fit,
+                       &dimensions.width, &dimensions.height);
 #endif
-    dimensions.width  = s->width  ? s->width  : dimensions.width;
-    dimensions.height = s->height ? s->height : dimensions.height;
-    if (s->keep_ar && (s->width || s->height)) {
-#if LIBRSVG_MAJOR_VERSION > 2 || LIBRSVG_MAJOR_VERSION == 2 && LIBRSVG_MINOR_VERSION >= 52
-        double default_ar = viewport.width / viewport.height;
-#else
-        double default_ar = unscaled_dimensions.width/(double)unscaled_dimensions.height;
-#endif
-        if (!s->width)
-            dimensions.width  = lrintf(dimensions.height * default_ar);
-        else
-            dimensions.height = lrintf(dimensions.width  / default_ar);
-    }
 
     ret = ff_set_dimensions(avctx, dimensions.width, dimensions.height);
     if (ret < 0)
@@ -93,7 +95,7 @@ static int librsvg_decode_frame(AVCodecContext *avctx, AVFrame *frame,
     viewport.width = dimensions.width;
     viewport.height = dimensions.height;
 
-    ret = ff_get_buffer(avctx, frame, 0);
+    ret = ff_thread_get_buffer(avctx, frame, 0);
     if (ret < 0)
         goto end;
 
@@ -129,6 +131,10 @@ static int librsvg_decode_frame(AVCodecContext *avctx, AVFrame *frame,
         goto end;
     }
 
+    ret = ff_svg_cache_add(&s->cache, pkt, frame);
+    if (ret < 0)
+        goto end;
+
     *got_frame = 1;
     ret = 0;
 
@@ -145,12 +151,26 @@ end:
     return ret;
 }
 
+static av_cold int librsvg_decode_close(AVCodecContext *avctx)
+{
+    LibRSVGContext *s = avctx->priv_data;
+
+    ff_svg_cache_uninit(&s->cache);
+
+    return 0;
+}
+
 #define OFFSET(x) offsetof(LibRSVGContext, x)
 #define DEC (AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_VIDEO_PARAM)
 static const AVOption options[] = {
     { "width", "Width to render to (0 for default)", OFFSET(width), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, DEC },
     { "height", "Height to render to (0 for default)", OFFSET(height), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, DEC },
     { "keep_ar", "Keep aspect ratio with custom width/height", OFFSET(keep_ar), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, DEC },
+    { "fit", "How to fit the document into width/height", OFFSET(fit), AV_OPT_TYPE_INT, { .i64 = SVG_FIT_FILL }, SVG_FIT_FILL, SVG_FIT_SHRINK, DEC, .unit = "fit" },
+        { "fill",    "Render at width/height, see keep_ar", 0, AV_OPT_TYPE_CONST, { .i64 = SVG_FIT_FILL },    0, 0, DEC, .unit = "fit" },
+        { "contain", "Scale to fit inside width/height",    0, AV_OPT_TYPE_CONST, { .i64 = SVG_FIT_CONTAIN }, 0, 0, DEC, .unit = "fit" },
+        { "shrink",  "Like contain, but never upscale",     0, AV_OPT_TYPE_CONST, { .i64 = SVG_FIT_SHRINK },  0, 0, DEC, .unit = "fit" },
+    { "cache_size", "Number of rendered frames to reuse for identical packets (0 to disable)", OFFSET(cache.max_entries), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1024, DEC },
     { NULL },
 };
 
@@ -167,8 +187,9 @@ const FFCodec ff_librsvg_decoder = {
     .p.priv_class   = &librsvg_decoder_class,
     .p.type         = AVMEDIA_TYPE_VIDEO,
     .p.id           = AV_CODEC_ID_SVG,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS,
     .p.wrapper_name = "librsvg",
     FF_CODEC_DECODE_CB(librsvg_decode_frame),
+    .close          = librsvg_decode_close,
     .priv_data_size = sizeof(LibRSVGContext),
 };
@@ -492,11 +492,11 @@ char *ff_AMediaCodecList_getCodecNameByType(const char *mime, int profile, int e
 
     JNI_GET_ENV_OR_RETURN(env, log_ctx, NULL);
 
-    if ((ret = ff_jni_init_jfields(env, &jfields, jni_amediacodeclist_mapping, 0, log_ctx)) < 0) {
+    if ((ret = ff_jni_get_jfields(env, &jfields, sizeof(jfields), jni_amediacodeclist_mapping, log_ctx)) < 0) {
         goto done;
     }
 
-    if ((ret = ff_jni_init_jfields(env, &mediaformat_jfields, jni_amediaformat_mapping, 0, log_ctx)) < 0) {
+    if ((ret = ff_jni_get_jfields(env, &mediaformat_jfields, sizeof(mediaformat_jfields), jni_amediaformat_mapping, log_ctx)) < 0) {
         goto done;
     }
 
@@ -665,9 +665,6 @@ done:
 
     av_freep(&supported_type);
 
-    ff_jni_reset_jfields(env, &jfields, jni_amediacodeclist_mapping, 0, log_ctx);
-    ff_jni_reset_jfields(env, &mediaformat_jfields, jni_amediaformat_mapping, 0, log_ctx);
-
     if (!found_codec) {
         av_freep(&name);
     }
@@ -693,7 +690,7 @@ static FFAMediaFormat *mediaformat_jni_new(void)
         return NULL;
     }
 
-    if (ff_jni_init_jfields(env, &format->jfields, jni_amediaformat_mapping, 1, format) < 0) {
+    if (ff_jni_get_jfields(env, &format->jfields, sizeof(format->jfields), jni_amediaformat_mapping, format) < 0) {
         goto fail;
     }
 
@@ -711,7 +708,6 @@ fail:
     (*env)->DeleteLocalRef(env, object);
 
     if (!format->object) {
-        ff_jni_reset_jfields(env, &format->jfields, jni_amediaformat_mapping, 1, format);
         av_freep(&format);
     }
 
@@ -735,7 +731,7 @@ static FFAMediaFormat *mediaformat_jni_newFromObject(void *object)
         return NULL;
     }
 
-    if (ff_jni_init_jfields(env, &format->jfields, jni_amediaformat_mapping, 1, format) < 0) {
+    if (ff_jni_get_jfields(env, &format->jfields, sizeof(format->jfields), jni_amediaformat_mapping, format) < 0) {
         goto fail;
     }
 
@@ -746,8 +742,6 @@ static FFAMediaFormat *mediaformat_jni_newFromObject(void *object)
 
     return (FFAMediaFormat *)format;
 fail:
-    ff_jni_reset_jfields(env, &format->jfields, jni_amediaformat_mapping, 1, format);
-
     av_freep(&format);
 
     return NULL;
@@ -768,8 +762,6 @@ static int mediaformat_jni_delete(FFAMediaFormat* ctx)
     (*env)->DeleteGlobalRef(env, format->object);
     format->object = NULL;
 
-    ff_jni_reset_jfields(env, &format->jfields, jni_amediaformat_mapping, 1, format);
-
     av_freep(&format);
 
     return ret;
@@ -1233,7 +1225,7 @@ static inline FFAMediaCodec *codec_create(int method, const char *arg)
         return NULL;
     }
 
-    if (ff_jni_init_jfields(env, &codec->jfields, jni_amediacodec_mapping, 1, codec) < 0) {
+    if (ff_jni_get_jfields(env, &codec->jfields, sizeof(codec->jfields), jni_amediacodec_mapping, codec) < 0) {
         goto fail;
     }
 
@@ -1291,7 +1283,6 @@ fail:
         (*env)->DeleteGlobalRef(env, codec->object);
         (*env)->DeleteGlobalRef(env, codec->buffer_info);
 
-        ff_jni_reset_jfields(env, &codec->jfields, jni_amediacodec_mapping, 1, codec);
         av_freep(&codec);
     }
 
@@ -1337,8 +1328,6 @@ static int mediacodec_jni_delete(FFAMediaCodec* ctx)
     (*env)->DeleteGlobalRef(env, codec->buffer_info);
     codec->buffer_info = NULL;
 
-    ff_jni_reset_jfields(env, &codec->jfields, jni_amediacodec_mapping, 1, codec);
-
     av_freep(&codec);
 
     return ret;
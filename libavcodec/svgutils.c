@@ -0,0 +1,188 @@
+/*
+ * Helpers shared by the SVG rasterizer wrappers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/crc.h"
+#include "libavutil/mem.h"
+
+#include "decode.h"
+#include "svgutils.h"
+
+struct SVGFrameCacheEntry {
+    uint32_t crc;
+    int size;
+    uint8_t *data;
+    AVFrame *frame;
+    uint64_t last_used;
+};
+
+void ff_svg_target_size(double iw, double ih, int width, int height,
+                        int keep_ar, int fit, int *out_w, int *out_h)
+{
+    if (fit != SVG_FIT_FILL && iw > 0 && ih > 0) {
+        double scale = 1.0;
+
+        if (width && height)
+            scale = FFMIN(width / iw, height / ih);
+        else if (width)
+            scale = width / iw;
+        else if (height)
+            scale = height / ih;
+
+        if (fit == SVG_FIT_SHRINK)
+            scale = FFMIN(scale, 1.0);
+
+        *out_w = FFMAX(lrint(iw * scale), 1);
+        *out_h = FFMAX(lrint(ih * scale), 1);
+        return;
+    }
+
+    *out_w = width  ? width  : (int)iw;
+    *out_h = height ? height : (int)ih;
+
+    if (keep_ar && (width || height) && iw > 0 && ih > 0) {
+        double default_ar = iw / ih;
+        if (!width)
+            *out_w = lrintf(*out_h * default_ar);
+        else
+            *out_h = lrintf(*out_w / default_ar);
+    }
+}
+
+static uint32_t packet_crc(const AVPacket *pkt)
+{
+    return av_crc(av_crc_get_table(AV_CRC_32_IEEE_LE), 0, pkt->data, pkt->size);
+}
+
+int ff_svg_cache_get(AVCodecContext *avctx, SVGFrameCache *cache,
+                     const AVPacket *pkt, AVFrame *frame)
+{
+    uint32_t crc;
+    int i, ret;
+
+    if (!cache->max_entries || !cache->nb_entries)
+        return 0;
+
+    crc = packet_crc(pkt);
+
+    for (i = 0; i < cache->nb_entries; i++) {
+        SVGFrameCacheEntry *e = &cache->entries[i];
+        const AVFrame *src = e->frame;
+        int j;
+
+        if (e->crc != crc || e->size != pkt->size ||
+            memcmp(e->data, pkt->data, pkt->size))
+            continue;
+
+        ret = ff_set_dimensions(avctx, src->width, src->height);
+        if (ret < 0)
+            return ret;
+        avctx->pix_fmt = src->format;
+
+        /* share the pixels only, the properties come from this packet */
+        frame->format = src->format;
+        frame->width  = src->width;
+        frame->height = src->height;
+        for (j = 0; j < FF_ARRAY_ELEMS(src->buf) && src->buf[j]; j++) {
+            frame->buf[j] = av_buffer_ref(src->buf[j]);
+            if (!frame->buf[j])
+                return AVERROR(ENOMEM);
+        }
+        memcpy(frame->data,     src->data,     sizeof(src->data));
+        memcpy(frame->linesize, src->linesize, sizeof(src->linesize));
+
+        ret = ff_decode_frame_props(avctx, frame);
+        if (ret < 0)
+            return ret;
+
+        e->last_used = ++cache->clock;
+        return 1;
+    }
+
+    return 0;
+}
+
+static void cache_entry_free(SVGFrameCacheEntry *e)
+{
+    av_freep(&e->data);
+    av_frame_free(&e->frame);
+}
+
+int ff_svg_cache_add(SVGFrameCache *cache, const AVPacket *pkt,
+                     const AVFrame *frame)
+{
+    SVGFrameCacheEntry *e;
+    int ret;
+
+    if (!cache->max_entries)
+        return 0;
+
+    if (cache->nb_entries < cache->max_entries) {
+        e = av_realloc_array(cache->entries, cache->nb_entries + 1,
+                             sizeof(*cache->entries));
+        if (!e)
+            return AVERROR(ENOMEM);
+        cache->entries = e;
+        e = &cache->entries[cache->nb_entries++];
+        memset(e, 0, sizeof(*e));
+    } else {
+        int i, lru = 0;
+        for (i = 1; i < cache->nb_entries; i++)
+            if (cache->entries[i].last_used < cache->entries[lru].last_used)
+                lru = i;
+        e = &cache->entries[lru];
+        cache_entry_free(e);
+    }
+
+    e->crc  = packet_crc(pkt);
+    e->size = pkt->size;
+    e->data = av_memdup(pkt->data, pkt->size);
+    e->frame = av_frame_alloc();
+    if (!e->data || !e->frame) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = av_frame_ref(e->frame, frame);
+    if (ret < 0)
+        goto fail;
+
+    e->last_used = ++cache->clock;
+    return 0;
+
+fail:
+    /* keep the slot, an entry without data never matches */
+    cache_entry_free(e);
+    e->size = -1;
+    return ret;
+}
+
+void ff_svg_cache_uninit(SVGFrameCache *cache)
+{
+    int i;
+
+    for (i = 0; i < cache->nb_entries; i++)
+        cache_entry_free(&cache->entries[i]);
+    av_freep(&cache->entries);
+    cache->nb_entries = 0;
+}
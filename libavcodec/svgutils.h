@@ -0,0 +1,79 @@
+/*
+ * Helpers shared by the SVG rasterizer wrappers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVCODEC_SVGUTILS_H
+#define AVCODEC_SVGUTILS_H
+
+#include <stdint.h>
+
+#include "libavutil/frame.h"
+
+#include "avcodec.h"
+#include "packet.h"
+
+enum SVGFitMode {
+    SVG_FIT_FILL,    ///< render at width x height as given
+    SVG_FIT_CONTAIN, ///< scale to fit inside width x height, keeping the aspect ratio
+    SVG_FIT_SHRINK,  ///< like contain, but never scale above the intrinsic size
+};
+
+/**
+ * Compute the size to rasterize a document to.
+ *
+ * @param iw, ih intrinsic document size
+ * @param width, height requested size, 0 for unconstrained
+ * @param keep_ar with SVG_FIT_FILL, derive the missing dimension from
+ *                the intrinsic aspect ratio
+ * @param fit an SVGFitMode
+ */
+void ff_svg_target_size(double iw, double ih, int width, int height,
+                        int keep_ar, int fit, int *out_w, int *out_h);
+
+typedef struct SVGFrameCacheEntry SVGFrameCacheEntry;
+
+/**
+ * Least recently used cache of rendered frames, keyed by packet content.
+ * The output size options are fixed per decoder instance, so identical
+ * packets always rasterize to identical frames.
+ */
+typedef struct SVGFrameCache {
+    SVGFrameCacheEntry *entries;
+    int nb_entries;
+    int max_entries; ///< 0 disables the cache
+    uint64_t clock;
+} SVGFrameCache;
+
+/**
+ * Look up pkt and on a hit, make frame reference the cached pixels.
+ *
+ * @return 1 on a hit, 0 on a miss, < 0 on error
+ */
+int ff_svg_cache_get(AVCodecContext *avctx, SVGFrameCache *cache,
+                     const AVPacket *pkt, AVFrame *frame);
+
+/**
+ * Store a reference to the pixels of frame rendered from pkt.
+ */
+int ff_svg_cache_add(SVGFrameCache *cache, const AVPacket *pkt,
+                     const AVFrame *frame);
+
+void ff_svg_cache_uninit(SVGFrameCache *cache);
+
+#endif /* AVCODEC_SVGUTILS_H */
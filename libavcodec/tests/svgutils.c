@@ -0,0 +1,167 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdio.h>
+
+#include "libavcodec/svgutils.c"
+
+#include "libavutil/pixfmt.h"
+
+static const char *const fit_names[] = { "fill", "contain", "shrink" };
+
+static void test_target_size(void)
+{
+    static const struct {
+        int iw, ih;
+        int width, height;
+    } sizes[] = {
+        { 200, 100,   0,   0 },
+        { 200, 100, 100,   0 },
+        { 200, 100,   0,  50 },
+        { 200, 100, 300, 300 },
+        { 200, 100,  50,  50 },
+        {  30,  90, 640, 360 },
+        {   0,   0, 100,   0 },
+    };
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(sizes); i++) {
+        for (int fit = SVG_FIT_FILL; fit <= SVG_FIT_SHRINK; fit++) {
+            for (int keep_ar = 0; keep_ar <= (fit == SVG_FIT_FILL); keep_ar++) {
+                int w, h;
+
+                ff_svg_target_size(sizes[i].iw, sizes[i].ih,
+                                   sizes[i].width, sizes[i].height,
+                                   keep_ar, fit, &w, &h);
+                printf("%dx%d in %dx%d, %s%s: %dx%d\n",
+                       sizes[i].iw, sizes[i].ih, sizes[i].width, sizes[i].height,
+                       fit_names[fit], keep_ar ? " keep_ar" : "", w, h);
+            }
+        }
+    }
+}
+
+static int render(AVFrame *frame, int width, int height, uint8_t value)
+{
+    int ret;
+
+    av_frame_unref(frame);
+    frame->format = AV_PIX_FMT_RGBA;
+    frame->width  = width;
+    frame->height = height;
+    ret = av_frame_get_buffer(frame, 0);
+    if (ret < 0)
+        return ret;
+    memset(frame->data[0], value, frame->linesize[0] * height);
+    return 0;
+}
+
+static int lookup(AVCodecContext *avctx, SVGFrameCache *cache,
+                  const char *doc, AVFrame *out, const AVFrame *rendered)
+{
+    AVPacket pkt = { .data = (uint8_t *)doc, .size = strlen(doc) };
+    int ret;
+
+    av_frame_unref(out);
+    ret = ff_svg_cache_get(avctx, cache, &pkt, out);
+    printf("get %-6s %s", doc, ret < 0 ? "error" : ret ? "hit" : "miss");
+    if (ret > 0)
+        printf(", %dx%d, %s pixels, value %d", out->width, out->height,
+               rendered && out->data[0] == rendered->data[0] ? "shared" : "other",
+               out->data[0][0]);
+    printf("\n");
+    return ret;
+}
+
+static int add(SVGFrameCache *cache, const char *doc, const AVFrame *frame)
+{
+    AVPacket pkt = { .data = (uint8_t *)doc, .size = strlen(doc) };
+    int ret = ff_svg_cache_add(cache, &pkt, frame);
+
+    printf("add %-6s %s, %d entries\n", doc, ret < 0 ? "error" : "ok",
+           cache->nb_entries);
+    return ret;
+}
+
+static int test_cache(AVCodecContext *avctx)
+{
+    SVGFrameCache cache = { .max_entries = 2 };
+    AVFrame *a = av_frame_alloc(), *b = av_frame_alloc();
+    AVFrame *c = av_frame_alloc(), *out = av_frame_alloc();
+    int ret = AVERROR(ENOMEM);
+
+    if (!a || !b || !c || !out)
+        goto end;
+
+    if ((ret = render(a, 16, 8, 1)) < 0 ||
+        (ret = render(b, 8, 16, 2)) < 0 ||
+        (ret = render(c, 4,  4, 3)) < 0)
+        goto end;
+
+    lookup(avctx, &cache, "<a/>", out, a);
+    add(&cache, "<a/>", a);
+    add(&cache, "<b/>", b);
+    lookup(avctx, &cache, "<a/>", out, a);
+    lookup(avctx, &cache, "<a />", out, NULL);
+    lookup(avctx, &cache, "<b/>", out, b);
+    lookup(avctx, &cache, "<a/>", out, a);
+    /* <b/> is now the least recently used entry */
+    add(&cache, "<c/>", c);
+    lookup(avctx, &cache, "<b/>", out, NULL);
+    lookup(avctx, &cache, "<c/>", out, c);
+    lookup(avctx, &cache, "<a/>", out, a);
+    printf("decoder size %dx%d\n", avctx->width, avctx->height);
+
+    ff_svg_cache_uninit(&cache);
+    lookup(avctx, &cache, "<a/>", out, NULL);
+
+    cache.max_entries = 0;
+    add(&cache, "<c/>", c);
+    lookup(avctx, &cache, "<c/>", out, NULL);
+    ret = 0;
+
+end:
+    ff_svg_cache_uninit(&cache);
+    av_frame_free(&a);
+    av_frame_free(&b);
+    av_frame_free(&c);
+    av_frame_free(&out);
+    return ret;
+}
+
+int main(void)
+{
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_RAWVIDEO);
+    AVCodecContext *avctx;
+    int ret;
+
+    test_target_size();
+
+    /* the cache sets the decoder dimensions and frame properties */
+    avctx = avcodec_alloc_context3(codec);
+    if (!avctx)
+        return 1;
+    avctx->width   = 1;
+    avctx->height  = 1;
+    avctx->pix_fmt = AV_PIX_FMT_RGBA;
+    ret = avcodec_open2(avctx, codec, NULL);
+    if (ret >= 0)
+        ret = test_cache(avctx);
+    avcodec_free_context(&avctx);
+
+    return ret < 0;
+}
@@ -40,6 +40,7 @@
 #include "demux.h"
 #include "mux.h"
 #include "internal.h"
+#include "probecache.h"
 
 void ff_free_stream(AVStream **pst)
 {
@@ -70,6 +71,7 @@ FF_ENABLE_DEPRECATION_WARNINGS
 
     if (sti->info) {
         av_freep(&sti->info->duration_error);
+        av_packet_free(&sti->info->probe_pkt);
         av_freep(&sti->info);
     }
 
@@ -182,6 +184,7 @@ void avformat_free_context(AVFormatContext *s)
     av_freep(&s->chapters);
     av_dict_free(&s->metadata);
     av_dict_free(&si->id3v2_meta);
+    ff_probe_cache_free(s);
     av_packet_free(&si->pkt);
     av_packet_free(&si->parse_pkt);
     av_freep(&s->streams);
@@ -1914,6 +1914,32 @@ typedef struct AVFormatContext {
      * @see skip_estimate_duration_from_pts
      */
     int64_t duration_probesize;
+
+    /**
+     * Number of threads avformat_find_stream_info() uses to decode packets
+     * of different streams in parallel, while the caller's thread keeps
+     * demuxing. 0 decodes everything on the caller's thread.
+     *
+     * In parallel mode, a few more packets than strictly needed may be
+     * read before probing stops.
+     *
+     * Demuxing only, set by the caller before avformat_find_stream_info().
+     */
+    int probe_threads;
+
+    /**
+     * Cache the results of input format probing and
+     * avformat_find_stream_info() across opens of the same input.
+     * "memory" keeps them in a process wide table, any other non-empty
+     * value is a directory to keep them in, one file per input.
+     *
+     * An entry is used when the URL, the input size, the probing options
+     * and the first 64 KiB of the input match, and the demuxer creates the
+     * cached streams while reading the header.
+     *
+     * Demuxing only, set by the caller before avformat_open_input().
+     */
+    char *probe_cache;
 } AVFormatContext;
 
 /**
@@ -2626,6 +2652,29 @@ int av_write_frame(AVFormatContext *s, AVPacket *pkt);
  */
 int av_interleaved_write_frame(AVFormatContext *s, AVPacket *pkt);
 
+/**
+ * Write several packets to an output media file ensuring correct
+ * interleaving.
+ *
+ * This is equivalent to calling av_interleaved_write_frame() on each packet
+ * in order, the packets are still interleaved one by one. The only difference
+ * is that the output is flushed (as requested by
+ * AVFormatContext.flush_packets) once after the last packet instead of after
+ * every one, which lets protocols supporting it combine the writes.
+ *
+ * @param s       media file handle
+ * @param pkts    array of nb_pkts packets, with the same requirements as the
+ *                pkt parameter of av_interleaved_write_frame(); they must not
+ *                be NULL. All of them are blank on return, even on error;
+ *                the ones following a failing packet are discarded.
+ * @param nb_pkts number of packets in pkts
+ *
+ * @return 0 on success, a negative AVERROR on error.
+ *
+ * @see av_interleaved_write_frame()
+ */
+int av_interleaved_write_frames(AVFormatContext *s, AVPacket **pkts, int nb_pkts);
+
 /**
  * Write an uncoded frame to an output media file.
  *
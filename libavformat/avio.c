@@ -90,8 +90,13 @@ static const AVClass *child_class_iterate(void **iter)
 #define AVIOOFFSET(x) offsetof(AVIOContext,x)
 #define E AV_OPT_FLAG_ENCODING_PARAM
 #define D AV_OPT_FLAG_DECODING_PARAM
+#define FFIOOFFSET(x) offsetof(FFIOContext,x)
 static const AVOption avio_options[] = {
     {"protocol_whitelist", "List of protocols that are allowed to be used", AVIOOFFSET(protocol_whitelist), AV_OPT_TYPE_STRING, { .str = NULL },  0, 0, D },
+    {"adaptive_buffer", "Resize the read buffer from the observed read sizes, latency and seeks", FFIOOFFSET(adaptive_buffer), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D },
+    {"adaptive_buffer_min", "Minimum adaptive read buffer size", FFIOOFFSET(adaptive_buffer_min), AV_OPT_TYPE_INT, { .i64 = 4096 }, 512, INT_MAX / 2, D },
+    {"adaptive_buffer_max", "Maximum adaptive read buffer size", FFIOOFFSET(adaptive_buffer_max), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 512, INT_MAX / 2, D },
+    {"buffer_refs", "Let packets reference the read buffer instead of copying it", FFIOOFFSET(buffer_refs), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D },
     { NULL },
 };
 
@@ -437,6 +442,8 @@ int ffio_fdopen(AVIOContext **sp, URLContext *h)
         return AVERROR(ENOMEM);
     }
     s = *sp;
+    s->av_class = &ff_avio_class;
+    av_opt_set_defaults(s);
     if (h->protocol_whitelist) {
         s->protocol_whitelist = av_strdup(h->protocol_whitelist);
         if (!s->protocol_whitelist) {
@@ -464,7 +471,36 @@ int ffio_fdopen(AVIOContext **sp, URLContext *h)
             s->seekable |= AVIO_SEEKABLE_TIME;
     }
     ((FFIOContext*)s)->short_seek_get = ffurl_get_short_seek;
-    s->av_class = &ff_avio_class;
+    if ((h->flags & AVIO_FLAG_WRITE) && h->prot && h->prot->url_writev &&
+        !max_packet_size)
+        ((FFIOContext*)s)->write_vec = ffurl_writev2;
+    if (!(h->flags & AVIO_FLAG_WRITE)) {
+        ffurl_get_mapping(h, &((FFIOContext*)s)->mapping);
+        ((FFIOContext*)s)->buffer_refs_allowed = 1;
+    }
+    return 0;
+}
+
+/* Only the options that configure the AVIOContext itself; everything else
+ * is left in the dictionary for the caller to report as unused. */
+static const char *const avio_open_options[] = {
+    "adaptive_buffer", "adaptive_buffer_min", "adaptive_buffer_max",
+    "buffer_refs",
+};
+
+static int avio_set_open_options(AVIOContext *s, AVDictionary **options)
+{
+    for (int i = 0; i < FF_ARRAY_ELEMS(avio_open_options); i++) {
+        const AVDictionaryEntry *e = av_dict_get(*options, avio_open_options[i], NULL, 0);
+        int ret;
+
+        if (!e)
+            continue;
+        ret = av_opt_set(s, e->key, e->value, 0);
+        if (ret < 0)
+            return ret;
+        av_dict_set(options, avio_open_options[i], NULL, 0);
+    }
     return 0;
 }
 
@@ -485,6 +521,10 @@ int ffio_open_whitelist(AVIOContext **s, const char *filename, int flags,
         ffurl_close(h);
         return err;
     }
+    if (options && (err = avio_set_open_options(*s, options)) < 0) {
+        avio_closep(s);
+        return err;
+    }
     return 0;
 }
 
@@ -574,6 +614,44 @@ int ffurl_write2(void *urlcontext, const uint8_t *buf, int size)
     return retry_transfer_wrapper(h, NULL, buf, size, size, 0);
 }
 
+int ffurl_writev2(void *urlcontext, const uint8_t *const *bufs,
+                  const int *sizes, int nb_bufs)
+{
+    URLContext *h = urlcontext;
+    int i = 0, total = 0;
+
+    if (!(h->flags & AVIO_FLAG_WRITE))
+        return AVERROR(EIO);
+
+    while (i < nb_bufs) {
+        int ret, off = 0;
+
+        if (h->prot->url_writev && !h->max_packet_size) {
+            if (ff_check_interrupt(&h->interrupt_callback))
+                return AVERROR_EXIT;
+            ret = h->prot->url_writev(h, bufs + i, sizes + i, nb_bufs - i);
+            if (ret == AVERROR(EINTR))
+                continue;
+            if (ret < 0 && (ret != AVERROR(EAGAIN) || h->flags & AVIO_FLAG_NONBLOCK))
+                return ret;
+            /* skip what was written, then finish a partially written
+             * buffer (or one that would block) with the retrying path */
+            for (off = FFMAX(ret, 0); i < nb_bufs && off >= sizes[i]; i++) {
+                off   -= sizes[i];
+                total += sizes[i];
+            }
+            if (i == nb_bufs || (ret > 0 && !off))
+                continue;
+        }
+
+        ret = ffurl_write2(h, bufs[i] + off, sizes[i] - off);
+        if (ret < 0)
+            return ret;
+        total += sizes[i++];
+    }
+    return total;
+}
+
 int64_t ffurl_seek2(void *urlcontext, int64_t pos, int whence)
 {
     URLContext *h = urlcontext;
@@ -626,7 +704,9 @@ int avio_close(AVIOContext *s)
     h         = s->opaque;
     s->opaque = NULL;
 
-    av_freep(&s->buffer);
+    /* a pool buffer is released with the context */
+    if (!ctx->buffer_ref)
+        av_freep(&s->buffer);
     if (s->write_flag)
         av_log(s, AV_LOG_VERBOSE,
                "Statistics: %"PRId64" bytes written, %d seeks, %d writeouts\n",
@@ -634,6 +714,9 @@ int avio_close(AVIOContext *s)
     else
         av_log(s, AV_LOG_VERBOSE, "Statistics: %"PRId64" bytes read, %d seeks\n",
                ctx->bytes_read, ctx->seek_count);
+    if (ctx->adaptive_buffer)
+        av_log(s, AV_LOG_VERBOSE, "Adaptive buffer: final size %d, %d grows, %d shrinks\n",
+               ctx->orig_buffer_size, ctx->adapt_grows, ctx->adapt_shrinks);
     av_opt_free(s);
 
     error = s->error;
@@ -844,6 +927,13 @@ int ffurl_get_short_seek(void *urlcontext)
     return h->prot->url_get_short_seek(h);
 }
 
+int ffurl_get_mapping(URLContext *h, AVBufferRef **buf)
+{
+    if (!h || !h->prot || !h->prot->url_get_mapping)
+        return AVERROR(ENOSYS);
+    return h->prot->url_get_mapping(h, buf);
+}
+
 int ffurl_shutdown(URLContext *h, int flags)
 {
     if (!h || !h->prot || !h->prot->url_shutdown)
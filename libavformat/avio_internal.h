@@ -21,6 +21,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -76,6 +77,60 @@ typedef struct FFIOContext {
      * is updated each time a successful writeout ends up further position-wise
      */
     int64_t written_output_size;
+
+    /**
+     * Read-only mapping of the whole resource, if the protocol provides one
+     */
+    AVBufferRef *mapping;
+
+    /**
+     * Set if av_get_packet() may return packets referencing the read
+     * buffer, i.e. the demuxer never writes to packet data.
+     */
+    int zero_copy_packets;
+
+    /**
+     * Set if the read buffer is owned by lavf, so that ffio_read_ref() may
+     * move it into buffer_pool and hand out references to it.
+     */
+    int buffer_refs_allowed;
+
+    /**
+     * The buffer_refs option: ffio_read_ref() only references the buffer
+     * if set, as each reference keeps the whole buffer alive.
+     */
+    int buffer_refs;
+
+    /**
+     * Pool buffer that buffer points into, NULL while buffer is a plain
+     * allocation
+     */
+    AVBufferRef *buffer_ref;
+    AVBufferPool *buffer_pool;
+    size_t buffer_pool_size;
+
+    /**
+     * Adaptive read buffer sizing: the buffer size is re-evaluated after
+     * every window of read calls and orig_buffer_size set to the result.
+     */
+    int adaptive_buffer;
+    int adaptive_buffer_min;
+    int adaptive_buffer_max;
+    int adapt_calls;           ///< read calls in the current window
+    int adapt_seeks;           ///< seek_count at the start of the window
+    int64_t adapt_bytes;       ///< bytes returned in the current window
+    int64_t adapt_requested;   ///< bytes requested in the current window
+    int64_t adapt_time;        ///< microseconds spent reading in the window
+    int adapt_grows;
+    int adapt_shrinks;
+
+    /**
+     * Optional vectored variant of write_packet. If set, avio_write() passes
+     * large payloads to it together with the buffered data instead of
+     * copying them into the buffer first.
+     */
+    int (*write_vec)(void *opaque, const uint8_t *const *bufs,
+                     const int *sizes, int nb_bufs);
 } FFIOContext;
 
 static av_always_inline FFIOContext *ffiocontext(AVIOContext *ctx)
@@ -119,6 +174,41 @@ void ffio_init_write_context(FFIOContext *s, uint8_t *buffer, int buffer_size);
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Get a pointer to the data at the current position in the memory mapping
+ * of the underlying resource, without reading it. The data stays valid as
+ * long as the IO context is open. Consume it with ffio_skip_mapped().
+ *
+ * @return number of bytes mapped from the current position on,
+ *         AVERROR(ENOSYS) if there is no mapping or it ends before it
+ */
+int ffio_peek_mapped(AVIOContext *s, const uint8_t **data);
+
+/**
+ * Skip size bytes of the memory mapping of the underlying resource, after
+ * ffio_peek_mapped(), without reading them.
+ */
+int ffio_skip_mapped(AVIOContext *s, int size);
+
+/**
+ * Read up to size bytes without copying them, by referencing the I/O
+ * buffer itself. This is only done with the buffer_refs option. The data
+ * must end the buffered data, so that it can be followed by
+ * AV_INPUT_BUFFER_PADDING_SIZE zero bytes: if less than size bytes are
+ * buffered, the rest is read into a fresh buffer after them, reading no
+ * more than size bytes. The data can be used as packet data, but it must
+ * not be written to.
+ *
+ * @param partial if 0, read until size bytes are buffered or EOF; if 1,
+ *                return whatever is buffered, reading once if nothing is
+ * @param buf set to a new reference to the I/O buffer on success
+ * @param data set to the start of the data read on success
+ * @return number of bytes read, AVERROR(ENOSYS) if the data can not be
+ *         referenced, in which case nothing was read, or another AVERROR
+ */
+int ffio_read_ref(AVIOContext *s, int size, int partial,
+                  AVBufferRef **buf, uint8_t **data);
+
 void ffio_fill(AVIOContext *s, int b, int64_t count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
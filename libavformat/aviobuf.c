@@ -27,6 +27,7 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/avassert.h"
+#include "libavutil/time.h"
 #include "libavcodec/defs.h"
 #include "avio.h"
 #include "avio_internal.h"
@@ -42,6 +43,17 @@
  */
 #define SHORT_SEEK_THRESHOLD 32768
 
+/**
+ * Number of read calls the adaptive buffer size is evaluated over.
+ */
+#define ADAPT_WINDOW 16
+
+/**
+ * Mean read call duration in microseconds above which the per call cost
+ * is considered high enough for a larger buffer to pay off.
+ */
+#define ADAPT_MIN_LATENCY 100
+
 static void fill_buffer(AVIOContext *s);
 static int url_resetbuf(AVIOContext *s, int flags);
 /** @warning must be called before any I/O */
@@ -125,9 +137,30 @@ AVIOContext *avio_alloc_context(
 
 void avio_context_free(AVIOContext **ps)
 {
+    if (*ps) {
+        FFIOContext *const ctx = ffiocontext(*ps);
+        av_buffer_unref(&ctx->mapping);
+        av_buffer_unref(&ctx->buffer_ref);
+        av_buffer_pool_uninit(&ctx->buffer_pool);
+    }
     av_freep(ps);
 }
 
+static void writeout_done(AVIOContext *s, int ret, int len)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    if (ret < 0) {
+        s->error = ret;
+    } else {
+        ctx->bytes_written += len;
+        s->bytes_written = ctx->bytes_written;
+
+        if (s->pos + len > ctx->written_output_size) {
+            ctx->written_output_size = s->pos + len;
+        }
+    }
+}
+
 static void writeout(AVIOContext *s, const uint8_t *data, int len)
 {
     FFIOContext *const ctx = ffiocontext(s);
@@ -140,16 +173,7 @@ static void writeout(AVIOContext *s, const uint8_t *data, int len)
                                      ctx->last_time);
         else if (s->write_packet)
             ret = s->write_packet(s->opaque, data, len);
-        if (ret < 0) {
-            s->error = ret;
-        } else {
-            ctx->bytes_written += len;
-            s->bytes_written = ctx->bytes_written;
-
-            if (s->pos + len > ctx->written_output_size) {
-                ctx->written_output_size = s->pos + len;
-            }
-        }
+        writeout_done(s, ret, len);
     }
     if (ctx->current_type == AVIO_DATA_MARKER_SYNC_POINT ||
         ctx->current_type == AVIO_DATA_MARKER_BOUNDARY_POINT) {
@@ -160,6 +184,25 @@ static void writeout(AVIOContext *s, const uint8_t *data, int len)
     s->pos += len;
 }
 
+/**
+ * Write out the buffered data followed by data with a single vectored
+ * write, leaving the buffer empty.
+ */
+static void writeout_vec(AVIOContext *s, const uint8_t *data, int len)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    const uint8_t *bufs[2] = { s->buffer, data };
+    int sizes[2] = { s->buf_ptr - s->buffer, len };
+
+    len += sizes[0];
+    if (!s->error)
+        writeout_done(s, ctx->write_vec(s->opaque, bufs, sizes, 2), len);
+    ctx->last_time = AV_NOPTS_VALUE;
+    ctx->writeout_count++;
+    s->pos += len;
+    s->buf_ptr = s->buf_ptr_max = s->buffer;
+}
+
 static void flush_buffer(AVIOContext *s)
 {
     s->buf_ptr_max = FFMAX(s->buf_ptr, s->buf_ptr_max);
@@ -207,6 +250,13 @@ void avio_write(AVIOContext *s, const unsigned char *buf, int size)
         writeout(s, buf, size);
         return;
     }
+    if (ffiocontext(s)->write_vec && !s->update_checksum &&
+        !s->write_data_type && size >= s->buffer_size &&
+        s->buf_ptr >= s->buf_ptr_max &&
+        size <= INT_MAX - (s->buf_ptr - s->buffer)) {
+        writeout_vec(s, buf, size);
+        return;
+    }
     do {
         int len = FFMIN(s->buf_end - s->buf_ptr, size);
         memcpy(s->buf_ptr, buf, len);
@@ -508,14 +558,122 @@ static int read_packet_wrapper(AVIOContext *s, uint8_t *buf, int size)
 
 /* Input stream */
 
+/**
+ * Free the I/O buffer, whether it is a plain allocation or lives in the
+ * buffer pool.
+ */
+static void free_buffer(AVIOContext *s)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+
+    if (ctx->buffer_ref)
+        av_buffer_unref(&ctx->buffer_ref);
+    else
+        av_free(s->buffer);
+    s->buffer = NULL;
+}
+
+static int buffer_writable(AVIOContext *s)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    return !ctx->buffer_ref || av_buffer_is_writable(ctx->buffer_ref);
+}
+
+/**
+ * Get an unused pool buffer large enough for buffer_size bytes plus padding.
+ */
+static AVBufferRef *buffer_get(AVIOContext *s)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    size_t size = s->buffer_size + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    if (ctx->buffer_pool_size != size) {
+        av_buffer_pool_uninit(&ctx->buffer_pool);
+        ctx->buffer_pool = av_buffer_pool_init(size, NULL);
+        if (!ctx->buffer_pool)
+            return NULL;
+        ctx->buffer_pool_size = size;
+    }
+    return av_buffer_pool_get(ctx->buffer_pool);
+}
+
+/**
+ * Replace buffer by the pool buffer ref, which must hold the buffered data
+ * at the same offsets. Pointers into the buffer are rebased.
+ */
+static void buffer_replace(AVIOContext *s, AVBufferRef *ref)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+
+    s->buf_ptr     = ref->data + (s->buf_ptr     - s->buffer);
+    s->buf_end     = ref->data + (s->buf_end     - s->buffer);
+    s->buf_ptr_max = ref->data + (s->buf_ptr_max - s->buffer);
+    if (s->update_checksum)
+        s->checksum_ptr = ref->data + (s->checksum_ptr - s->buffer);
+
+    free_buffer(s);
+    s->buffer       = ref->data;
+    ctx->buffer_ref = ref;
+}
+
+/**
+ * Account a read call and at the end of each window pick a new buffer size:
+ * halve it if seeks discard the buffer before it is consumed, double it if
+ * the protocol fills whole buffers and read calls are slow.
+ */
+static void adapt_buffer_size(AVIOContext *s, int len, int requested, int64_t elapsed)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    int seeks, size = ctx->orig_buffer_size;
+
+    ctx->adapt_calls++;
+    ctx->adapt_bytes     += len;
+    ctx->adapt_requested += requested;
+    ctx->adapt_time      += elapsed;
+    if (ctx->adapt_calls < ADAPT_WINDOW)
+        return;
+
+    seeks = ctx->seek_count - ctx->adapt_seeks;
+    if (seeks * 4 > ctx->adapt_calls)
+        size /= 2;
+    else if (!seeks && ctx->adapt_bytes * 4 >= ctx->adapt_requested * 3 &&
+             ctx->adapt_time >= (int64_t)ADAPT_MIN_LATENCY * ctx->adapt_calls)
+        size *= 2;
+    size = av_clip(size, ctx->adaptive_buffer_min, ctx->adaptive_buffer_max);
+
+    if (size != ctx->orig_buffer_size) {
+        av_log(s, AV_LOG_DEBUG, "Buffer size %d -> %d: %"PRId64" bytes and "
+               "%"PRId64" us per read, %d seeks in %d reads\n",
+               ctx->orig_buffer_size, size,
+               ctx->adapt_bytes / ctx->adapt_calls,
+               ctx->adapt_time  / ctx->adapt_calls, seeks, ctx->adapt_calls);
+        if (size > ctx->orig_buffer_size)
+            ctx->adapt_grows++;
+        else
+            ctx->adapt_shrinks++;
+        ctx->orig_buffer_size = size;
+    }
+
+    ctx->adapt_calls     = 0;
+    ctx->adapt_seeks     = ctx->seek_count;
+    ctx->adapt_bytes     =
+    ctx->adapt_requested =
+    ctx->adapt_time      = 0;
+}
+
 static void fill_buffer(AVIOContext *s)
 {
     FFIOContext *const ctx = (FFIOContext *)s;
+    int adaptive        = ctx->adaptive_buffer && s->read_packet &&
+                          !s->max_packet_size;
+    int64_t start       = 0;
+    int requested       = 0;
     int max_buffer_size = s->max_packet_size ?
                           s->max_packet_size : IO_BUFFER_SIZE;
     uint8_t *dst        = s->buf_end - s->buffer + max_buffer_size <= s->buffer_size ?
                           s->buf_end : s->buffer;
     int len             = s->buffer_size - (dst - s->buffer);
+    AVBufferRef *next   = NULL;
 
     /* can't fill the buffer without read_packet, just set EOF if appropriate */
     if (!s->read_packet && s->buf_ptr >= s->buf_end)
@@ -532,6 +690,17 @@ static void fill_buffer(AVIOContext *s)
         s->checksum_ptr = s->buffer;
     }
 
+    /* grow the buffer as decided by adapt_buffer_size() once it is drained */
+    if (adaptive && s->buffer_size < ctx->orig_buffer_size &&
+        dst == s->buffer && s->buf_ptr >= s->buf_end) {
+        int ret = set_buf_size(s, ctx->orig_buffer_size);
+        if (ret < 0)
+            av_log(s, AV_LOG_WARNING, "Failed to increase buffer size\n");
+
+        s->checksum_ptr = dst = s->buffer;
+        len = s->buffer_size;
+    }
+
     /* make buffer smaller in case it ended up large after probing */
     if (s->read_packet && ctx->orig_buffer_size &&
         s->buffer_size > ctx->orig_buffer_size  && len >= ctx->orig_buffer_size) {
@@ -545,7 +714,33 @@ static void fill_buffer(AVIOContext *s)
         len = ctx->orig_buffer_size;
     }
 
+    /* packets still reference the buffer, continue in a fresh one and
+     * switch to it only if the read succeeded, so that the old data
+     * remains for seeking back at EOF */
+    if (!buffer_writable(s)) {
+        next = buffer_get(s);
+        if (!next) {
+            s->eof_reached = 1;
+            s->error = AVERROR(ENOMEM);
+            return;
+        }
+        memcpy(next->data, s->buffer, dst - s->buffer);
+        dst = next->data + (dst - s->buffer);
+    }
+
+    if (adaptive) {
+        requested = len;
+        start     = av_gettime_relative();
+    }
     len = read_packet_wrapper(s, dst, len);
+    if (adaptive && len >= 0)
+        adapt_buffer_size(s, len, requested, av_gettime_relative() - start);
+    if (next) {
+        if (len >= 0)
+            buffer_replace(s, next);
+        else
+            av_buffer_unref(&next);
+    }
     if (len == AVERROR_EOF) {
         /* do not modify buffer if EOF reached so that a seek back can
            be done without rereading data */
@@ -681,6 +876,133 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+int ffio_peek_mapped(AVIOContext *s, const uint8_t **data)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    int64_t pos;
+
+    if (!ctx->mapping || s->write_flag || s->update_checksum || !s->seek)
+        return AVERROR(ENOSYS);
+
+    pos = avio_tell(s);
+    if (pos < 0 || pos >= ctx->mapping->size)
+        return AVERROR(ENOSYS);
+
+    *data = ctx->mapping->data + pos;
+    return FFMIN(ctx->mapping->size - pos, INT_MAX);
+}
+
+int ffio_skip_mapped(AVIOContext *s, int size)
+{
+    int64_t pos, res;
+
+    if (s->buf_end - s->buf_ptr >= size) {
+        s->buf_ptr += size;
+        return 0;
+    }
+
+    /* skip past the data without reading it into the buffer,
+     * seeking in a mapped resource is cheap */
+    pos = avio_tell(s);
+    res = s->seek(s->opaque, pos + size, SEEK_SET);
+    if (res < 0)
+        return res;
+    s->buf_end = s->buf_ptr = s->buf_ptr_max = s->buffer;
+    s->pos = pos + size;
+    s->eof_reached = 0;
+    return 0;
+}
+
+/**
+ * Continue in a fresh pool buffer that holds the buffered data followed by
+ * newly read data, size bytes at most, so that no further data follows.
+ * With partial set, read once, otherwise until size bytes are buffered or
+ * EOF.
+ */
+static int fill_buffer_exact(AVIOContext *s, int size, int partial)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    int len = s->buf_end - s->buf_ptr;
+    AVBufferRef *ref;
+
+    if (s->eof_reached && !len)
+        return s->error ? s->error : AVERROR_EOF;
+
+    ref = buffer_get(s);
+    if (!ref)
+        return AVERROR(ENOMEM);
+    memcpy(ref->data, s->buf_ptr, len);
+
+    while (len < size && !s->eof_reached) {
+        int ret = read_packet_wrapper(s, ref->data + len, size - len);
+        if (ret < 0) {
+            s->eof_reached = 1;
+            if (ret != AVERROR_EOF)
+                s->error = ret;
+            break;
+        }
+        s->pos += ret;
+        ctx->bytes_read += ret;
+        s->bytes_read    = ctx->bytes_read;
+        len += ret;
+        if (partial)
+            break;
+    }
+    if (!len) {
+        av_buffer_unref(&ref);
+        return s->error ? s->error : AVERROR_EOF;
+    }
+
+    free_buffer(s);
+    s->buffer       = ref->data;
+    ctx->buffer_ref = ref;
+    s->buf_ptr      = s->buf_ptr_max = s->buffer;
+    s->buf_end      = s->buffer + len;
+    return 0;
+}
+
+int ffio_read_ref(AVIOContext *s, int size, int partial,
+                  AVBufferRef **buf, uint8_t **data)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    int len, ret;
+
+    if (!ctx->buffer_refs || !ctx->buffer_refs_allowed ||
+        s->write_flag || s->update_checksum || size <= 0)
+        return AVERROR(ENOSYS);
+
+    /* the padding after the data must be zero, which it can only be made
+     * if no buffered data follows */
+    len = s->buf_end - s->buf_ptr;
+    if (len > size)
+        return AVERROR(ENOSYS);
+
+    if (len < size && !(partial && len)) {
+        /* the protocol must allow reads of any size */
+        if (size > s->buffer_size || !s->read_packet || s->max_packet_size)
+            return AVERROR(ENOSYS);
+        if ((ret = fill_buffer_exact(s, size, partial)) < 0)
+            return ret;
+        len = s->buf_end - s->buf_ptr;
+    } else if (!ctx->buffer_ref) {
+        /* the buffer is followed by padding once it lives in the pool */
+        AVBufferRef *ref = buffer_get(s);
+        if (!ref)
+            return AVERROR(ENOMEM);
+        memcpy(ref->data, s->buffer, s->buf_end - s->buffer);
+        buffer_replace(s, ref);
+    }
+    memset(s->buf_end, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    *buf = av_buffer_ref(ctx->buffer_ref);
+    if (!*buf)
+        return AVERROR(ENOMEM);
+
+    *data = s->buf_ptr;
+    s->buf_ptr += len;
+    return len;
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -1039,16 +1361,17 @@ int ffio_ensure_seekback(AVIOContext *s, int64_t buf_size)
         return 0;
     av_assert0(!s->write_flag);
 
-    if (buf_size <= s->buffer_size) {
+    if (buf_size <= s->buffer_size && buffer_writable(s)) {
         update_checksum(s);
         memmove(s->buffer, s->buf_ptr, filled);
     } else {
+        buf_size = FFMAX(buf_size, s->buffer_size);
         buffer = av_malloc(buf_size);
         if (!buffer)
             return AVERROR(ENOMEM);
         update_checksum(s);
         memcpy(buffer, s->buf_ptr, filled);
-        av_free(s->buffer);
+        free_buffer(s);
         s->buffer = buffer;
         s->buffer_size = buf_size;
     }
@@ -1091,7 +1414,7 @@ static int set_buf_size(AVIOContext *s, int buf_size)
     if (!buffer)
         return AVERROR(ENOMEM);
 
-    av_free(s->buffer);
+    free_buffer(s);
     s->buffer = buffer;
     ffiocontext(s)->orig_buffer_size =
     s->buffer_size = buf_size;
@@ -1118,7 +1441,7 @@ int ffio_realloc_buf(AVIOContext *s, int buf_size)
     data_size = s->write_flag ? (s->buf_ptr - s->buffer) : (s->buf_end - s->buf_ptr);
     if (data_size > 0)
         memcpy(buffer, s->write_flag ? s->buffer : s->buf_ptr, data_size);
-    av_free(s->buffer);
+    free_buffer(s);
     s->buffer = buffer;
     ffiocontext(s)->orig_buffer_size = buf_size;
     s->buffer_size = buf_size;
@@ -1178,7 +1501,7 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char **bufp, int buf_si
         buf_size = new_size;
     }
 
-    av_free(s->buffer);
+    free_buffer(s);
     s->buf_ptr = s->buffer = buf;
     s->buffer_size = alloc_size;
     s->pos = buf_size;
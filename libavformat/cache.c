@@ -22,18 +22,40 @@
  */
 
 /**
+ * @file
+ * With cache_dir set, the cached data of each URL is kept across opens.
+ * The data file then holds every byte at its logical offset (sparse where
+ * nothing was fetched yet), and the ranges it holds are saved to an index
+ * file next to it on close:
+ *
+ *   "FFCACHE1"
+ *   be32 key length, key
+ *   be32 validator length, validator
+ *   be64 end, u8 is_true_eof
+ *   be32 number of ranges, per range be64 offset, be64 size
+ *
+ * An index whose key or validator does not match the current open is
+ * discarded together with its data. The modification time of the index
+ * is the last use of an entry for the cache_max_size LRU eviction.
+ *
  * @TODO
- *      support keeping files
  *      support filling with a background thread
  */
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
 #include "libavutil/file_open.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/sha.h"
 #include "libavutil/tree.h"
+#include "libavcodec/bytestream.h"
 #include "avio.h"
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#endif
 #include <fcntl.h>
 #if HAVE_IO_H
 #include <io.h>
@@ -43,13 +65,23 @@
 #endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#include "internal.h"
 #include "os_support.h"
 #include "url.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define INDEX_MAGIC "FFCACHE1"
+#define INDEX_SUFFIX ".index"
+#define DATA_SUFFIX  ".data"
+#define KEY_HASH_SIZE 20
+
 typedef struct CacheEntry {
     int64_t logical_pos;
     int64_t physical_pos;
-    int size;
+    int64_t size;
 } CacheEntry;
 
 typedef struct CacheContext {
@@ -65,6 +97,16 @@ typedef struct CacheContext {
     URLContext *inner;
     int64_t cache_hit, cache_miss;
     int read_ahead_limit;
+
+    char *cache_dir;
+    char *cache_key;
+    char *cache_validator;
+    int64_t cache_max_size;
+    /* persistent mode */
+    char *key;
+    char *validator;
+    char *data_filename;
+    char *index_filename;
 } CacheContext;
 
 static int cmp(const void *key, const void *node)
@@ -72,6 +114,347 @@ static int cmp(const void *key, const void *node)
     return FFDIFFSIGN(*(const int64_t *)key, ((const CacheEntry *) node)->logical_pos);
 }
 
+static int enu_free(void *opaque, void *elem)
+{
+    av_free(elem);
+    return 0;
+}
+
+static int add_range(CacheContext *c, int64_t pos, int64_t size)
+{
+    CacheEntry *entry = av_malloc(sizeof(*entry)), *entry_ret;
+    struct AVTreeNode *node = av_tree_node_alloc();
+
+    if (!entry || !node) {
+        av_free(entry);
+        av_free(node);
+        return AVERROR(ENOMEM);
+    }
+    entry->logical_pos  =
+    entry->physical_pos = pos;
+    entry->size         = size;
+    entry_ret = av_tree_insert(&c->root, entry, cmp, &node);
+    if (entry_ret && entry_ret != entry) {
+        av_free(entry);
+        av_free(node);
+        return AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
+static int load_index(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    GetByteContext gb;
+    uint8_t *buf = NULL;
+    struct stat st;
+    int fd, len, nb_ranges, err, ret = AVERROR_INVALIDDATA;
+    int64_t prev_end = 0;
+
+    fd = avpriv_open(c->index_filename, O_RDONLY | O_BINARY);
+    if (fd < 0)
+        return AVERROR(errno);
+    if (fstat(fd, &st) < 0 || st.st_size > INT_MAX)
+        goto end;
+    buf = av_malloc(st.st_size + 1);
+    if (!buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if (read(fd, buf, st.st_size) != st.st_size)
+        goto end;
+    bytestream2_init(&gb, buf, st.st_size);
+
+    if (bytestream2_get_bytes_left(&gb) < 8 || memcmp(gb.buffer, INDEX_MAGIC, 8))
+        goto end;
+    bytestream2_skip(&gb, 8);
+
+    len = bytestream2_get_be32(&gb);
+    if (len != strlen(c->key) || bytestream2_get_bytes_left(&gb) < len ||
+        memcmp(gb.buffer, c->key, len))
+        goto end;
+    bytestream2_skip(&gb, len);
+    len = bytestream2_get_be32(&gb);
+    if (len != strlen(c->validator) || bytestream2_get_bytes_left(&gb) < len ||
+        memcmp(gb.buffer, c->validator, len))
+        goto end;
+    bytestream2_skip(&gb, len);
+
+    if (bytestream2_get_bytes_left(&gb) < 13)
+        goto end;
+    c->end         = bytestream2_get_be64(&gb);
+    c->is_true_eof = bytestream2_get_byte(&gb);
+    nb_ranges      = bytestream2_get_be32(&gb);
+    if (c->end < 0 || nb_ranges < 0 || bytestream2_get_bytes_left(&gb) != nb_ranges * 16LL)
+        goto end;
+
+    for (int i = 0; i < nb_ranges; i++) {
+        int64_t pos  = bytestream2_get_be64(&gb);
+        int64_t size = bytestream2_get_be64(&gb);
+        if (pos < prev_end || size <= 0 || size > c->end - pos)
+            goto end;
+        if ((err = add_range(c, pos, size)) < 0) {
+            ret = err;
+            goto end;
+        }
+        prev_end = pos + size;
+    }
+    ret = nb_ranges;
+end:
+    close(fd);
+    av_free(buf);
+    return ret;
+}
+
+typedef struct IndexWriter {
+    AVBPrint *bp;
+    int64_t start, end;
+    int nb_ranges;
+} IndexWriter;
+
+static void put_be32(AVBPrint *bp, uint32_t v)
+{
+    uint8_t b[4];
+    AV_WB32(b, v);
+    av_bprint_append_data(bp, b, 4);
+}
+
+static void put_be64(AVBPrint *bp, uint64_t v)
+{
+    uint8_t b[8];
+    AV_WB64(b, v);
+    av_bprint_append_data(bp, b, 8);
+}
+
+static void flush_range(IndexWriter *w)
+{
+    if (w->end > w->start) {
+        put_be64(w->bp, w->start);
+        put_be64(w->bp, w->end - w->start);
+        w->nb_ranges++;
+    }
+}
+
+/* entries are visited in order, overlapping and adjacent ones are merged */
+static int enu_range(void *opaque, void *elem)
+{
+    IndexWriter *w = opaque;
+    const CacheEntry *e = elem;
+
+    if (e->logical_pos > w->end) {
+        flush_range(w);
+        w->start = e->logical_pos;
+        w->end   = e->logical_pos;
+    }
+    w->end = FFMAX(w->end, e->logical_pos + e->size);
+    return 0;
+}
+
+static int save_index(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    IndexWriter w = { 0 };
+    AVBPrint bp;
+    char *tmp;
+    int fd, ret = 0;
+    size_t count_pos;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprint_append_data(&bp, INDEX_MAGIC, 8);
+    put_be32(&bp, strlen(c->key));
+    av_bprintf(&bp, "%s", c->key);
+    put_be32(&bp, strlen(c->validator));
+    av_bprintf(&bp, "%s", c->validator);
+    put_be64(&bp, c->end);
+    av_bprint_chars(&bp, c->is_true_eof, 1);
+    count_pos = bp.len;
+    put_be32(&bp, 0);
+
+    w.bp = &bp;
+    av_tree_enumerate(c->root, &w, NULL, enu_range);
+    flush_range(&w);
+    if (!av_bprint_is_complete(&bp)) {
+        av_bprint_finalize(&bp, NULL);
+        return AVERROR(ENOMEM);
+    }
+    AV_WB32(bp.str + count_pos, w.nb_ranges);
+
+    /* replace the index atomically, a reader never sees a partial one */
+    tmp = av_asprintf("%s.tmp", c->index_filename);
+    if (!tmp) {
+        av_bprint_finalize(&bp, NULL);
+        return AVERROR(ENOMEM);
+    }
+    fd = avpriv_open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (fd < 0) {
+        ret = AVERROR(errno);
+    } else {
+        if (write(fd, bp.str, bp.len) != bp.len)
+            ret = AVERROR(EIO);
+        if (close(fd) < 0 && !ret)
+            ret = AVERROR(errno);
+    }
+    if (!ret && rename(tmp, c->index_filename) < 0) {
+        /* rename() does not replace existing files everywhere */
+        unlink(c->index_filename);
+        if (rename(tmp, c->index_filename) < 0)
+            ret = AVERROR(errno);
+    }
+    if (ret < 0) {
+        av_log(h, AV_LOG_ERROR, "Could not write cache index %s\n", c->index_filename);
+        unlink(tmp);
+    }
+    av_free(tmp);
+    av_bprint_finalize(&bp, NULL);
+    return ret;
+}
+
+#if HAVE_DIRENT_H
+typedef struct CacheFile {
+    char *name;
+    int64_t size;
+    time_t last_use;
+} CacheFile;
+
+static int cmp_last_use(const void *a, const void *b)
+{
+    return FFDIFFSIGN(((const CacheFile *)a)->last_use, ((const CacheFile *)b)->last_use);
+}
+
+static char *cache_path(CacheContext *c, const char *name, int name_len, const char *suffix)
+{
+    return av_asprintf("%s/%.*s%s", c->cache_dir, name_len, name, suffix);
+}
+
+/**
+ * Delete the least recently used entries until the cache directory holds
+ * at most cache_max_size bytes of data. The current entry is never deleted.
+ */
+static void evict_entries(URLContext *h)
+{
+    CacheContext *c = h->priv_data;
+    CacheFile *files = NULL;
+    int nb_files = 0;
+    int64_t total = 0;
+    struct dirent *de;
+    DIR *dir;
+
+    dir = opendir(c->cache_dir);
+    if (!dir)
+        return;
+
+    while ((de = readdir(dir))) {
+        size_t len = strlen(de->d_name);
+        char *index, *data;
+        struct stat st_index, st_data;
+        CacheFile *f;
+
+        if (len <= strlen(INDEX_SUFFIX) || !av_strstart(de->d_name + len - strlen(INDEX_SUFFIX), INDEX_SUFFIX, NULL))
+            continue;
+        len -= strlen(INDEX_SUFFIX);
+        index = cache_path(c, de->d_name, len, INDEX_SUFFIX);
+        data  = cache_path(c, de->d_name, len, DATA_SUFFIX);
+        if (index && data && !stat(index, &st_index) && !stat(data, &st_data) &&
+            strcmp(index, c->index_filename) &&
+            (f = av_dynarray2_add((void **)&files, &nb_files, sizeof(*files), NULL))) {
+            f->name     = av_strndup(de->d_name, len);
+            f->size     = st_data.st_size;
+            f->last_use = st_index.st_mtime;
+            total      += f->size;
+            if (!f->name)
+                nb_files--;
+        }
+        av_free(index);
+        av_free(data);
+    }
+    closedir(dir);
+
+    total += c->end;
+    qsort(files, nb_files, sizeof(*files), cmp_last_use);
+    for (int i = 0; i < nb_files; i++) {
+        if (total > c->cache_max_size) {
+            char *index = cache_path(c, files[i].name, strlen(files[i].name), INDEX_SUFFIX);
+            char *data  = cache_path(c, files[i].name, strlen(files[i].name), DATA_SUFFIX);
+            if (index && data && !unlink(index)) {
+                unlink(data);
+                total -= files[i].size;
+                av_log(h, AV_LOG_VERBOSE, "Evicted cache entry %s\n", files[i].name);
+            }
+            av_free(index);
+            av_free(data);
+        }
+        av_free(files[i].name);
+    }
+    av_free(files);
+}
+#endif
+
+static int cache_open_persistent(URLContext *h, const char *arg, int flags,
+                                 AVDictionary **options)
+{
+    CacheContext *c = h->priv_data;
+    uint8_t hash[KEY_HASH_SIZE];
+    char hex[2 * KEY_HASH_SIZE + 1];
+    struct AVSHA *sha;
+    int64_t size;
+    int ret;
+
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
+                               options, h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0)
+        return ret;
+
+    /* the resource size is the built in validator, cache_validator
+     * can add e.g. an ETag known to the caller */
+    size = FFMAX(ffurl_seek(c->inner, 0, AVSEEK_SIZE), -1);
+    c->key       = av_strdup(c->cache_key ? c->cache_key : arg);
+    c->validator = av_asprintf("%"PRId64";%s", size,
+                               c->cache_validator ? c->cache_validator : "");
+    sha = av_sha_alloc();
+    if (!c->key || !c->validator || !sha) {
+        av_free(sha);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    av_sha_init(sha, 8 * KEY_HASH_SIZE);
+    av_sha_update(sha, c->key, strlen(c->key));
+    av_sha_final(sha, hash);
+    av_free(sha);
+    ff_data_to_hex(hex, hash, KEY_HASH_SIZE, 1);
+    hex[2 * KEY_HASH_SIZE] = 0;
+
+    c->data_filename  = av_asprintf("%s/%s"DATA_SUFFIX,  c->cache_dir, hex);
+    c->index_filename = av_asprintf("%s/%s"INDEX_SUFFIX, c->cache_dir, hex);
+    if (!c->data_filename || !c->index_filename) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = load_index(h);
+    if (ret < 0) {
+        if (ret != AVERROR(ENOENT))
+            av_log(h, AV_LOG_VERBOSE, "Discarding cache entry %s\n", c->index_filename);
+        av_tree_enumerate(c->root, NULL, NULL, enu_free);
+        av_tree_destroy(c->root);
+        c->root = NULL;
+        c->end = c->is_true_eof = 0;
+        unlink(c->index_filename);
+        c->fd = avpriv_open(c->data_filename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    } else {
+        av_log(h, AV_LOG_VERBOSE, "Reusing %d cached ranges from %s\n", ret, c->data_filename);
+        c->fd = avpriv_open(c->data_filename, O_RDWR | O_CREAT | O_BINARY, 0666);
+    }
+    if (c->fd < 0) {
+        ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "Failed to open %s\n", c->data_filename);
+        goto fail;
+    }
+    return 0;
+fail:
+    ffurl_closep(&c->inner);
+    return ret;
+}
+
 static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     CacheContext *c = h->priv_data;
@@ -80,6 +463,9 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "cache:", &arg);
 
+    if (c->cache_dir)
+        return cache_open_persistent(h, arg, flags, options);
+
     c->fd = avpriv_tempfile("ffcache", &buffername, 0, h);
     if (c->fd < 0){
         av_log(h, AV_LOG_ERROR, "Failed to create tempfile\n");
@@ -107,7 +493,9 @@ static int add_entry(URLContext *h, const unsigned char *buf, int size)
     struct AVTreeNode *node = NULL;
 
     //FIXME avoid lseek
-    pos = lseek(c->fd, 0, SEEK_END);
+    /* persistent data files hold every byte at its logical offset */
+    pos = c->data_filename ? lseek(c->fd, c->logical_pos, SEEK_SET)
+                           : lseek(c->fd, 0, SEEK_END);
     if (pos < 0) {
         ret = AVERROR(errno);
         av_log(h, AV_LOG_ERROR, "seek in cache failed\n");
@@ -198,6 +586,10 @@ static int cache_read(URLContext *h, unsigned char *buf, int size)
 
     // Cache miss or some kind of fault with the cache
 
+    /* only fetch up to the next cached range */
+    if (next[1] && next[1]->logical_pos > c->logical_pos)
+        size = FFMIN(size, next[1]->logical_pos - c->logical_pos);
+
     if (c->logical_pos != c->inner_pos) {
         r = ffurl_seek(c->inner, c->logical_pos, SEEK_SET);
         if (r<0) {
@@ -290,12 +682,6 @@ resolve_eof:
     return ret;
 }
 
-static int enu_free(void *opaque, void *elem)
-{
-    av_free(elem);
-    return 0;
-}
-
 static int cache_close(URLContext *h)
 {
     CacheContext *c = h->priv_data;
@@ -304,6 +690,18 @@ static int cache_close(URLContext *h)
     av_log(h, AV_LOG_INFO, "Statistics, cache hits:%"PRId64" cache misses:%"PRId64"\n",
            c->cache_hit, c->cache_miss);
 
+    if (c->data_filename) {
+        save_index(h);
+#if HAVE_DIRENT_H
+        if (c->cache_max_size)
+            evict_entries(h);
+#endif
+        av_freep(&c->data_filename);
+        av_freep(&c->index_filename);
+        av_freep(&c->key);
+        av_freep(&c->validator);
+    }
+
     close(c->fd);
     if (c->filename) {
         ret = unlink(c->filename);
@@ -323,6 +721,10 @@ static int cache_close(URLContext *h)
 
 static const AVOption options[] = {
     { "read_ahead_limit", "Amount in bytes that may be read ahead when seeking isn't supported, -1 for unlimited", OFFSET(read_ahead_limit), AV_OPT_TYPE_INT, { .i64 = 65536 }, -1, INT_MAX, D },
+    { "cache_dir", "Keep the cached data in this directory across opens", OFFSET(cache_dir), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_key", "Identify the cached resource by this instead of the URL", OFFSET(cache_key), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_validator", "Discard cached data stored with a different validator, e.g. an ETag", OFFSET(cache_validator), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_max_size", "Evict least recently used entries beyond this many bytes in cache_dir, 0 for unlimited", OFFSET(cache_max_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     {NULL},
 };
 
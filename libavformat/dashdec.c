@@ -26,6 +26,7 @@
 #include "libavutil/opt.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
+#include "libavutil/thread.h"
 #include "internal.h"
 #include "avio_internal.h"
 #include "dash.h"
@@ -33,6 +34,7 @@
 #include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
+#define MAX_PREFETCH_FRAGMENTS 16
 
 struct fragment {
     int64_t url_offset;
@@ -40,6 +42,31 @@ struct fragment {
     char *url;
 };
 
+enum PrefetchState {
+    PREFETCH_FREE,
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+    PREFETCH_CONSUMING,
+};
+
+/*
+ * A fragment downloaded ahead of time by the fetch worker of its
+ * representation. The URL is resolved when the fragment is queued, so the
+ * worker never looks at the manifest, which may be refreshed while it runs.
+ */
+struct fragment_prefetch {
+    enum PrefetchState state;
+    int discard;
+    int64_t seq_no;
+    struct fragment seg;
+    AVDictionary *opts;
+    uint8_t *data;
+    int data_size;
+    int read_offset;
+    int ret;
+};
+
 /*
  * reference to : ISO_IEC_23009-1-DASH-2012
  * Section: 5.3.9.6.2
@@ -95,6 +122,10 @@ struct representation {
 
     int n_timelines;
     struct timeline **timelines;
+    /* SegmentTimeline element the last lookup ended in, see timeline_cursor_set() */
+    int timeline_cursor_idx;
+    int64_t timeline_cursor_num;
+    int64_t timeline_cursor_start;
 
     int64_t first_seq_no;
     int64_t last_seq_no;
@@ -118,6 +149,18 @@ struct representation {
     uint32_t init_sec_buf_read_offset;
     int64_t cur_timestamp;
     int is_restart_needed;
+
+    /* prefetch_fragments state, the slots hold the fragment being read
+     * and the ones downloaded ahead of it */
+    struct fragment_prefetch *cur_prefetch;
+#if HAVE_THREADS
+    struct fragment_prefetch prefetch[MAX_PREFETCH_FRAGMENTS + 1];
+    int prefetch_running;
+    int prefetch_abort;
+    pthread_t prefetch_thread;
+    pthread_mutex_t prefetch_mutex;
+    pthread_cond_t prefetch_cond;
+#endif
 };
 
 typedef struct DASHContext {
@@ -154,6 +197,7 @@ typedef struct DASHContext {
     AVDictionary *avio_opts;
     int max_url_size;
     char *cenc_decryption_key;
+    int prefetch_fragments;
 
     /* Flags for init section*/
     int is_init_section_common_video;
@@ -252,69 +296,103 @@ static uint32_t get_duration_insec(AVFormatContext *s, const char *duration)
     return  ((days * 24 + hours) * 60 + mins) * 60 + secs;
 }
 
+/*
+ * Lookups usually move forward through the SegmentTimeline, one fragment
+ * at a time, so resume them from the S element the previous one ended in.
+ * The cursor holds the state at the top of that element and stays valid
+ * when S elements are appended.
+ */
+static void timeline_cursor_reset(struct representation *pls)
+{
+    pls->timeline_cursor_idx   = 0;
+    pls->timeline_cursor_num   = 0;
+    pls->timeline_cursor_start = 0;
+}
+
+static void timeline_cursor_set(struct representation *pls, int idx,
+                                int64_t num, int64_t start_time)
+{
+    pls->timeline_cursor_idx   = idx;
+    pls->timeline_cursor_num   = num;
+    pls->timeline_cursor_start = start_time;
+}
+
 static int64_t get_segment_start_time_based_on_timeline(struct representation *pls, int64_t cur_seq_no)
 {
     int64_t start_time = 0;
-    int64_t i = 0;
-    int64_t j = 0;
     int64_t num = 0;
+    int i = 0;
 
-    if (pls->n_timelines) {
-        for (i = 0; i < pls->n_timelines; i++) {
-            if (pls->timelines[i]->starttime > 0) {
-                start_time = pls->timelines[i]->starttime;
-            }
-            if (num == cur_seq_no)
-                goto finish;
+    if (pls->timeline_cursor_idx <= pls->n_timelines &&
+        pls->timeline_cursor_num <= cur_seq_no) {
+        i          = pls->timeline_cursor_idx;
+        num        = pls->timeline_cursor_num;
+        start_time = pls->timeline_cursor_start;
+    }
 
-            start_time += pls->timelines[i]->duration;
+    for (; i < pls->n_timelines; i++) {
+        const struct timeline *tl = pls->timelines[i];
+        int64_t count = FFMAX(tl->repeat, 0) + 1;
+        int64_t element_start = tl->starttime > 0 ? tl->starttime : start_time;
 
-            if (pls->timelines[i]->repeat == -1) {
-                start_time = pls->timelines[i]->duration * cur_seq_no;
-                goto finish;
-            }
+        if (num == cur_seq_no) {
+            timeline_cursor_set(pls, i, num, start_time);
+            return element_start;
+        }
 
-            for (j = 0; j < pls->timelines[i]->repeat; j++) {
-                num++;
-                if (num == cur_seq_no)
-                    goto finish;
-                start_time += pls->timelines[i]->duration;
-            }
-            num++;
+        if (tl->repeat == -1) {
+            timeline_cursor_set(pls, i, num, start_time);
+            return tl->duration * cur_seq_no;
         }
+
+        if (cur_seq_no < num + count) {
+            timeline_cursor_set(pls, i, num, start_time);
+            return element_start + (cur_seq_no - num) * tl->duration;
+        }
+
+        start_time = element_start + count * tl->duration;
+        num += count;
     }
-finish:
+
+    timeline_cursor_set(pls, i, num, start_time);
     return start_time;
 }
 
 static int64_t calc_next_seg_no_from_timelines(struct representation *pls, int64_t cur_time)
 {
-    int64_t i = 0;
-    int64_t j = 0;
     int64_t num = 0;
     int64_t start_time = 0;
+    int i = 0;
 
-    for (i = 0; i < pls->n_timelines; i++) {
-        if (pls->timelines[i]->starttime > 0) {
-            start_time = pls->timelines[i]->starttime;
-        }
+    if (pls->timeline_cursor_idx <= pls->n_timelines &&
+        pls->timeline_cursor_start <= cur_time) {
+        i          = pls->timeline_cursor_idx;
+        num        = pls->timeline_cursor_num;
+        start_time = pls->timeline_cursor_start;
+    }
+
+    for (; i < pls->n_timelines; i++) {
+        const struct timeline *tl = pls->timelines[i];
+        int64_t count = FFMAX(tl->repeat, 0) + 1;
+        int64_t k;
+
+        if (tl->starttime > 0)
+            start_time = tl->starttime;
         if (start_time > cur_time)
-            goto finish;
+            return num;
 
-        start_time += pls->timelines[i]->duration;
-        for (j = 0; j < pls->timelines[i]->repeat; j++) {
-            num++;
-            if (start_time > cur_time)
-                goto finish;
-            start_time += pls->timelines[i]->duration;
+        /* first fragment of this element starting after cur_time */
+        k = tl->duration > 0 ? (cur_time - start_time) / tl->duration + 1 : count;
+        if (k < count) {
+            timeline_cursor_set(pls, i, num, start_time);
+            return num + k;
         }
-        num++;
+
+        start_time += count * tl->duration;
+        num += count;
     }
 
     return -1;
-
-finish:
-    return num;
 }
 
 static void free_fragment(struct fragment **seg)
@@ -346,10 +424,14 @@ static void free_timelines_list(struct representation *pls)
     }
     av_freep(&pls->timelines);
     pls->n_timelines = 0;
+    timeline_cursor_reset(pls);
 }
 
+static void prefetch_stop(struct representation *pls);
+
 static void free_representation(struct representation *pls)
 {
+    prefetch_stop(pls);
     free_fragment_list(pls);
     free_timelines_list(pls);
     free_fragment(&pls->cur_seg);
@@ -1597,29 +1679,68 @@ finish:
     return ret;
 }
 
+static struct fragment *copy_fragment(const struct fragment *src)
+{
+    struct fragment *seg = av_mallocz(sizeof(struct fragment));
+    if (!seg) {
+        return NULL;
+    }
+    seg->url = av_strdup(src->url);
+    if (!seg->url) {
+        av_free(seg);
+        return NULL;
+    }
+    seg->size = src->size;
+    seg->url_offset = src->url_offset;
+    return seg;
+}
+
+static struct fragment *get_template_fragment(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    struct fragment *seg;
+    char *tmpfilename;
+
+    if (!pls->url_template) {
+        av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
+        return NULL;
+    }
+    seg = av_mallocz(sizeof(struct fragment));
+    if (!seg) {
+        return NULL;
+    }
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename) {
+        av_free(seg);
+        return NULL;
+    }
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!seg->url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        seg->url = av_strdup(pls->url_template);
+        if (!seg->url) {
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+            av_free(tmpfilename);
+            av_free(seg);
+            return NULL;
+        }
+    }
+    av_free(tmpfilename);
+    seg->size = -1;
+
+    return seg;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
     int64_t max_seq_no = 0;
-    struct fragment *seg = NULL;
-    struct fragment *seg_ptr = NULL;
     DASHContext *c = pls->parent->priv_data;
 
     while (( !ff_check_interrupt(c->interrupt_callback)&& pls->n_fragments > 0)) {
         if (pls->cur_seq_no < pls->n_fragments) {
-            seg_ptr = pls->fragments[pls->cur_seq_no];
-            seg = av_mallocz(sizeof(struct fragment));
-            if (!seg) {
-                return NULL;
-            }
-            seg->url = av_strdup(seg_ptr->url);
-            if (!seg->url) {
-                av_free(seg);
-                return NULL;
-            }
-            seg->size = seg_ptr->size;
-            seg->url_offset = seg_ptr->url_offset;
-            return seg;
+            return copy_fragment(pls->fragments[pls->cur_seq_no]);
         } else if (c->is_live) {
             refresh_manifest(pls->parent);
         } else {
@@ -1639,45 +1760,11 @@ static struct fragment *get_current_fragment(struct representation *pls)
         } else if (pls->cur_seq_no > max_seq_no) {
             av_log(pls->parent, AV_LOG_VERBOSE, "new fragment: min[%"PRId64"] max[%"PRId64"]\n", min_seq_no, max_seq_no);
         }
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
-    } else if (pls->cur_seq_no <= pls->last_seq_no) {
-        seg = av_mallocz(sizeof(struct fragment));
-        if (!seg) {
-            return NULL;
-        }
-    }
-    if (seg) {
-        char *tmpfilename;
-        if (!pls->url_template) {
-            av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
-            av_free(seg);
-            return NULL;
-        }
-        tmpfilename = av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
-            av_free(seg);
-            return NULL;
-        }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                av_free(seg);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
-        seg->size = -1;
+    } else if (pls->cur_seq_no > pls->last_seq_no) {
+        return NULL;
     }
 
-    return seg;
+    return get_template_fragment(pls, pls->cur_seq_no);
 }
 
 static int read_from_url(struct representation *pls, struct fragment *seg,
@@ -1696,9 +1783,29 @@ static int read_from_url(struct representation *pls, struct fragment *seg,
     return ret;
 }
 
-static int open_input(DASHContext *c, struct representation *pls, struct fragment *seg)
+static int open_fragment(AVFormatContext *s, AVIOContext **in, const char *url,
+                         const struct fragment *seg, AVDictionary **avio_opts)
 {
     AVDictionary *opts = NULL;
+    int ret;
+
+    if (seg->size >= 0) {
+        /* try to restrict the HTTP request to the part we want
+         * (if this is in fact a HTTP request) */
+        av_dict_set_int(&opts, "offset", seg->url_offset, 0);
+        av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
+    }
+
+    av_log(s, AV_LOG_VERBOSE, "DASH request for url '%s', offset %"PRId64"\n",
+           url, seg->url_offset);
+    ret = open_url(s, in, url, avio_opts, opts, NULL);
+
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int open_input(DASHContext *c, struct representation *pls, struct fragment *seg)
+{
     char *url = NULL;
     int ret = 0;
 
@@ -1708,21 +1815,11 @@ static int open_input(DASHContext *c, struct representation *pls, struct fragmen
         goto cleanup;
     }
 
-    if (seg->size >= 0) {
-        /* try to restrict the HTTP request to the part we want
-         * (if this is in fact a HTTP request) */
-        av_dict_set_int(&opts, "offset", seg->url_offset, 0);
-        av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
-    }
-
     ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
-    av_log(pls->parent, AV_LOG_VERBOSE, "DASH request for url '%s', offset %"PRId64"\n",
-           url, seg->url_offset);
-    ret = open_url(pls->parent, &pls->input, url, &c->avio_opts, opts, NULL);
+    ret = open_fragment(pls->parent, &pls->input, url, seg, &c->avio_opts);
 
 cleanup:
     av_free(url);
-    av_dict_free(&opts);
     pls->cur_seg_offset = 0;
     pls->cur_seg_size = seg->size;
     return ret;
@@ -1774,6 +1871,396 @@ static int update_init_section(struct representation *pls)
     return 0;
 }
 
+#if HAVE_THREADS
+/*
+ * prefetch_fragments: every representation has a worker thread downloading
+ * the fragments following the one being read into memory, so that the
+ * representations are fetched in parallel. The demuxer thread queues them
+ * in order and takes ownership of a slot once its download is done.
+ */
+
+static void prefetch_slot_reset(struct fragment_prefetch *p)
+{
+    av_freep(&p->seg.url);
+    av_dict_free(&p->opts);
+    av_freep(&p->data);
+    p->data_size   = 0;
+    p->read_offset = 0;
+    p->discard     = 0;
+    p->ret         = 0;
+    p->state       = PREFETCH_FREE;
+}
+
+/* must be called with prefetch_mutex held */
+static void prefetch_slot_drop(struct fragment_prefetch *p)
+{
+    if (p->state == PREFETCH_RUNNING)
+        p->discard = 1;
+    else if (p->state != PREFETCH_FREE)
+        prefetch_slot_reset(p);
+}
+
+static int prefetch_slot_match(const struct fragment_prefetch *p,
+                               const struct fragment *seg)
+{
+    return p->state != PREFETCH_FREE && p->state != PREFETCH_CONSUMING &&
+           !p->discard && !strcmp(p->seg.url, seg->url) &&
+           p->seg.url_offset == seg->url_offset && p->seg.size == seg->size;
+}
+
+static int prefetch_aborted(struct representation *pls)
+{
+    int abort;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    abort = pls->prefetch_abort;
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    return abort;
+}
+
+static int prefetch_download(struct representation *pls, struct fragment_prefetch *p)
+{
+    AVFormatContext *s = pls->parent;
+    DASHContext *c = s->priv_data;
+    AVIOContext *in = NULL, *dyn = NULL;
+    uint8_t buf[16384];
+    int64_t left = p->seg.size;
+    int ret;
+
+    ret = open_fragment(s, &in, p->seg.url, &p->seg, &p->opts);
+    if (ret < 0)
+        return ret;
+
+    ret = avio_open_dyn_buf(&dyn);
+    if (ret < 0)
+        goto end;
+
+    while (left) {
+        int n = avio_read(in, buf, left > 0 ? FFMIN(left, sizeof(buf)) : sizeof(buf));
+        if (n == AVERROR_EOF)
+            break;
+        if (n < 0) {
+            ret = n;
+            goto end;
+        }
+        avio_write(dyn, buf, n);
+        if (left > 0)
+            left -= n;
+        if (ff_check_interrupt(c->interrupt_callback) || prefetch_aborted(pls)) {
+            ret = AVERROR_EXIT;
+            goto end;
+        }
+    }
+
+    p->data_size = avio_close_dyn_buf(dyn, &p->data);
+    dyn = NULL;
+    if (!p->data)
+        ret = AVERROR(ENOMEM);
+
+end:
+    ffio_free_dyn_buf(&dyn);
+    ff_format_io_close(s, &in);
+    return ret;
+}
+
+static void *prefetch_worker(void *arg)
+{
+    struct representation *pls = arg;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    while (!pls->prefetch_abort) {
+        struct fragment_prefetch *p = NULL;
+        int i, ret;
+
+        for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++) {
+            struct fragment_prefetch *q = &pls->prefetch[i];
+            if (q->state == PREFETCH_QUEUED && (!p || q->seq_no < p->seq_no))
+                p = q;
+        }
+        if (!p) {
+            pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_mutex);
+            continue;
+        }
+
+        p->state = PREFETCH_RUNNING;
+        pthread_mutex_unlock(&pls->prefetch_mutex);
+
+        ret = prefetch_download(pls, p);
+
+        pthread_mutex_lock(&pls->prefetch_mutex);
+        if (p->discard) {
+            prefetch_slot_reset(p);
+        } else {
+            p->ret   = ret;
+            p->state = PREFETCH_DONE;
+        }
+        pthread_cond_broadcast(&pls->prefetch_cond);
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    return NULL;
+}
+
+static int prefetch_start(struct representation *pls)
+{
+    int ret;
+
+    if (pls->prefetch_running)
+        return 0;
+
+    if ((ret = pthread_mutex_init(&pls->prefetch_mutex, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&pls->prefetch_cond, NULL))) {
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+        return AVERROR(ret);
+    }
+
+    pls->prefetch_abort = 0;
+    if ((ret = pthread_create(&pls->prefetch_thread, NULL, prefetch_worker, pls))) {
+        pthread_cond_destroy(&pls->prefetch_cond);
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+        return AVERROR(ret);
+    }
+    pls->prefetch_running = 1;
+
+    return 0;
+}
+
+static void prefetch_stop(struct representation *pls)
+{
+    int i;
+
+    if (!pls->prefetch_running)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    pls->prefetch_abort = 1;
+    pthread_cond_broadcast(&pls->prefetch_cond);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    pthread_join(pls->prefetch_thread, NULL);
+    pls->prefetch_running = 0;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++)
+        prefetch_slot_reset(&pls->prefetch[i]);
+    pls->cur_prefetch = NULL;
+
+    pthread_cond_destroy(&pls->prefetch_cond);
+    pthread_mutex_destroy(&pls->prefetch_mutex);
+}
+
+/* drop all queued and downloaded fragments, e.g. after seeking */
+static void prefetch_flush(struct representation *pls)
+{
+    int i;
+
+    if (!pls->prefetch_running)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++)
+        prefetch_slot_drop(&pls->prefetch[i]);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    pls->cur_prefetch = NULL;
+}
+
+/*
+ * Describe cur and the prefetch_fragments following it, with absolute URLs.
+ * Only fragments already known are listed, the manifest is not refreshed.
+ */
+static int prefetch_fragment_list(DASHContext *c, struct representation *pls,
+                                  const struct fragment *cur, struct fragment **list)
+{
+    int64_t max_seq_no = pls->n_fragments ? pls->n_fragments - 1 :
+                         c->is_live ? calc_max_seg_no(pls, c) : pls->last_seq_no;
+    /* looking ahead must not move the timeline cursor past cur_seq_no */
+    int cursor_idx        = pls->timeline_cursor_idx;
+    int64_t cursor_num    = pls->timeline_cursor_num;
+    int64_t cursor_start  = pls->timeline_cursor_start;
+    int n;
+
+    for (n = 0; n <= c->prefetch_fragments; n++) {
+        int64_t seq_no = pls->cur_seq_no + n;
+        struct fragment *seg;
+        char *url;
+
+        if (!n)
+            seg = copy_fragment(cur);
+        else if (seq_no > max_seq_no)
+            break;
+        else if (pls->n_fragments)
+            seg = copy_fragment(pls->fragments[seq_no]);
+        else
+            seg = get_template_fragment(pls, seq_no);
+        if (!seg)
+            break;
+
+        url = av_mallocz(c->max_url_size);
+        if (!url) {
+            free_fragment(&seg);
+            break;
+        }
+        ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+        av_free(seg->url);
+        seg->url = url;
+        list[n] = seg;
+    }
+
+    timeline_cursor_set(pls, cursor_idx, cursor_num, cursor_start);
+
+    return n ? n : AVERROR(ENOMEM);
+}
+
+/* queue the listed fragments that are not queued yet and drop the others,
+ * must be called with prefetch_mutex held */
+static void prefetch_schedule(DASHContext *c, struct representation *pls,
+                              struct fragment **list, int n)
+{
+    int i, k;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++) {
+        struct fragment_prefetch *p = &pls->prefetch[i];
+        int wanted = 0;
+
+        if (p->state == PREFETCH_CONSUMING)
+            continue;
+        for (k = 0; k < n; k++)
+            wanted |= prefetch_slot_match(p, list[k]);
+        if (!wanted)
+            prefetch_slot_drop(p);
+    }
+
+    for (k = 0; k < n; k++) {
+        struct fragment_prefetch *p = NULL;
+        int queued = 0;
+
+        for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++) {
+            struct fragment_prefetch *q = &pls->prefetch[i];
+            if (prefetch_slot_match(q, list[k])) {
+                /* the sequence numbers shift when a live manifest is refreshed */
+                q->seq_no = pls->cur_seq_no + k;
+                queued = 1;
+            } else if (q->state == PREFETCH_FREE && !p) {
+                p = q;
+            }
+        }
+        if (queued)
+            continue;
+        if (!p)
+            break;
+
+        p->seq_no         = pls->cur_seq_no + k;
+        p->seg.url_offset = list[k]->url_offset;
+        p->seg.size       = list[k]->size;
+        p->seg.url        = av_strdup(list[k]->url);
+        if (!p->seg.url || av_dict_copy(&p->opts, c->avio_opts, 0) < 0) {
+            prefetch_slot_reset(p);
+            break;
+        }
+        p->state = PREFETCH_QUEUED;
+    }
+
+    pthread_cond_broadcast(&pls->prefetch_cond);
+}
+
+/* wait for the download of seg, the current fragment, and start reading it */
+static int prefetch_open(DASHContext *c, struct representation *pls, struct fragment *seg)
+{
+    struct fragment *list[MAX_PREFETCH_FRAGMENTS + 1] = { NULL };
+    struct fragment_prefetch *p = NULL;
+    int i, n, ret;
+
+    if ((ret = prefetch_start(pls)) < 0)
+        return ret;
+
+    n = prefetch_fragment_list(c, pls, seg, list);
+    if (n < 0)
+        return n;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    for (;;) {
+        int64_t t;
+        struct timespec tv;
+
+        /* slots still held by discarded downloads are reused once
+         * those finish, so retry until the current one is queued */
+        prefetch_schedule(c, pls, list, n);
+
+        p = NULL;
+        for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++)
+            if (prefetch_slot_match(&pls->prefetch[i], list[0]))
+                p = &pls->prefetch[i];
+        if (p && p->state == PREFETCH_DONE) {
+            ret = p->ret;
+            break;
+        }
+        if (ff_check_interrupt(c->interrupt_callback)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+
+        t = av_gettime() + 100000;
+        tv.tv_sec  = t / 1000000;
+        tv.tv_nsec = (t % 1000000) * 1000;
+        pthread_cond_timedwait(&pls->prefetch_cond, &pls->prefetch_mutex, &tv);
+    }
+
+    if (p && p->state == PREFETCH_DONE) {
+        if (ret < 0) {
+            prefetch_slot_reset(p);
+        } else {
+            p->state = PREFETCH_CONSUMING;
+            pls->cur_prefetch = p;
+        }
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    for (i = 0; i < n; i++)
+        free_fragment(&list[i]);
+
+    pls->cur_seg_offset = 0;
+    pls->cur_seg_size = seg->size;
+    return ret;
+}
+
+static void prefetch_release(struct representation *pls)
+{
+    if (!pls->cur_prefetch)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    prefetch_slot_reset(pls->cur_prefetch);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    pls->cur_prefetch = NULL;
+}
+#else
+static int prefetch_open(DASHContext *c, struct representation *pls, struct fragment *seg)
+{
+    return AVERROR(ENOSYS);
+}
+
+static void prefetch_release(struct representation *pls) {}
+static void prefetch_flush(struct representation *pls) {}
+static void prefetch_stop(struct representation *pls) {}
+#endif
+
+static int prefetch_read(struct representation *pls, uint8_t *buf, int buf_size)
+{
+    struct fragment_prefetch *p = pls->cur_prefetch;
+    int size = FFMIN(buf_size, p->data_size - p->read_offset);
+
+    if (size <= 0)
+        return AVERROR_EOF;
+    memcpy(buf, p->data + p->read_offset, size);
+    p->read_offset      += size;
+    pls->cur_seg_offset += size;
+
+    return size;
+}
+
 static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
@@ -1791,7 +2278,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->cur_prefetch) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1804,7 +2291,11 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
+        /* seek_data() needs a real input for single file representations */
+        if (c->prefetch_fragments && !(v->n_fragments && !v->init_sec_data_len))
+            ret = prefetch_open(c, v, v->cur_seg);
+        else
+            ret = open_input(c, v, v->cur_seg);
         if (ret < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 ret = AVERROR_EXIT;
@@ -1833,7 +2324,10 @@ restart:
         ret = AVERROR_EOF;
         goto end;
     }
-    ret = read_from_url(v, v->cur_seg, buf, buf_size);
+    if (v->cur_prefetch)
+        ret = prefetch_read(v, buf, buf_size);
+    else
+        ret = read_from_url(v, v->cur_seg, buf, buf_size);
 
     if (ret > 0)
         goto end;
@@ -2057,6 +2551,11 @@ static int dash_read_header(AVFormatContext *s)
         av_dict_set(&c->avio_opts, "seekable", "0", 0);
     }
 
+    if (c->prefetch_fragments && !HAVE_THREADS) {
+        av_log(s, AV_LOG_WARNING, "prefetch_fragments requires threads, disabling it\n");
+        c->prefetch_fragments = 0;
+    }
+
     if(c->n_videos)
         c->is_init_section_common_video = is_common_init_section_exist(c->videos, c->n_videos);
 
@@ -2168,6 +2667,7 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
             ff_format_io_close(pls->parent, &pls->input);
+            prefetch_flush(pls);
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2230,6 +2730,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->init_sec_buf_read_offset = 0;
             cur->is_restart_needed = 0;
             ff_format_io_close(cur->parent, &cur->input);
+            prefetch_release(cur);
             ret = reopen_demux_for_component(s, cur);
         }
     }
@@ -2268,6 +2769,7 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
     }
 
     ff_format_io_close(pls->parent, &pls->input);
+    prefetch_flush(pls);
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2366,6 +2868,8 @@ static const AVOption dash_options[] = {
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
     { "cenc_decryption_key", "Media decryption key (hex)", OFFSET(cenc_decryption_key), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
+    {"prefetch_fragments", "Number of fragments to download ahead of the current one, 0 to disable",
+        OFFSET(prefetch_fragments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, MAX_PREFETCH_FRAGMENTS, FLAGS},
     {NULL}
 };
 
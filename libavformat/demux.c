@@ -26,12 +26,14 @@
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/dict.h"
+#include "libavutil/fifo.h"
 #include "libavutil/internal.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/pixfmt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/timestamp.h"
 
@@ -47,6 +49,7 @@
 #include "demux.h"
 #include "id3v2.h"
 #include "internal.h"
+#include "probecache.h"
 #include "url.h"
 
 static int64_t wrap_timestamp(const AVStream *st, int64_t timestamp)
@@ -162,13 +165,17 @@ static int init_input(AVFormatContext *s, const char *filename,
 
     if (s->pb) {
         s->flags |= AVFMT_FLAG_CUSTOM_IO;
-        if (!s->iformat)
-            return av_probe_input_buffer2(s->pb, &s->iformat, filename,
-                                          s, 0, s->format_probesize);
-        else if (s->iformat->flags & AVFMT_NOFILE)
+        if (s->iformat && s->iformat->flags & AVFMT_NOFILE) {
             av_log(s, AV_LOG_WARNING, "Custom AVIOContext makes no sense and "
                                       "will be ignored with AVFMT_NOFILE format.\n");
-        return 0;
+            return 0;
+        }
+        if ((ret = ff_probe_cache_lookup(s)) < 0)
+            return ret;
+        if (ret > 0 || s->iformat)
+            return ret;
+        return av_probe_input_buffer2(s->pb, &s->iformat, filename,
+                                      s, 0, s->format_probesize);
     }
 
     if ((s->iformat && s->iformat->flags & AVFMT_NOFILE) ||
@@ -178,8 +185,10 @@ static int init_input(AVFormatContext *s, const char *filename,
     if ((ret = s->io_open(s, &s->pb, filename, AVIO_FLAG_READ | s->avio_flags, options)) < 0)
         return ret;
 
-    if (s->iformat)
-        return 0;
+    if ((ret = ff_probe_cache_lookup(s)) < 0)
+        return ret;
+    if (ret > 0 || s->iformat)
+        return ret;
     return av_probe_input_buffer2(s->pb, &s->iformat, filename,
                                   s, 0, s->format_probesize);
 }
@@ -301,6 +310,9 @@ int avformat_open_input(AVFormatContext **ps, const char *filename,
     if (s->pb)
         ff_id3v2_read_dict(s->pb, &si->id3v2_meta, ID3v2_DEFAULT_MAGIC, &id3v2_extra_meta);
 
+    if (s->pb && ffifmt(s->iformat)->flags_internal & FF_INFMT_FLAG_ZERO_COPY)
+        ffiocontext(s->pb)->zero_copy_packets = 1;
+
     if (ffifmt(s->iformat)->read_header)
         if ((ret = ffifmt(s->iformat)->read_header(s)) < 0) {
             if (ffifmt(s->iformat)->flags_internal & FF_INFMT_FLAG_INIT_CLEANUP)
@@ -1321,6 +1333,8 @@ fail:
 
 static int extract_extradata(FFFormatContext *si, AVStream *st, const AVPacket *pkt);
 
+static void probe_workers_wait(AVFormatContext *s, AVStream *st);
+
 static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
 {
     FFFormatContext *const si = ffformatcontext(s);
@@ -1336,6 +1350,7 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
         if (ret < 0) {
             if (ret == AVERROR(EAGAIN))
                 return ret;
+            probe_workers_wait(s, NULL);
             /* flush the parsers */
             for (unsigned i = 0; i < s->nb_streams; i++) {
                 AVStream *const st  = s->streams[i];
@@ -1351,6 +1366,8 @@ static int read_frame_internal(AVFormatContext *s, AVPacket *pkt)
         st  = s->streams[pkt->stream_index];
         sti = ffstream(st);
 
+        probe_workers_wait(s, st);
+
         st->event_flags |= AVSTREAM_EVENT_FLAG_NEW_PACKETS;
 
         /* update context if required */
@@ -2187,6 +2204,226 @@ fail:
     return ret;
 }
 
+enum ProbeState {
+    PROBE_IDLE,
+    PROBE_QUEUED,
+    PROBE_BUSY,
+};
+
+/**
+ * Worker threads running try_decode_frame() for avformat_find_stream_info().
+ *
+ * A stream has at most one packet in flight. The demuxing thread only
+ * touches the decoding context and decoding related fields of a stream
+ * while it is idle: it waits for the stream after reading a packet for
+ * it, and considers busy streams as not analyzed yet.
+ */
+#if HAVE_THREADS
+typedef struct ProbeWorkers {
+    AVFormatContext *s;
+    AVDictionary **options;
+    int nb_options;
+
+    pthread_t *threads;
+    int nb_threads;
+    AVFifo *queue;             ///< AVStream pointers with a queued packet
+    int exit;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond; ///< a packet was queued, or exit was set
+    pthread_cond_t  idle_cond; ///< a stream became idle
+} ProbeWorkers;
+
+static void *probe_worker(void *arg)
+{
+    ProbeWorkers *const pw = arg;
+    AVStream *st;
+
+    pthread_mutex_lock(&pw->lock);
+    for (;;) {
+        FFStreamInfo *info;
+
+        if (av_fifo_read(pw->queue, &st, 1) < 0) {
+            if (pw->exit)
+                break;
+            pthread_cond_wait(&pw->work_cond, &pw->lock);
+            continue;
+        }
+        info = ffstream(st)->info;
+        info->probe_state = PROBE_BUSY;
+        pthread_mutex_unlock(&pw->lock);
+
+        try_decode_frame(pw->s, st, info->probe_pkt,
+                         st->index < pw->nb_options ? &pw->options[st->index] : NULL);
+        av_packet_unref(info->probe_pkt);
+        ffstream(st)->codec_info_nb_frames++;
+
+        pthread_mutex_lock(&pw->lock);
+        info->probe_state = PROBE_IDLE;
+        pthread_cond_broadcast(&pw->idle_cond);
+    }
+    pthread_mutex_unlock(&pw->lock);
+
+    return NULL;
+}
+#endif
+
+static void probe_workers_free(AVFormatContext *s)
+{
+#if HAVE_THREADS
+    FFFormatContext *const si = ffformatcontext(s);
+    ProbeWorkers *const pw = si->probe_workers;
+
+    if (!pw)
+        return;
+
+    pthread_mutex_lock(&pw->lock);
+    pw->exit = 1;
+    pthread_cond_broadcast(&pw->work_cond);
+    pthread_mutex_unlock(&pw->lock);
+    for (int i = 0; i < pw->nb_threads; i++)
+        pthread_join(pw->threads[i], NULL);
+
+    av_freep(&pw->threads);
+    av_fifo_freep2(&pw->queue);
+    pthread_cond_destroy(&pw->idle_cond);
+    pthread_cond_destroy(&pw->work_cond);
+    pthread_mutex_destroy(&pw->lock);
+    av_freep(&si->probe_workers);
+#endif
+}
+
+static int probe_workers_init(AVFormatContext *s, AVDictionary **options,
+                              int nb_options)
+{
+#if HAVE_THREADS
+    FFFormatContext *const si = ffformatcontext(s);
+    ProbeWorkers *pw;
+    int ret;
+
+    pw = av_mallocz(sizeof(*pw));
+    if (!pw)
+        return AVERROR(ENOMEM);
+    pw->s          = s;
+    pw->options    = options;
+    pw->nb_options = options ? nb_options : 0;
+
+    pw->queue   = av_fifo_alloc2(FFMAX(s->nb_streams, 1), sizeof(AVStream *),
+                                 AV_FIFO_FLAG_AUTO_GROW);
+    pw->threads = av_calloc(s->probe_threads, sizeof(*pw->threads));
+    if (!pw->queue || !pw->threads) {
+        av_fifo_freep2(&pw->queue);
+        av_freep(&pw->threads);
+        av_free(pw);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_init(&pw->lock, NULL);
+    pthread_cond_init(&pw->work_cond, NULL);
+    pthread_cond_init(&pw->idle_cond, NULL);
+    si->probe_workers = pw;
+
+    for (; pw->nb_threads < s->probe_threads; pw->nb_threads++) {
+        ret = pthread_create(&pw->threads[pw->nb_threads], NULL, probe_worker, pw);
+        if (ret) {
+            probe_workers_free(s);
+            return AVERROR(ret);
+        }
+    }
+    av_log(s, AV_LOG_DEBUG, "Probing with %d decoding threads\n", pw->nb_threads);
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+#if HAVE_THREADS
+static int probe_stream_busy(const AVStream *st)
+{
+    const FFStreamInfo *const info = cffstream(st)->info;
+    return info && info->probe_state != PROBE_IDLE;
+}
+#endif
+
+/**
+ * @return whether the probe workers have a packet of st in flight
+ */
+static int probe_workers_busy(AVFormatContext *s, const AVStream *st)
+{
+    int busy = 0;
+#if HAVE_THREADS
+    ProbeWorkers *const pw = ffformatcontext(s)->probe_workers;
+
+    if (pw) {
+        pthread_mutex_lock(&pw->lock);
+        busy = probe_stream_busy(st);
+        pthread_mutex_unlock(&pw->lock);
+    }
+#endif
+    return busy;
+}
+
+/**
+ * Wait until the probe workers are done with st, or with all streams if st
+ * is NULL.
+ */
+static void probe_workers_wait(AVFormatContext *s, AVStream *st)
+{
+#if HAVE_THREADS
+    ProbeWorkers *const pw = ffformatcontext(s)->probe_workers;
+
+    if (!pw)
+        return;
+
+    pthread_mutex_lock(&pw->lock);
+    if (st) {
+        while (probe_stream_busy(st))
+            pthread_cond_wait(&pw->idle_cond, &pw->lock);
+    } else {
+        for (unsigned i = 0; i < s->nb_streams; i++)
+            while (probe_stream_busy(s->streams[i]))
+                pthread_cond_wait(&pw->idle_cond, &pw->lock);
+    }
+    pthread_mutex_unlock(&pw->lock);
+#endif
+}
+
+/**
+ * Hand pkt to the probe workers for decoding.
+ *
+ * @return 0 if queued, < 0 if the caller should decode it itself
+ */
+static int probe_workers_submit(AVFormatContext *s, AVStream *st,
+                                const AVPacket *pkt)
+{
+#if HAVE_THREADS
+    ProbeWorkers *const pw = ffformatcontext(s)->probe_workers;
+    FFStreamInfo *const info = ffstream(st)->info;
+    int ret;
+
+    if (!pw)
+        return AVERROR(ENOSYS);
+
+    if (!info->probe_pkt && !(info->probe_pkt = av_packet_alloc()))
+        return AVERROR(ENOMEM);
+    ret = av_packet_ref(info->probe_pkt, pkt);
+    if (ret < 0)
+        return ret;
+
+    pthread_mutex_lock(&pw->lock);
+    ret = av_fifo_write(pw->queue, &st, 1);
+    if (ret >= 0) {
+        info->probe_state = PROBE_QUEUED;
+        pthread_cond_signal(&pw->work_cond);
+    }
+    pthread_mutex_unlock(&pw->lock);
+    if (ret < 0)
+        av_packet_unref(info->probe_pkt);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 static int chapter_start_cmp(const void *p1, const void *p2)
 {
     const AVChapter *const ch1 = *(AVChapter**)p1;
@@ -2532,6 +2769,14 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
 
     flush_codecs = probesize > 0;
 
+    ret = ff_probe_cache_apply(ic);
+    if (ret < 0)
+        goto find_stream_info_err;
+    if (ret > 0) {
+        ret = 0;
+        goto analysis_done;
+    }
+
     av_opt_set_int(ic, "skip_clear", 1, AV_OPT_SEARCH_CHILDREN);
 
     max_stream_analyze_duration = max_analyze_duration;
@@ -2608,6 +2853,10 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             av_dict_free(&thread_opt);
     }
 
+    if (ic->probe_threads > 0 &&
+        probe_workers_init(ic, options, orig_nb_streams) < 0)
+        av_log(ic, AV_LOG_WARNING, "Could not start probe threads, decoding serially\n");
+
     read_size = 0;
     for (;;) {
         const AVPacket *pkt;
@@ -2615,6 +2864,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         FFStream *sti;
         AVCodecContext *avctx;
         int analyzed_all_streams;
+        int probe_busy = 0;
         unsigned i;
         if (ff_check_interrupt(&ic->interrupt_callback)) {
             ret = AVERROR_EXIT;
@@ -2629,6 +2879,11 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
             int fps_analyze_framecount = 20;
             int count;
 
+            /* decided once the probe workers are done with it */
+            if (probe_workers_busy(ic, st)) {
+                probe_busy = 1;
+                continue;
+            }
             if (!has_codec_parameters(st, NULL))
                 break;
             /* If the timebase is coarse (like the usual millisecond precision
@@ -2666,6 +2921,10 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
                  st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO))
                 break;
         }
+        if (i == ic->nb_streams && probe_busy) {
+            probe_workers_wait(ic, NULL);
+            continue;
+        }
         analyzed_all_streams = 0;
         if (!missing_streams || !*missing_streams)
             if (i == ic->nb_streams) {
@@ -2723,6 +2982,8 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         }
 
         st  = ic->streams[pkt->stream_index];
+        /* packets queued by the parser do not pass through ff_read_packet() */
+        probe_workers_wait(ic, st);
         sti = ffstream(st);
         if (!(st->disposition & AV_DISPOSITION_ATTACHED_PIC))
             read_size += pkt->size;
@@ -2837,15 +3098,19 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
          * least one frame of codec data, this makes sure the codec initializes
          * the channel configuration and does not only trust the values from
          * the container. */
-        try_decode_frame(ic, st, pkt,
-                         (options && i < orig_nb_streams) ? &options[i] : NULL);
+        /* the probe workers count the packet once decoded */
+        if (probe_workers_submit(ic, st, pkt) < 0) {
+            try_decode_frame(ic, st, pkt,
+                             (options && i < orig_nb_streams) ? &options[i] : NULL);
+            sti->codec_info_nb_frames++;
+        }
 
         if (ic->flags & AVFMT_FLAG_NOBUFFER)
             av_packet_unref(pkt1);
 
-        sti->codec_info_nb_frames++;
         count++;
     }
+    probe_workers_free(ic);
 
     if (eof_reached) {
         for (unsigned stream_index = 0; stream_index < ic->nb_streams; stream_index++) {
@@ -3027,6 +3292,7 @@ int avformat_find_stream_info(AVFormatContext *ic, AVDictionary **options)
         }
     }
 
+analysis_done:
     err = compute_chapters_end(ic);
     if (err < 0) {
         ret = err;
@@ -3091,7 +3357,11 @@ FF_ENABLE_DEPRECATION_WARNINGS
 #endif
     }
 
+    if (ret >= 0)
+        ff_probe_cache_store(ic);
+
 find_stream_info_err:
+    probe_workers_free(ic);
     for (unsigned i = 0; i < ic->nb_streams; i++) {
         AVStream *const st  = ic->streams[i];
         FFStream *const sti = ffstream(st);
@@ -3099,6 +3369,7 @@ find_stream_info_err:
 
         if (sti->info) {
             av_freep(&sti->info->duration_error);
+            av_packet_free(&sti->info->probe_pkt);
             av_freep(&sti->info);
         }
 
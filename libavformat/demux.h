@@ -34,6 +34,12 @@ struct AVDeviceInfoList;
  */
 #define FF_INFMT_FLAG_INIT_CLEANUP                             (1 << 0)
 
+/**
+ * The demuxer never writes to the data of packets returned by
+ * av_get_packet(), so these may reference the I/O buffer directly.
+ */
+#define FF_INFMT_FLAG_ZERO_COPY                                (1 << 1)
+
 typedef struct FFInputFormat {
     /**
      * The public AVInputFormat. See avformat.h for it.
@@ -162,6 +168,13 @@ typedef struct FFStreamInfo {
     int     fps_first_dts_idx;
     int64_t fps_last_dts;
     int     fps_last_dts_idx;
+
+    /**
+     * Packet queued for or being decoded by a probe worker and the state of
+     * that decode, see AVFormatContext.probe_threads.
+     */
+    AVPacket *probe_pkt;
+    int probe_state;
 } FFStreamInfo;
 
 /**
@@ -19,18 +19,30 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#define _DEFAULT_SOURCE
+#define _SVID_SOURCE // needed for MAP_ANONYMOUS
+#define _DARWIN_C_SOURCE // needed for MAP_ANON
+
 #include "config_components.h"
 
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/file_open.h"
 #include "libavutil/internal.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavcodec/defs.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
 #endif
 #include <fcntl.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
 #if HAVE_IO_H
 #include <io.h>
 #endif
@@ -38,6 +50,9 @@
 #include <unistd.h>
 #endif
 #include <sys/stat.h>
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 #include <stdlib.h>
 #include "os_support.h"
 #include "url.h"
@@ -96,6 +111,9 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int mmap;
+    AVBufferRef *map;
+    int64_t map_pos;
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -106,6 +124,7 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "Map the file into memory when reading", offsetof(FileContext, mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -141,6 +160,14 @@ static int file_read(URLContext *h, unsigned char *buf, int size)
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->map) {
+        if (c->map_pos >= c->map->size)
+            return AVERROR_EOF;
+        size = FFMIN(size, c->map->size - c->map_pos);
+        memcpy(buf, c->map->data + c->map_pos, size);
+        c->map_pos += size;
+        return size;
+    }
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -158,6 +185,26 @@ static int file_write(URLContext *h, const unsigned char *buf, int size)
     return (ret == -1) ? AVERROR(errno) : ret;
 }
 
+#if HAVE_SYS_UIO_H
+#define MAX_IOV 16
+
+static int file_writev(URLContext *h, const uint8_t *const *bufs,
+                       const int *sizes, int nb_bufs)
+{
+    FileContext *c = h->priv_data;
+    struct iovec iov[MAX_IOV];
+    int i, ret, left = c->blocksize;
+
+    for (i = 0; i < FFMIN(nb_bufs, MAX_IOV) && left > 0; i++) {
+        iov[i].iov_base = (void *)bufs[i];
+        iov[i].iov_len  = FFMIN(sizes[i], left);
+        left -= iov[i].iov_len;
+    }
+    ret = writev(c->fd, iov, i);
+    return (ret == -1) ? AVERROR(errno) : ret;
+}
+#endif
+
 static int file_get_handle(URLContext *h)
 {
     FileContext *c = h->priv_data;
@@ -221,7 +268,10 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+    /* packets referencing the mapping keep it alive */
+    av_buffer_unref(&c->map);
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -237,6 +287,18 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+    if (c->map) {
+        if (whence == SEEK_CUR)
+            pos += c->map_pos;
+        else if (whence == SEEK_END)
+            pos += c->map->size;
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return c->map_pos = pos;
+    }
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -267,6 +329,69 @@ static int file_delete(URLContext *h)
 #endif /* HAVE_UNISTD_H */
 }
 
+#if HAVE_MMAP
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+/* the mapping covers the file as it is when opened, mmap is only
+ * meant for files that do not change while they are read: accessing
+ * pages of a file truncated after it was mapped raises SIGBUS */
+static int file_map(URLContext *h, const struct stat *st)
+{
+    FileContext *c = h->priv_data;
+    size_t map_size;
+    void *data;
+
+#ifndef MAP_ANONYMOUS
+    return 0;
+#else
+    if (!S_ISREG(st->st_mode) || st->st_size <= 0 ||
+        st->st_size > SIZE_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return 0;
+    map_size = st->st_size + AV_INPUT_BUFFER_PADDING_SIZE;
+
+    /* map the file over zeroed pages, so that it is followed by
+     * zero padding even if it ends on a page boundary */
+    data = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data != MAP_FAILED &&
+        mmap(data, st->st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, c->fd, 0) == MAP_FAILED) {
+        int err = errno;
+        munmap(data, map_size);
+        data  = MAP_FAILED;
+        errno = err;
+    }
+    if (data == MAP_FAILED) {
+        av_log(h, AV_LOG_WARNING, "Cannot map the file, reading it instead: %s\n",
+               av_err2str(AVERROR(errno)));
+        return 0;
+    }
+
+    c->map = av_buffer_create(data, st->st_size, file_unmap,
+                              (void *)(uintptr_t)map_size,
+                              AV_BUFFER_FLAG_READONLY);
+    if (!c->map) {
+        munmap(data, map_size);
+        return AVERROR(ENOMEM);
+    }
+    c->map_pos = 0;
+
+    return 0;
+#endif
+}
+
+static int file_get_mapping(URLContext *h, AVBufferRef **buf)
+{
+    FileContext *c = h->priv_data;
+
+    if (!c->map)
+        return AVERROR(ENOSYS);
+    *buf = av_buffer_ref(c->map);
+    return *buf ? 0 : AVERROR(ENOMEM);
+}
+#endif
+
 static int file_move(URLContext *h_src, URLContext *h_dst)
 {
     const char *filename_src = h_src->filename;
@@ -318,6 +443,16 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+#if HAVE_MMAP
+    if (c->mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow && !h->is_streamed) {
+        int ret = fstat(fd, &st) < 0 ? AVERROR(errno) : file_map(h, &st);
+        if (ret < 0) {
+            close(fd);
+            return ret;
+        }
+    }
+#endif
+
     return 0;
 }
 
@@ -410,9 +545,15 @@ const URLProtocol ff_file_protocol = {
     .url_open            = file_open,
     .url_read            = file_read,
     .url_write           = file_write,
+#if HAVE_SYS_UIO_H
+    .url_writev          = file_writev,
+#endif
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+#if HAVE_MMAP
+    .url_get_mapping     = file_get_mapping,
+#endif
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
@@ -463,6 +604,9 @@ const URLProtocol ff_pipe_protocol = {
     .url_open            = pipe_open,
     .url_read            = file_read,
     .url_write           = file_write,
+#if HAVE_SYS_UIO_H
+    .url_writev          = file_writev,
+#endif
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
     .url_check           = file_check,
@@ -508,6 +652,9 @@ const URLProtocol ff_fd_protocol = {
     .url_open            = fd_open,
     .url_read            = file_read,
     .url_write           = file_write,
+#if HAVE_SYS_UIO_H
+    .url_writev          = file_writev,
+#endif
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
@@ -577,7 +724,7 @@ static int android_content_open(URLContext *h, const char *filename, int flags)
         return AVERROR(EINVAL);
     }
 
-    ret = ff_jni_init_jfields(env, &jfields, jfields_mapping, 0, c);
+    ret = ff_jni_get_jfields(env, &jfields, sizeof(jfields), jfields_mapping, c);
     if (ret < 0) {
         av_log(c, AV_LOG_ERROR, "failed to initialize jni fields\n");
         return ret;
@@ -641,7 +788,6 @@ done:
     (*env)->DeleteLocalRef(env, uri);
     (*env)->DeleteLocalRef(env, content_resolver);
     (*env)->DeleteLocalRef(env, parcel_file_descriptor);
-    ff_jni_reset_jfields(env, &jfields, jfields_mapping, 0, c);
 
     return ret;
 }
@@ -663,6 +809,9 @@ const URLProtocol ff_android_content_protocol = {
     .url_open            = android_content_open,
     .url_read            = file_read,
     .url_write           = file_write,
+#if HAVE_SYS_UIO_H
+    .url_writev          = file_writev,
+#endif
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
@@ -27,6 +27,8 @@
  * https://www.rfc-editor.org/rfc/rfc8216.txt
  */
 
+#include <stdatomic.h>
+
 #include "config_components.h"
 
 #include "libavutil/aes.h"
@@ -37,12 +39,14 @@
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "demux.h"
 #include "internal.h"
 #include "avio_internal.h"
 #include "id3v2.h"
+#include "http.h"
 #include "url.h"
 
 #include "hls_sample_encryption.h"
@@ -52,6 +56,8 @@
 #define MAX_FIELD_LEN 64
 #define MAX_CHARACTERISTICS_LEN 512
 
+#define MAX_PREFETCH_SEGMENTS 16
+
 #define MPEG_TIME_BASE 90000
 #define MPEG_TIME_BASE_Q (AVRational){1, MPEG_TIME_BASE}
 
@@ -85,6 +91,32 @@ struct segment {
     struct segment *init_section;
 };
 
+enum PrefetchState {
+    PREFETCH_FREE,
+    PREFETCH_QUEUED,
+    PREFETCH_RUNNING,
+    PREFETCH_DONE,
+    PREFETCH_CONSUMING,
+};
+
+/*
+ * A media segment downloaded ahead of time by a prefetch_segments worker.
+ * The segment description is copied when it is queued, so the workers
+ * never look at the playlist, which may be reloaded while they run.
+ */
+struct segment_prefetch {
+    enum PrefetchState state;
+    int discard;
+    int64_t seq_no;
+    struct segment seg;
+    AVDictionary *opts;
+    uint8_t key[16];
+    uint8_t *data;
+    int data_size;
+    int read_offset;
+    int ret;
+};
+
 struct rendition;
 
 enum PlaylistType {
@@ -172,6 +204,18 @@ struct playlist {
      * playlist, if any. */
     int n_init_sections;
     struct segment **init_sections;
+
+    /* prefetch_segments state, the slots hold the segment being read
+     * and the ones downloaded ahead of it */
+    struct segment_prefetch *cur_prefetch;
+#if HAVE_THREADS
+    struct segment_prefetch prefetch[MAX_PREFETCH_SEGMENTS + 1];
+    int n_prefetch_threads;
+    int prefetch_abort;
+    pthread_t prefetch_threads[MAX_PREFETCH_SEGMENTS];
+    pthread_mutex_t prefetch_mutex;
+    pthread_cond_t prefetch_cond;
+#endif
 };
 
 /*
@@ -224,13 +268,31 @@ typedef struct HLSContext {
     char *allowed_extensions;
     int max_reload;
     int http_persistent;
+    /* set once a keepalive request failed with ENOSYS, may be set from
+     * the prefetch_segments workers */
+    atomic_int keepalive_unsupported;
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    int probe_once;
+    /* segment formats found so far with probe_once, keyed by the segment
+     * extension and whether there is a Media Initialization Section */
+    struct {
+        char key[16];
+        const AVInputFormat *fmt;
+    } probed_fmts[8];
+    int n_probed_fmts;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
 
+static int use_keepalive(HLSContext *c)
+{
+    return c->http_persistent &&
+           !atomic_load_explicit(&c->keepalive_unsupported, memory_order_relaxed);
+}
+
 static void free_segment_dynarray(struct segment **segments, int n_segments)
 {
     int i;
@@ -260,11 +322,14 @@ static void free_init_section_list(struct playlist *pls)
     pls->n_init_sections = 0;
 }
 
+static void prefetch_stop(struct playlist *pls);
+
 static void free_playlist_list(HLSContext *c)
 {
     int i;
     for (i = 0; i < c->n_playlists; i++) {
         struct playlist *pls = c->playlists[i];
+        prefetch_stop(pls);
         free_segment_list(pls);
         free_init_section_list(pls);
         av_freep(&pls->main_streams);
@@ -626,6 +691,24 @@ static int ensure_playlist(HLSContext *c, struct playlist **pls, const char *url
 }
 
 
+static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
+                              const char *url, AVDictionary **options)
+{
+#if !CONFIG_HTTP_PROTOCOL
+    return AVERROR_PROTOCOL_NOT_FOUND;
+#else
+    int ret;
+    URLContext *uc = ffio_geturlcontext(*pb);
+    av_assert0(uc);
+    (*pb)->eof_reached = 0;
+    ret = ff_http_do_new_request2(uc, url, options);
+    if (ret < 0) {
+        ff_format_io_close(s, pb);
+    }
+    return ret;
+#endif
+}
+
 static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
                     AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
 {
@@ -677,8 +760,30 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
 
-
-    ret = s->io_open(s, pb, url, AVIO_FLAG_READ, &tmp);
+    if (is_http && use_keepalive(c) && *pb) {
+        ret = open_url_keepalive(c->ctx, pb, url, &tmp);
+        if (ret == AVERROR_EXIT) {
+            av_dict_free(&tmp);
+            return ret;
+        } else if (ret < 0) {
+            /* The backend cannot reuse connections, stop trying. */
+            if (ret == AVERROR(ENOSYS))
+                atomic_store_explicit(&c->keepalive_unsupported, 1, memory_order_relaxed);
+            else if (ret != AVERROR_EOF)
+                av_log(s, AV_LOG_WARNING,
+                    "keepalive request failed for '%s' with error: '%s' when opening url, retrying with new connection\n",
+                    url, av_err2str(ret));
+            av_dict_free(&tmp);
+            av_dict_copy(&tmp, *opts, 0);
+            av_dict_copy(&tmp, opts2, 0);
+            ret = s->io_open(s, pb, url, AVIO_FLAG_READ, &tmp);
+        }
+    } else {
+        /* A connection kept alive before keepalive got disabled. */
+        if (*pb)
+            ff_format_io_close(c->ctx, pb);
+        ret = s->io_open(s, pb, url, AVIO_FLAG_READ, &tmp);
+    }
 
     if (ret >= 0) {
         // update cookies on http response with setcookies.
@@ -723,11 +828,27 @@ static int parse_playlist(HLSContext *c, const char *url,
     int64_t prev_start_seq_no = -1;
 
 
+    if (is_http && !in && use_keepalive(c) && c->playlist_pb) {
+        in = c->playlist_pb;
+        ret = open_url_keepalive(c->ctx, &c->playlist_pb, url, NULL);
+        if (ret == AVERROR_EXIT) {
+            return ret;
+        } else if (ret < 0) {
+            if (ret == AVERROR(ENOSYS))
+                atomic_store_explicit(&c->keepalive_unsupported, 1, memory_order_relaxed);
+            else if (ret != AVERROR_EOF)
+                av_log(c->ctx, AV_LOG_WARNING,
+                    "keepalive request failed for '%s' with error: '%s' when parsing playlist\n",
+                    url, av_err2str(ret));
+            in = NULL;
+        }
+    }
+
     if (!in) {
         AVDictionary *opts = NULL;
         av_dict_copy(&opts, c->avio_opts, 0);
 
-        if (c->http_persistent)
+        if (use_keepalive(c))
             av_dict_set(&opts, "multiple_requests", "1", 0);
 
         ret = c->ctx->io_open(c->ctx, &in, url, AVIO_FLAG_READ, &opts);
@@ -735,7 +856,10 @@ static int parse_playlist(HLSContext *c, const char *url,
         if (ret < 0)
             return ret;
 
-        close_in = 1;
+        if (is_http && use_keepalive(c))
+            c->playlist_pb = in;
+        else
+            close_in = 1;
     }
 
     if (av_opt_get(in, "location", AV_OPT_SEARCH_CHILDREN, &new_url) >= 0)
@@ -1020,6 +1144,17 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
 {
     int ret;
 
+    if (pls->cur_prefetch) {
+        struct segment_prefetch *p = pls->cur_prefetch;
+        ret = FFMIN(buf_size, p->data_size - p->read_offset);
+        if (ret <= 0)
+            return AVERROR_EOF;
+        memcpy(buf, p->data + p->read_offset, ret);
+        p->read_offset      += ret;
+        pls->cur_seg_offset += ret;
+        return ret;
+    }
+
      /* limit read if the segment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
@@ -1232,13 +1367,16 @@ static void intercept_id3(struct playlist *pls, uint8_t *buf,
         pls->is_id3_timestamped = (pls->id3_mpegts_timestamp != AV_NOPTS_VALUE);
 }
 
-static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg, AVIOContext **in)
+/* key_url and key cache the last key fetched, key_url is MAX_URL_SIZE long */
+static int open_segment(HLSContext *c, struct playlist *pls, struct segment *seg,
+                        AVIOContext **in, AVDictionary **avio_opts,
+                        char *key_url, uint8_t *key)
 {
     AVDictionary *opts = NULL;
     int ret;
     int is_http = 0;
 
-    if (c->http_persistent)
+    if (use_keepalive(c))
         av_dict_set(&opts, "multiple_requests", "1", 0);
 
     if (seg->size >= 0) {
@@ -1252,10 +1390,10 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
            seg->url, seg->url_offset, pls->index);
 
     if (seg->key_type == KEY_AES_128 || seg->key_type == KEY_SAMPLE_AES) {
-        if (strcmp(seg->key, pls->key_url)) {
+        if (strcmp(seg->key, key_url)) {
             AVIOContext *pb = NULL;
-            if (open_url(pls->parent, &pb, seg->key, &c->avio_opts, opts, NULL) == 0) {
-                ret = avio_read(pb, pls->key, sizeof(pls->key));
+            if (open_url(pls->parent, &pb, seg->key, avio_opts, opts, NULL) == 0) {
+                ret = avio_read(pb, key, sizeof(pls->key));
                 if (ret != sizeof(pls->key)) {
                     av_log(pls->parent, AV_LOG_ERROR, "Unable to read key file %s\n",
                            seg->key);
@@ -1265,29 +1403,29 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
                 av_log(pls->parent, AV_LOG_ERROR, "Unable to open key file %s\n",
                        seg->key);
             }
-            av_strlcpy(pls->key_url, seg->key, sizeof(pls->key_url));
+            av_strlcpy(key_url, seg->key, MAX_URL_SIZE);
         }
     }
 
     if (seg->key_type == KEY_AES_128) {
-        char iv[33], key[33], url[MAX_URL_SIZE];
+        char iv[33], hex_key[33], url[MAX_URL_SIZE];
         ff_data_to_hex(iv, seg->iv, sizeof(seg->iv), 0);
-        ff_data_to_hex(key, pls->key, sizeof(pls->key), 0);
+        ff_data_to_hex(hex_key, key, sizeof(pls->key), 0);
         if (strstr(seg->url, "://"))
             snprintf(url, sizeof(url), "crypto+%s", seg->url);
         else
             snprintf(url, sizeof(url), "crypto:%s", seg->url);
 
-        av_dict_set(&opts, "key", key, 0);
+        av_dict_set(&opts, "key", hex_key, 0);
         av_dict_set(&opts, "iv", iv, 0);
 
-        ret = open_url(pls->parent, in, url, &c->avio_opts, opts, &is_http);
+        ret = open_url(pls->parent, in, url, avio_opts, opts, &is_http);
         if (ret < 0) {
             goto cleanup;
         }
         ret = 0;
     } else {
-        ret = open_url(pls->parent, in, seg->url, &c->avio_opts, opts, &is_http);
+        ret = open_url(pls->parent, in, seg->url, avio_opts, opts, &is_http);
     }
 
     /* Seek to the requested position. If this was a HTTP request, the offset
@@ -1311,6 +1449,12 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
 
 cleanup:
     av_dict_free(&opts);
+    return ret;
+}
+
+static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg, AVIOContext **in)
+{
+    int ret = open_segment(c, pls, seg, in, &c->avio_opts, pls->key_url, pls->key);
     pls->cur_seg_offset = 0;
     return ret;
 }
@@ -1372,6 +1516,353 @@ static int update_init_section(struct playlist *pls, struct segment *seg)
     return 0;
 }
 
+#if HAVE_THREADS
+/*
+ * prefetch_segments: worker threads download the segments following the
+ * one being read into memory. The demuxer thread queues them in order and
+ * takes ownership of a slot once its download is done.
+ */
+
+static void prefetch_slot_reset(struct segment_prefetch *p)
+{
+    av_freep(&p->seg.url);
+    av_freep(&p->seg.key);
+    av_dict_free(&p->opts);
+    av_freep(&p->data);
+    p->data_size   = 0;
+    p->read_offset = 0;
+    p->discard     = 0;
+    p->ret         = 0;
+    p->state       = PREFETCH_FREE;
+}
+
+/* must be called with prefetch_mutex held */
+static void prefetch_slot_drop(struct segment_prefetch *p)
+{
+    if (p->state == PREFETCH_RUNNING)
+        p->discard = 1;
+    else if (p->state != PREFETCH_FREE)
+        prefetch_slot_reset(p);
+}
+
+static int prefetch_aborted(struct playlist *pls)
+{
+    int abort;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    abort = pls->prefetch_abort;
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    return abort;
+}
+
+static int prefetch_download(struct playlist *pls, struct segment_prefetch *p,
+                             AVIOContext **conn, char *key_url, uint8_t *key)
+{
+    AVFormatContext *s = pls->parent;
+    HLSContext *c = s->priv_data;
+    AVIOContext *dyn = NULL;
+    uint8_t buf[16384];
+    int64_t left = p->seg.size;
+    int reuse = use_keepalive(c) && p->seg.key_type == KEY_NONE &&
+                av_strstart(p->seg.url, "http", NULL);
+    int ret;
+
+    if (!reuse)
+        ff_format_io_close(s, conn);
+
+    ret = open_segment(c, pls, &p->seg, conn, &p->opts, key_url, key);
+    if (ret < 0)
+        return ret;
+    memcpy(p->key, key, sizeof(p->key));
+
+    ret = avio_open_dyn_buf(&dyn);
+    if (ret < 0)
+        goto end;
+
+    while (left) {
+        int n = avio_read(*conn, buf, left > 0 ? FFMIN(left, sizeof(buf)) : sizeof(buf));
+        if (n == AVERROR_EOF)
+            break;
+        if (n < 0) {
+            ret = n;
+            goto end;
+        }
+        avio_write(dyn, buf, n);
+        if (left > 0)
+            left -= n;
+        if (ff_check_interrupt(c->interrupt_callback) || prefetch_aborted(pls)) {
+            ret = AVERROR_EXIT;
+            goto end;
+        }
+    }
+
+    p->data_size = avio_close_dyn_buf(dyn, &p->data);
+    dyn = NULL;
+    if (!p->data)
+        ret = AVERROR(ENOMEM);
+
+end:
+    ffio_free_dyn_buf(&dyn);
+    if (ret < 0 || !reuse)
+        ff_format_io_close(s, conn);
+    return ret;
+}
+
+static void *prefetch_worker(void *arg)
+{
+    struct playlist *pls = arg;
+    AVIOContext *conn = NULL;
+    char key_url[MAX_URL_SIZE] = "";
+    uint8_t key[16] = { 0 };
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    while (!pls->prefetch_abort) {
+        struct segment_prefetch *p = NULL;
+        int i, ret;
+
+        for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++) {
+            struct segment_prefetch *q = &pls->prefetch[i];
+            if (q->state == PREFETCH_QUEUED && (!p || q->seq_no < p->seq_no))
+                p = q;
+        }
+        if (!p) {
+            pthread_cond_wait(&pls->prefetch_cond, &pls->prefetch_mutex);
+            continue;
+        }
+
+        p->state = PREFETCH_RUNNING;
+        pthread_mutex_unlock(&pls->prefetch_mutex);
+
+        ret = prefetch_download(pls, p, &conn, key_url, key);
+
+        pthread_mutex_lock(&pls->prefetch_mutex);
+        if (p->discard) {
+            prefetch_slot_reset(p);
+        } else {
+            p->ret   = ret;
+            p->state = PREFETCH_DONE;
+        }
+        pthread_cond_broadcast(&pls->prefetch_cond);
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    ff_format_io_close(pls->parent, &conn);
+    return NULL;
+}
+
+static int prefetch_start(HLSContext *c, struct playlist *pls)
+{
+    int i, ret;
+
+    if (pls->n_prefetch_threads)
+        return 0;
+
+    if ((ret = pthread_mutex_init(&pls->prefetch_mutex, NULL)))
+        return AVERROR(ret);
+    if ((ret = pthread_cond_init(&pls->prefetch_cond, NULL))) {
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+        return AVERROR(ret);
+    }
+
+    pls->prefetch_abort = 0;
+    for (i = 0; i < c->prefetch_segments; i++) {
+        ret = pthread_create(&pls->prefetch_threads[i], NULL, prefetch_worker, pls);
+        if (ret)
+            break;
+        pls->n_prefetch_threads++;
+    }
+
+    if (!pls->n_prefetch_threads) {
+        pthread_cond_destroy(&pls->prefetch_cond);
+        pthread_mutex_destroy(&pls->prefetch_mutex);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+static void prefetch_stop(struct playlist *pls)
+{
+    int i;
+
+    if (!pls->n_prefetch_threads)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    pls->prefetch_abort = 1;
+    pthread_cond_broadcast(&pls->prefetch_cond);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    for (i = 0; i < pls->n_prefetch_threads; i++)
+        pthread_join(pls->prefetch_threads[i], NULL);
+    pls->n_prefetch_threads = 0;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++)
+        prefetch_slot_reset(&pls->prefetch[i]);
+    pls->cur_prefetch = NULL;
+
+    pthread_cond_destroy(&pls->prefetch_cond);
+    pthread_mutex_destroy(&pls->prefetch_mutex);
+}
+
+/* drop all queued and downloaded segments, e.g. after seeking */
+static void prefetch_flush(struct playlist *pls)
+{
+    int i;
+
+    if (!pls->n_prefetch_threads)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++)
+        prefetch_slot_drop(&pls->prefetch[i]);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    pls->cur_prefetch = NULL;
+}
+
+/* queue cur_seq_no and the prefetch_segments following it,
+ * must be called with prefetch_mutex held */
+static void prefetch_schedule(HLSContext *c, struct playlist *pls)
+{
+    int64_t last = FFMIN(pls->cur_seq_no + c->prefetch_segments,
+                         pls->start_seq_no + pls->n_segments - 1);
+    int64_t seq_no;
+    int i;
+
+    for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++) {
+        struct segment_prefetch *p = &pls->prefetch[i];
+        if (p->state != PREFETCH_CONSUMING &&
+            (p->seq_no < pls->cur_seq_no || p->seq_no > last))
+            prefetch_slot_drop(p);
+    }
+
+    for (seq_no = FFMAX(pls->cur_seq_no, pls->start_seq_no); seq_no <= last; seq_no++) {
+        struct segment_prefetch *p = NULL;
+        struct segment *seg = pls->segments[seq_no - pls->start_seq_no];
+        int queued = 0;
+
+        for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++) {
+            struct segment_prefetch *q = &pls->prefetch[i];
+            if (q->state != PREFETCH_FREE && !q->discard && q->seq_no == seq_no)
+                queued = 1;
+            else if (q->state == PREFETCH_FREE && !p)
+                p = q;
+        }
+        if (queued)
+            continue;
+        if (!p)
+            break;
+
+        p->seq_no          = seq_no;
+        p->seg.duration    = seg->duration;
+        p->seg.url_offset  = seg->url_offset;
+        p->seg.size        = seg->size;
+        p->seg.key_type    = seg->key_type;
+        memcpy(p->seg.iv, seg->iv, sizeof(seg->iv));
+        p->seg.url = av_strdup(seg->url);
+        if (seg->key)
+            p->seg.key = av_strdup(seg->key);
+        if (!p->seg.url || (seg->key && !p->seg.key) ||
+            av_dict_copy(&p->opts, c->avio_opts, 0) < 0) {
+            prefetch_slot_reset(p);
+            break;
+        }
+        p->state = PREFETCH_QUEUED;
+    }
+
+    pthread_cond_broadcast(&pls->prefetch_cond);
+}
+
+/* wait for the download of the current segment and start reading it */
+static int prefetch_open(HLSContext *c, struct playlist *pls)
+{
+    const AVDictionaryEntry *e;
+    struct segment_prefetch *p;
+    int i, ret;
+
+    if ((ret = prefetch_start(c, pls)) < 0)
+        return ret;
+
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    for (;;) {
+        int64_t t;
+        struct timespec tv;
+
+        /* slots still held by discarded downloads are reused once
+         * those finish, so retry until the current one is queued */
+        prefetch_schedule(c, pls);
+
+        p = NULL;
+        for (i = 0; i < FF_ARRAY_ELEMS(pls->prefetch); i++) {
+            struct segment_prefetch *q = &pls->prefetch[i];
+            if (q->state != PREFETCH_FREE && !q->discard && q->seq_no == pls->cur_seq_no)
+                p = q;
+        }
+        if (p && p->state == PREFETCH_DONE) {
+            ret = p->ret;
+            break;
+        }
+        if (ff_check_interrupt(c->interrupt_callback)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+
+        t = av_gettime() + 100000;
+        tv.tv_sec  = t / 1000000;
+        tv.tv_nsec = (t % 1000000) * 1000;
+        pthread_cond_timedwait(&pls->prefetch_cond, &pls->prefetch_mutex, &tv);
+    }
+
+    if (p && p->state == PREFETCH_DONE) {
+        if (ret < 0) {
+            prefetch_slot_reset(p);
+        } else {
+            p->state = PREFETCH_CONSUMING;
+            pls->cur_prefetch = p;
+        }
+    }
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    if (ret < 0)
+        return ret;
+
+    /* the worker got its own copy of the options, keep the cookies it
+     * was sent for the following requests */
+    e = av_dict_get(p->opts, "cookies", NULL, 0);
+    if (e && (ret = av_dict_set(&c->avio_opts, "cookies", e->value, 0)) < 0)
+        return ret;
+
+    /* SAMPLE-AES decryption in hls_read_packet() uses the playlist key */
+    if (p->seg.key_type != KEY_NONE) {
+        memcpy(pls->key, p->key, sizeof(pls->key));
+        av_strlcpy(pls->key_url, p->seg.key, sizeof(pls->key_url));
+    }
+    pls->cur_seg_offset = 0;
+
+    return 0;
+}
+
+static void prefetch_release(struct playlist *pls)
+{
+    pthread_mutex_lock(&pls->prefetch_mutex);
+    prefetch_slot_reset(pls->cur_prefetch);
+    pthread_mutex_unlock(&pls->prefetch_mutex);
+
+    pls->cur_prefetch = NULL;
+}
+#else
+static int prefetch_open(HLSContext *c, struct playlist *pls)
+{
+    return AVERROR(ENOSYS);
+}
+
+static void prefetch_release(struct playlist *pls) {}
+static void prefetch_flush(struct playlist *pls) {}
+static void prefetch_stop(struct playlist *pls) {}
+#endif
+
 static int64_t default_reload_interval(struct playlist *pls)
 {
     return pls->n_segments > 0 ?
@@ -1439,7 +1930,7 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if ((!v->input && !v->cur_prefetch) || v->input_read_done) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1510,7 +2001,9 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (c->prefetch_segments) {
+            ret = prefetch_open(c, v);
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1539,7 +2032,7 @@ reload:
         just_opened = 1;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1549,7 +2042,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !c->prefetch_segments &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1582,7 +2075,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->cur_prefetch) {
+        prefetch_release(v);
+    } else if (use_keepalive(c) &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1862,6 +2357,41 @@ static void update_noheader_flag(AVFormatContext *s)
         s->ctx_flags &= ~AVFMTCTX_NOHEADER;
 }
 
+/* the probe_once cache key of a playlist, or NULL if its segment URLs
+ * have no usable extension and it has to be probed */
+static const char *probe_once_key(const struct playlist *pls, char *key, int key_size)
+{
+    const char *url = pls->segments[0]->url;
+    const char *end = url + strcspn(url, "?#");
+    const char *ext = end;
+
+    while (ext > url && ext[-1] != '.' && ext[-1] != '/')
+        ext--;
+    if (ext == url || ext[-1] != '.' || ext == end || end - ext >= key_size - 2)
+        return NULL;
+
+    snprintf(key, key_size, "%d%.*s", !!pls->segments[0]->init_section,
+             (int)(end - ext), ext);
+    return key;
+}
+
+static const AVInputFormat *probe_once_find(HLSContext *c, const char *key)
+{
+    for (int i = 0; i < c->n_probed_fmts; i++)
+        if (!strcmp(c->probed_fmts[i].key, key))
+            return c->probed_fmts[i].fmt;
+    return NULL;
+}
+
+static void probe_once_add(HLSContext *c, const char *key, const AVInputFormat *fmt)
+{
+    if (c->n_probed_fmts == FF_ARRAY_ELEMS(c->probed_fmts))
+        return;
+    av_strlcpy(c->probed_fmts[c->n_probed_fmts].key, key,
+               sizeof(c->probed_fmts[0].key));
+    c->probed_fmts[c->n_probed_fmts++].fmt = fmt;
+}
+
 static int hls_close(AVFormatContext *s)
 {
     HLSContext *c = s->priv_data;
@@ -1900,6 +2430,15 @@ static int hls_read_header(AVFormatContext *s)
        the range header */
     av_dict_set_int(&c->avio_opts, "seekable", c->http_seekable, 0);
 
+    if (c->prefetch_segments && !HAVE_THREADS) {
+        av_log(s, AV_LOG_WARNING, "prefetch_segments requires threads, disabling it\n");
+        c->prefetch_segments = 0;
+    }
+    if (c->prefetch_segments && !ff_format_io_is_default(s)) {
+        av_log(s, AV_LOG_WARNING, "prefetch_segments does not work with a custom io_open, disabling it\n");
+        c->prefetch_segments = 0;
+    }
+
     if ((ret = parse_playlist(c, s->url, NULL, s->pb)) < 0)
         return ret;
 
@@ -2061,23 +2600,41 @@ static int hls_read_header(AVFormatContext *s)
             in_fmt = av_find_input_format(pls->audio_setup_info.codec_id == AV_CODEC_ID_AAC ? "aac" :
                                           pls->audio_setup_info.codec_id == AV_CODEC_ID_AC3 ? "ac3" : "eac3");
         } else {
+            char key_buf[sizeof(c->probed_fmts[0].key)];
+            const char *key = c->probe_once ?
+                              probe_once_key(pls, key_buf, sizeof(key_buf)) : NULL;
+
             pls->ctx->probesize = s->probesize > 0 ? s->probesize : 1024 * 4;
             pls->ctx->max_analyze_duration = s->max_analyze_duration > 0 ? s->max_analyze_duration : 4 * AV_TIME_BASE;
             pls->ctx->interrupt_callback = s->interrupt_callback;
-            url = av_strdup(pls->segments[0]->url);
-            ret = av_probe_input_buffer(&pls->pb.pub, &in_fmt, url, NULL, 0, 0);
-            if (ret < 0) {
-                /* Free the ctx - it isn't initialized properly at this point,
-                * so avformat_close_input shouldn't be called. If
-                * avformat_open_input fails below, it frees and zeros the
-                * context, so it doesn't need any special treatment like this. */
-                av_log(s, AV_LOG_ERROR, "Error when loading first segment '%s'\n", url);
-                avformat_free_context(pls->ctx);
-                pls->ctx = NULL;
+
+            if (key && (in_fmt = probe_once_find(c, key))) {
+                av_log(s, AV_LOG_DEBUG, "Reusing format %s for playlist %d\n",
+                       in_fmt->name, pls->index);
+            } else {
+                url = av_strdup(pls->segments[0]->url);
+                ret = av_probe_input_buffer(&pls->pb.pub, &in_fmt, url, NULL, 0, 0);
+                if (ret < 0) {
+                    /* Free the ctx - it isn't initialized properly at this point,
+                    * so avformat_close_input shouldn't be called. If
+                    * avformat_open_input fails below, it frees and zeros the
+                    * context, so it doesn't need any special treatment like this. */
+                    av_log(s, AV_LOG_ERROR, "Error when loading first segment '%s'\n", url);
+                    avformat_free_context(pls->ctx);
+                    pls->ctx = NULL;
+                    av_free(url);
+                    return ret;
+                }
                 av_free(url);
-                return ret;
+                if (key)
+                    probe_once_add(c, key, in_fmt);
             }
-            av_free(url);
+
+            /* ID3 timestamps are only used with elementary audio streams,
+             * skip looking for them at the start of every segment */
+            if (c->probe_once && pls->is_id3_timestamped == -1 &&
+                (!strcmp(in_fmt->name, "mpegts") || strstr(in_fmt->name, "mov")))
+                pls->is_id3_timestamped = 0;
         }
 
         seg = current_segment(pls);
@@ -2126,7 +2683,8 @@ static int hls_read_header(AVFormatContext *s)
          * but for other streams we can rely on our user calling avformat_find_stream_info()
          * on us if they want to.
          */
-        if (pls->is_id3_timestamped || (pls->n_renditions > 0 && pls->renditions[0]->type == AVMEDIA_TYPE_AUDIO)) {
+        if (pls->is_id3_timestamped ||
+            (pls->n_renditions > 0 && pls->renditions[0]->type == AVMEDIA_TYPE_AUDIO)) {
             seg = current_segment(pls);
             if (seg && seg->key_type == KEY_SAMPLE_AES && pls->audio_setup_info.setup_data_length > 0 &&
                 pls->ctx->nb_streams == 1)
@@ -2192,6 +2750,7 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
         } else if (first && !cur_needed && pls->needed) {
             ff_format_io_close(pls->parent, &pls->input);
             pls->input_read_done = 0;
+            prefetch_flush(pls);
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
             pls->needed = 0;
@@ -2448,6 +3007,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         AVIOContext *const pb = &pls->pb.pub;
         ff_format_io_close(pls->parent, &pls->input);
         pls->input_read_done = 0;
+        prefetch_flush(pls);
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
         av_packet_unref(pls->pkt);
@@ -2559,6 +3119,10 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of segments to download ahead of the current one, 0 to disable",
+     OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, MAX_PREFETCH_SEGMENTS, FLAGS},
+    {"probe_once", "Assume all playlists use the same segment format and probe it only once",
+     OFFSET(probe_once), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS},
     {NULL}
 };
 
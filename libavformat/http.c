@@ -23,11 +23,22 @@
 #include "libavcodec/ffjni.h"
 #include "libavcodec/jni.h"
 
+#include "libavcodec/bytestream.h"
+
+#include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/fifo.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "http.h"
 #include "url.h"
 
+#define SEGMENT_SIZE 8192
+
+/* flags returned by okhttpOpenPacked() */
+#define OKHTTP_OPEN_FLAG_SEEKABLE      0x1
+#define OKHTTP_OPEN_FLAG_ACCEPT_RANGES 0x2
 
 struct JNIOkhttpFields {
 
@@ -37,14 +48,20 @@ struct JNIOkhttpFields {
 
     jmethodID okhttp_open_method;
 
+    jmethodID okhttp_open_packed_method;
+
     jmethodID okhttp_read_method;
 
+    jmethodID okhttp_read_direct_method;
+
     jmethodID okhttp_seek_method;
 
     jmethodID okhttp_close_method;
 
     jmethodID okhttp_get_mime_method;
 
+    jmethodID okhttp_new_request_method;
+
     jclass hash_map_class;
 
     jmethodID hash_map_init_method;
@@ -59,10 +76,13 @@ static const struct FFJniField jfields_okhttp_mapping[] = {
         { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", NULL, NULL, FF_JNI_CLASS, OFFSET(okhttp_class), 1 },
         { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "<init>", "(Ljava/lang/String;Ljava/lang/String;)V", FF_JNI_METHOD, OFFSET(init_method), 1 },
         { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpOpen", "(Ljava/util/Map;)I", FF_JNI_METHOD, OFFSET(okhttp_open_method), 1 },
+        { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpOpenPacked", "(Ljava/nio/ByteBuffer;I)I", FF_JNI_METHOD, OFFSET(okhttp_open_packed_method), 0 },
         { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpRead", "([BI)I", FF_JNI_METHOD, OFFSET(okhttp_read_method), 1 },
+        { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpReadDirect", "(Ljava/nio/ByteBuffer;I)I", FF_JNI_METHOD, OFFSET(okhttp_read_direct_method), 0 },
         { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpSeek", "(JI)J", FF_JNI_METHOD, OFFSET(okhttp_seek_method), 1 },
         { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpClose", "()V", FF_JNI_METHOD, OFFSET(okhttp_close_method), 1 },
         { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpGetMime", "()Ljava/lang/String;", FF_JNI_METHOD, OFFSET(okhttp_get_mime_method), 1 },
+        { "com/solarized/firedown/ffmpegutils/FFmpegOkhttp", "okhttpNewRequest", "(Ljava/lang/String;Ljava/util/Map;)I", FF_JNI_METHOD, OFFSET(okhttp_new_request_method), 0 },
         { "java/util/HashMap", NULL, NULL, FF_JNI_CLASS, OFFSET(hash_map_class), 1 },
         { "java/util/HashMap", "<init>", "()V", FF_JNI_METHOD, OFFSET(hash_map_init_method), 1 },
         { "java/util/HashMap", "put", "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;", FF_JNI_METHOD, OFFSET(hash_map_put_method), 1 },
@@ -77,12 +97,69 @@ typedef struct {
 
     char *mime_type;
 
+    char *location;
+
+    /* reported by okhttpOpenPacked(), -1 if unknown */
+    int64_t content_length;
+
+    int seekable;
+
+    int direct_buffer;
+
+    int buffer_size;
+
     struct JNIOkhttpFields jfields;
 
     jbyteArray jarray;
 
+    /* native buffer for the open handshake, wrapped by jbuffer when
+     * direct_buffer is used, reads wrap the caller's buffer instead;
+     * also the staging buffer of the prefetch thread */
+    uint8_t *buffer;
+
+    jobject jbuffer;
+
     jobject thiz;
 
+    int prefetch_size;
+
+    /* prefetch state, see okhttp_prefetch_task() */
+    AVFifo *fifo;
+
+    int read_back_capacity;
+
+    int read_pos;
+
+    int64_t logical_pos;
+
+    int64_t logical_size;
+
+    int seek_request;
+
+    int64_t seek_pos;
+
+    int seek_whence;
+
+    int seek_completed;
+
+    int64_t seek_ret;
+
+    int io_error;
+
+    int io_eof_reached;
+
+    int abort_request;
+
+    int prefetch_started;
+
+    pthread_cond_t cond_wakeup_main;
+
+    pthread_cond_t cond_wakeup_background;
+
+    pthread_mutex_t mutex;
+
+    pthread_t prefetch_thread;
+
 } OkhttpContext;
 
 
@@ -93,16 +170,18 @@ typedef struct {
 static const AVOption options[] = {
     { "headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D | E },
     { "mime_type", "export the MIME type", OFFSET(mime_type), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "location", "The actual location of the data received", OFFSET(location), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D | E },
+    { "direct_buffer", "read through a direct ByteBuffer wrapping native memory", OFFSET(direct_buffer), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, D },
+    { "buffer_size", "maximum number of bytes transferred per read call", OFFSET(buffer_size), AV_OPT_TYPE_INT, { .i64 = 128 * 1024 }, SEGMENT_SIZE, INT_MAX / 2, D },
+    { "prefetch_size", "read ahead up to this many bytes on a background thread, 0 disables it", OFFSET(prefetch_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX / 2, D },
     { NULL }
 };
 #undef OFFSET
 
-#define SEGMENT_SIZE 8192
-
 static jobject okhttp_get_options(OkhttpContext *c, JNIEnv *env, AVDictionary **options)
 {
     jobject meta_map = NULL;
-    AVDictionaryEntry *t = NULL;
+    const AVDictionaryEntry *t = NULL;
     jobject key = NULL;
     jobject value = NULL;
     jobject previous = NULL;
@@ -163,6 +242,656 @@ static jobject okhttp_get_options(OkhttpContext *c, JNIEnv *env, AVDictionary **
 
 }
 
+static int okhttp_alloc_buffer(OkhttpContext *c, JNIEnv *env)
+{
+    jobject buffer = NULL;
+    jbyteArray array = NULL;
+    int ret = 0;
+
+    if (c->direct_buffer && c->jfields.okhttp_read_direct_method) {
+
+        c->buffer = av_malloc(c->buffer_size);
+
+        if (!c->buffer) {
+            return AVERROR(ENOMEM);
+        }
+
+        buffer = (*env)->NewDirectByteBuffer(env, c->buffer, c->buffer_size);
+
+        if (!buffer || ff_jni_exception_check(env, 1, c) < 0) {
+            ret = AVERROR_EXTERNAL;
+            goto done;
+        }
+
+        c->jbuffer = (*env)->NewGlobalRef(env, buffer);
+
+        if (!c->jbuffer) {
+            ret = AVERROR_EXTERNAL;
+            goto done;
+        }
+
+    } else {
+
+        array = (*env)->NewByteArray(env, c->buffer_size);
+
+        if (!array) {
+            ret = AVERROR_EXTERNAL;
+            goto done;
+        }
+
+        c->jarray = (*env)->NewGlobalRef(env, array);
+
+        if (!c->jarray) {
+            ret = AVERROR_EXTERNAL;
+            goto done;
+        }
+
+    }
+
+    done:
+
+    if (ret < 0) {
+        av_freep(&c->buffer);
+    }
+
+    (*env)->DeleteLocalRef(env, buffer);
+    (*env)->DeleteLocalRef(env, array);
+
+    return ret;
+}
+
+static void okhttp_update_mime_type(OkhttpContext *c, JNIEnv *env)
+{
+    jobject mime_type = NULL;
+
+    av_freep(&c->mime_type);
+
+    mime_type = (*env)->CallObjectMethod(env, c->thiz, c->jfields.okhttp_get_mime_method);
+
+    if (ff_jni_exception_check(env, 1, c) < 0) {
+        return;
+    }
+
+    if(mime_type != NULL){
+        c->mime_type = ff_jni_jstring_to_utf_chars(env, mime_type, c);
+        (*env)->DeleteLocalRef(env, mime_type);
+    }
+}
+
+/*
+ * Packed open handshake. All integers are big endian, the default
+ * ByteBuffer order. The request is written to the direct buffer as
+ *     u32 number of options, then for each: u32 key length, key,
+ *     u32 value length, value
+ * and okhttpOpenPacked() overwrites it with the response
+ *     s32 HTTP status, s64 content length (-1 if unknown), u32 flags,
+ *     u32 MIME type length, MIME type,
+ *     u32 final URL length, final URL after redirects (optional)
+ * returning the response size, or a negative value on failure.
+ */
+static int okhttp_pack_options(OkhttpContext *c, AVDictionary *options)
+{
+    const AVDictionaryEntry *t = NULL;
+    PutByteContext pb;
+
+    bytestream2_init_writer(&pb, c->buffer, c->buffer_size);
+
+    bytestream2_put_be32(&pb, av_dict_count(options));
+
+    while ((t = av_dict_iterate(options, t))) {
+        size_t key_len = strlen(t->key);
+        size_t value_len = strlen(t->value);
+
+        if (key_len + value_len + 8 > bytestream2_get_bytes_left_p(&pb)) {
+            return AVERROR(ENOSPC);
+        }
+
+        bytestream2_put_be32(&pb, key_len);
+        bytestream2_put_buffer(&pb, t->key, key_len);
+        bytestream2_put_be32(&pb, value_len);
+        bytestream2_put_buffer(&pb, t->value, value_len);
+    }
+
+    return bytestream2_tell_p(&pb);
+}
+
+static int okhttp_open_packed(URLContext *h, JNIEnv *env, AVDictionary *options)
+{
+    OkhttpContext *c = h->priv_data;
+    GetByteContext gb;
+    int size, status, flags, mime_len, location_len;
+
+    size = okhttp_pack_options(c, options);
+
+    if (size < 0) {
+        return size;
+    }
+
+    size = (*env)->CallIntMethod(env, c->thiz, c->jfields.okhttp_open_packed_method, c->jbuffer, size);
+
+    if (ff_jni_exception_check(env, 1, c) < 0) {
+        return AVERROR_EXTERNAL;
+    }
+
+    if (size < 20) {
+        return AVERROR(EINVAL);
+    }
+
+    bytestream2_init(&gb, c->buffer, FFMIN(size, c->buffer_size));
+
+    status            = bytestream2_get_be32(&gb);
+    c->content_length = bytestream2_get_be64(&gb);
+    flags             = bytestream2_get_be32(&gb);
+    mime_len          = bytestream2_get_be32(&gb);
+
+    c->seekable = !!(flags & OKHTTP_OPEN_FLAG_SEEKABLE);
+
+    /* a known length and byte ranges are enough to seek with range requests */
+    if ((flags & OKHTTP_OPEN_FLAG_ACCEPT_RANGES) && c->content_length >= 0) {
+        c->seekable = 1;
+    }
+
+    av_freep(&c->mime_type);
+
+    if (mime_len > 0 && mime_len <= bytestream2_get_bytes_left(&gb)) {
+        c->mime_type = av_strndup(gb.buffer, mime_len);
+
+        if (!c->mime_type) {
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    bytestream2_skip(&gb, mime_len);
+
+    if (bytestream2_get_bytes_left(&gb) >= 4) {
+        location_len = bytestream2_get_be32(&gb);
+
+        if (location_len > 0 && location_len <= bytestream2_get_bytes_left(&gb)) {
+            char *location = av_strndup(gb.buffer, location_len);
+
+            if (!location) {
+                return AVERROR(ENOMEM);
+            }
+
+            av_free(c->location);
+            c->location = location;
+        }
+    }
+
+    av_log(c, AV_LOG_DEBUG, "okhttp_open status %d length %"PRId64" seekable %d mime %s location %s\n",
+           status, c->content_length, c->seekable,
+           c->mime_type ? c->mime_type : "none", c->location);
+
+    if (status < 200 || status >= 400) {
+        return ff_http_averror(status, AVERROR(EINVAL));
+    }
+
+    return 0;
+}
+
+static int okhttp_open_legacy(URLContext *h, JNIEnv *env, AVDictionary **options)
+{
+    OkhttpContext *c = h->priv_data;
+    jobject meta_map = NULL;
+    int ret = 0;
+
+    meta_map = okhttp_get_options(c, env, options);
+
+    ret = (*env)->CallIntMethod(env, c->thiz, c->jfields.okhttp_open_method, meta_map);
+
+    (*env)->DeleteLocalRef(env, meta_map);
+
+    if (ff_jni_exception_check(env, 1, c) < 0 || ret < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    if (ff_check_interrupt(&h->interrupt_callback)){
+        av_log(c, AV_LOG_DEBUG, "okhttp_open interrupt\n");
+        return AVERROR_EXIT;
+    }
+
+    okhttp_update_mime_type(c, env);
+
+    return 0;
+}
+
+static int okhttp_read_internal(URLContext *h, JNIEnv *env, unsigned char *buf, int size)
+{
+    OkhttpContext *c = h->priv_data;
+    jsize bytes_read = 0;
+    int buffer_size = 0;
+
+    buffer_size = FFMIN(size, c->buffer_size);
+
+    if (c->jbuffer) {
+
+        /* Java writes straight into the destination */
+        jobject jbuf = (*env)->NewDirectByteBuffer(env, buf, buffer_size);
+
+        if (!jbuf || ff_jni_exception_check(env, 1, c->thiz) < 0) {
+            (*env)->DeleteLocalRef(env, jbuf);
+            return AVERROR_EXTERNAL;
+        }
+
+        bytes_read = (*env)->CallIntMethod(env, c->thiz,
+                                           c->jfields.okhttp_read_direct_method, jbuf, buffer_size);
+
+        (*env)->DeleteLocalRef(env, jbuf);
+
+        if (ff_jni_exception_check(env, 1, c->thiz) < 0) {
+            av_log(c, AV_LOG_ERROR, "okhttp_read, bytes_read exception\n");
+            return AVERROR(EINVAL);
+        }
+
+        bytes_read = FFMIN(bytes_read, buffer_size);
+
+    } else {
+
+        bytes_read = (*env)->CallIntMethod(env, c->thiz,
+                                           c->jfields.okhttp_read_method, c->jarray, buffer_size);
+
+        if (ff_jni_exception_check(env, 1, c->thiz) < 0) {
+            av_log(c, AV_LOG_ERROR, "okhttp_read, bytes_read exception\n");
+            return AVERROR(EINVAL);
+        }
+
+        if (bytes_read > 0) {
+            (*env)->GetByteArrayRegion(env, c->jarray, 0, bytes_read, buf);
+        }
+
+    }
+
+    av_log(c, AV_LOG_DEBUG, "okhttp_read, bytes_read result: %d\n", bytes_read > 0 ? bytes_read : AVERROR_EOF);
+
+
+    return bytes_read > 0 ? bytes_read : AVERROR_EOF;
+}
+
+static int64_t okhttp_seek_internal(URLContext *h, JNIEnv *env, int64_t off, int whence)
+{
+    OkhttpContext *c = h->priv_data;
+    int64_t result = 0;
+
+    if (whence == AVSEEK_SIZE && c->content_length >= 0) {
+        return c->content_length;
+    }
+
+    result = (*env)->CallLongMethod(env, c->thiz,
+                                           c->jfields.okhttp_seek_method, off, whence);
+
+    if (ff_jni_exception_check(env, 1, c->thiz) < 0) {
+        return AVERROR(EINVAL);
+    }
+
+
+    if(result < 0)
+        result = AVERROR_EOF;
+
+    //av_log(c, AV_LOG_DEBUG, "okhttp_seek %ld\n", result);
+
+    return result;
+}
+
+/*
+ * Prefetch mode: a background thread owns the Java object and keeps
+ * c->fifo filled, the caller only consumes from it. The ring keeps a
+ * read-back window so short backward seeks are served from memory too.
+ * Modelled on the ring buffer in async.c, except that the thread reads
+ * into c->buffer without the lock and only copies into the fifo with it
+ * held, so the consumer never sees the write position before the data.
+ */
+
+static int okhttp_ring_size(OkhttpContext *c)
+{
+    return av_fifo_can_read(c->fifo) - c->read_pos;
+}
+
+static void okhttp_ring_reset(OkhttpContext *c)
+{
+    av_fifo_reset2(c->fifo);
+    c->read_pos = 0;
+}
+
+static void okhttp_ring_read(OkhttpContext *c, void *dest, int buf_size)
+{
+    av_assert2(buf_size <= okhttp_ring_size(c));
+    if (dest)
+        av_fifo_peek(c->fifo, dest, buf_size, c->read_pos);
+    c->read_pos += buf_size;
+
+    if (c->read_pos > c->read_back_capacity) {
+        av_fifo_drain2(c->fifo, c->read_pos - c->read_back_capacity);
+        c->read_pos = c->read_back_capacity;
+    }
+}
+
+static int okhttp_prefetch_check_interrupt(URLContext *h)
+{
+    OkhttpContext *c = h->priv_data;
+
+    if (c->abort_request)
+        return 1;
+
+    if (ff_check_interrupt(&h->interrupt_callback))
+        c->abort_request = 1;
+
+    return c->abort_request;
+}
+
+static void *okhttp_prefetch_task(void *arg)
+{
+    URLContext *h = arg;
+    OkhttpContext *c = h->priv_data;
+    JNIEnv *env;
+    int64_t seek_ret;
+    int ret = 0;
+
+    ff_thread_setname("okhttp");
+
+    /* attached once, detached by ffjni when the thread exits */
+    env = ff_jni_get_env(h);
+
+    while (1) {
+        int fifo_space;
+
+        pthread_mutex_lock(&c->mutex);
+        if (!env || okhttp_prefetch_check_interrupt(h)) {
+            c->io_eof_reached = 1;
+            c->io_error       = env ? AVERROR_EXIT : AVERROR(EINVAL);
+            pthread_cond_signal(&c->cond_wakeup_main);
+            pthread_mutex_unlock(&c->mutex);
+            break;
+        }
+
+        if (c->seek_request) {
+            seek_ret = okhttp_seek_internal(h, env, c->seek_pos, c->seek_whence);
+            if (seek_ret >= 0 && c->seek_whence != AVSEEK_SIZE) {
+                c->io_eof_reached = 0;
+                c->io_error       = 0;
+                okhttp_ring_reset(c);
+            }
+
+            c->seek_completed = 1;
+            c->seek_ret       = seek_ret;
+            c->seek_request   = 0;
+
+            pthread_cond_signal(&c->cond_wakeup_main);
+            pthread_mutex_unlock(&c->mutex);
+            continue;
+        }
+
+        fifo_space = av_fifo_can_write(c->fifo);
+        if (c->io_eof_reached || fifo_space <= 0) {
+            pthread_cond_signal(&c->cond_wakeup_main);
+            pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+            pthread_mutex_unlock(&c->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&c->mutex);
+
+        ret = okhttp_read_internal(h, env, c->buffer, FFMIN(c->buffer_size, fifo_space));
+
+        pthread_mutex_lock(&c->mutex);
+        /* only this thread writes or resets the fifo, the space is still there */
+        if (ret > 0) {
+            av_fifo_write(c->fifo, c->buffer, ret);
+        } else {
+            c->io_eof_reached = 1;
+            if (ret != AVERROR_EOF)
+                c->io_error = ret;
+        }
+
+        pthread_cond_signal(&c->cond_wakeup_main);
+        pthread_mutex_unlock(&c->mutex);
+    }
+
+    return NULL;
+}
+
+static int okhttp_prefetch_start(URLContext *h, JNIEnv *env)
+{
+    OkhttpContext *c = h->priv_data;
+    int ret;
+
+    /* staging buffer for the thread, already there in direct buffer mode */
+    if (!c->buffer) {
+        c->buffer = av_malloc(c->buffer_size);
+        if (!c->buffer)
+            return AVERROR(ENOMEM);
+    }
+
+    if (!c->fifo) {
+        c->read_back_capacity = c->prefetch_size / 4;
+        c->fifo = av_fifo_alloc2(c->prefetch_size + c->read_back_capacity, 1, 0);
+        if (!c->fifo)
+            return AVERROR(ENOMEM);
+    }
+
+    okhttp_ring_reset(c);
+
+    c->logical_pos     = 0;
+    c->logical_size    = okhttp_seek_internal(h, env, 0, AVSEEK_SIZE);
+    c->seek_request    = 0;
+    c->io_error        = 0;
+    c->io_eof_reached  = 0;
+    c->abort_request   = 0;
+
+    ret = pthread_mutex_init(&c->mutex, NULL);
+    if (ret != 0) {
+        ret = AVERROR(ret);
+        goto mutex_fail;
+    }
+
+    ret = pthread_cond_init(&c->cond_wakeup_main, NULL);
+    if (ret != 0) {
+        ret = AVERROR(ret);
+        goto cond_wakeup_main_fail;
+    }
+
+    ret = pthread_cond_init(&c->cond_wakeup_background, NULL);
+    if (ret != 0) {
+        ret = AVERROR(ret);
+        goto cond_wakeup_background_fail;
+    }
+
+    ret = pthread_create(&c->prefetch_thread, NULL, okhttp_prefetch_task, h);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto thread_fail;
+    }
+
+    c->prefetch_started = 1;
+
+    return 0;
+
+thread_fail:
+    pthread_cond_destroy(&c->cond_wakeup_background);
+cond_wakeup_background_fail:
+    pthread_cond_destroy(&c->cond_wakeup_main);
+cond_wakeup_main_fail:
+    pthread_mutex_destroy(&c->mutex);
+mutex_fail:
+    av_log(c, AV_LOG_ERROR, "failed to start prefetch thread: %s\n", av_err2str(ret));
+    return ret;
+}
+
+static void okhttp_prefetch_stop(URLContext *h)
+{
+    OkhttpContext *c = h->priv_data;
+    int ret;
+
+    if (!c->prefetch_started)
+        return;
+
+    pthread_mutex_lock(&c->mutex);
+    c->abort_request = 1;
+    pthread_cond_signal(&c->cond_wakeup_background);
+    pthread_mutex_unlock(&c->mutex);
+
+    ret = pthread_join(c->prefetch_thread, NULL);
+    if (ret != 0)
+        av_log(c, AV_LOG_ERROR, "pthread_join(): %s\n", av_err2str(AVERROR(ret)));
+
+    pthread_cond_destroy(&c->cond_wakeup_background);
+    pthread_cond_destroy(&c->cond_wakeup_main);
+    pthread_mutex_destroy(&c->mutex);
+
+    c->prefetch_started = 0;
+}
+
+static int okhttp_prefetch_read(URLContext *h, void *dest, int size)
+{
+    OkhttpContext *c  = h->priv_data;
+    int read_complete = !dest;
+    int to_read       = size;
+    int ret           = 0;
+
+    pthread_mutex_lock(&c->mutex);
+
+    while (to_read > 0) {
+        int fifo_size, to_copy;
+        if (okhttp_prefetch_check_interrupt(h)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        fifo_size = okhttp_ring_size(c);
+        to_copy   = FFMIN(to_read, fifo_size);
+        if (to_copy > 0) {
+            okhttp_ring_read(c, dest, to_copy);
+            if (dest)
+                dest = (uint8_t *)dest + to_copy;
+            c->logical_pos += to_copy;
+            to_read        -= to_copy;
+            ret             = size - to_read;
+
+            if (to_read <= 0 || !read_complete)
+                break;
+        } else if (c->io_eof_reached) {
+            if (ret <= 0) {
+                if (c->io_error)
+                    ret = c->io_error;
+                else
+                    ret = AVERROR_EOF;
+            }
+            break;
+        }
+        pthread_cond_signal(&c->cond_wakeup_background);
+        pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
+    }
+
+    pthread_cond_signal(&c->cond_wakeup_background);
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static int64_t okhttp_prefetch_seek(URLContext *h, int64_t off, int whence)
+{
+    OkhttpContext *c = h->priv_data;
+    int64_t new_logical_pos;
+    int64_t ret;
+
+    if (whence == AVSEEK_SIZE && c->logical_size >= 0) {
+        return c->logical_size;
+    } else if (whence == SEEK_CUR) {
+        new_logical_pos = off + c->logical_pos;
+    } else if (whence == SEEK_SET) {
+        new_logical_pos = off;
+    } else if (whence == SEEK_END && c->logical_size >= 0) {
+        new_logical_pos = off + c->logical_size;
+    } else {
+        new_logical_pos = -1;
+    }
+
+    if (whence != AVSEEK_SIZE && new_logical_pos >= 0) {
+        int fifo_size;
+
+        pthread_mutex_lock(&c->mutex);
+        fifo_size = okhttp_ring_size(c);
+        pthread_mutex_unlock(&c->mutex);
+
+        if (new_logical_pos == c->logical_pos) {
+            return c->logical_pos;
+        } else if (new_logical_pos >= c->logical_pos - c->read_pos &&
+                   new_logical_pos <= c->logical_pos + fifo_size) {
+            /* target is inside the prefetched window */
+            int pos_delta = (int)(new_logical_pos - c->logical_pos);
+
+            if (pos_delta > 0) {
+                /* the data is buffered, only an interrupt stops short */
+                ret = okhttp_prefetch_read(h, NULL, pos_delta);
+                if (ret != pos_delta)
+                    return ret < 0 ? ret : AVERROR(EIO);
+            } else {
+                pthread_mutex_lock(&c->mutex);
+                c->read_pos   += pos_delta;
+                c->logical_pos = new_logical_pos;
+                pthread_mutex_unlock(&c->mutex);
+            }
+
+            return c->logical_pos;
+        }
+    }
+
+    pthread_mutex_lock(&c->mutex);
+
+    c->seek_request   = 1;
+    if (whence == AVSEEK_SIZE || new_logical_pos < 0) {
+        c->seek_pos    = off;
+        c->seek_whence = whence;
+    } else {
+        c->seek_pos    = new_logical_pos;
+        c->seek_whence = SEEK_SET;
+    }
+    c->seek_completed = 0;
+    c->seek_ret       = 0;
+
+    while (1) {
+        if (okhttp_prefetch_check_interrupt(h)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (c->seek_completed) {
+            ret = c->seek_ret;
+            if (ret >= 0) {
+                if (whence == AVSEEK_SIZE)
+                    c->logical_size = ret;
+                else
+                    c->logical_pos  = ret;
+            }
+            break;
+        }
+        pthread_cond_signal(&c->cond_wakeup_background);
+        pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
+    }
+
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static void okhttp_release(OkhttpContext *c, JNIEnv *env)
+{
+    if (c->jarray) {
+        (*env)->DeleteGlobalRef(env, c->jarray);
+        c->jarray = NULL;
+    }
+
+    if (c->jbuffer) {
+        (*env)->DeleteGlobalRef(env, c->jbuffer);
+        c->jbuffer = NULL;
+    }
+
+    if (c->thiz) {
+        (*env)->DeleteGlobalRef(env, c->thiz);
+        c->thiz = NULL;
+    }
+
+    av_freep(&c->buffer);
+
+    av_fifo_freep2(&c->fifo);
+}
+
 static int okhttp_close(URLContext *h)
 {
     OkhttpContext *c = h->priv_data;
@@ -171,7 +900,11 @@ static int okhttp_close(URLContext *h)
 
     //av_log(c, AV_LOG_DEBUG, "okhttp_close\n");
 
-    if (!c->thiz || !c->jarray) {
+    okhttp_prefetch_stop(h);
+
+    if (!c->thiz) {
+        av_freep(&c->buffer);
+        av_fifo_freep2(&c->fifo);
         return 0;
     }
 
@@ -187,15 +920,7 @@ static int okhttp_close(URLContext *h)
         ret = AVERROR_EXTERNAL;
     }
 
-    (*env)->DeleteGlobalRef(env, c->jarray);
-
-    c->jarray = NULL;
-
-    (*env)->DeleteGlobalRef(env, c->thiz);
-
-    c->thiz = NULL;
-
-    ff_jni_reset_jfields(env, &c->jfields, jfields_okhttp_mapping, 1, c);
+    okhttp_release(c, env);
 
     return ret;
 }
@@ -208,13 +933,21 @@ static int okhttp_open(URLContext *h, const char *uri, int flags, AVDictionary *
     jobject object = NULL;
     jobject url = NULL;
     jobject headers = NULL;
-    jobject mime_type = NULL;
-    jobject meta_map = NULL;
-    jbyteArray array = NULL;
+    int opened = 0;
     int ret = 0;
 
     //av_log(c, AV_LOG_DEBUG, "okhttp_open\n");
 
+    c->content_length = -1;
+
+    av_freep(&c->location);
+
+    c->location = av_strdup(uri);
+
+    if (!c->location) {
+        return AVERROR(ENOMEM);
+    }
+
 
     av_jni_get_java_vm(h);
 
@@ -230,7 +963,7 @@ static int okhttp_open(URLContext *h, const char *uri, int flags, AVDictionary *
         goto done;
     }
 
-    ret = ff_jni_init_jfields(env, &c->jfields, jfields_okhttp_mapping, 1, c);
+    ret = ff_jni_get_jfields(env, &c->jfields, sizeof(c->jfields), jfields_okhttp_mapping, c);
 
     if (ret < 0) {
         av_log(c, AV_LOG_ERROR, "failed to initialize jni fields\n");
@@ -253,7 +986,7 @@ static int okhttp_open(URLContext *h, const char *uri, int flags, AVDictionary *
     }
 
 
-    object = (*env)->NewObject(env, c->jfields.okhttp_class, c->jfields.init_method, url, headers, meta_map);
+    object = (*env)->NewObject(env, c->jfields.okhttp_class, c->jfields.init_method, url, headers);
 
     if (!object) {
         ret = AVERROR_EXTERNAL;
@@ -267,17 +1000,9 @@ static int okhttp_open(URLContext *h, const char *uri, int flags, AVDictionary *
         goto done;
     }
 
-    array = (*env)->NewByteArray(env, SEGMENT_SIZE);
-
-    if(!array){
-        ret = AVERROR_EXTERNAL;
-        goto done;
-    }
-
-    c->jarray = (*env)->NewGlobalRef(env, array);
+    ret = okhttp_alloc_buffer(c, env);
 
-    if (!c->jarray) {
-        ret = AVERROR_EXTERNAL;
+    if (ret < 0) {
         goto done;
     }
 
@@ -287,37 +1012,45 @@ static int okhttp_open(URLContext *h, const char *uri, int flags, AVDictionary *
         goto done;
     }
 
-    meta_map = okhttp_get_options(c, env, options);
+    /* one round trip when the Java side supports it, the options
+     * must fit in the direct buffer */
+    ret = AVERROR(ENOSPC);
 
-    ret = (*env)->CallIntMethod(env, c->thiz, c->jfields.okhttp_open_method, meta_map);
-
-    if(ret < 0) {
-        ret = AVERROR(EINVAL);
-        goto done;
+    if (c->jbuffer && c->jfields.okhttp_open_packed_method) {
+        ret = okhttp_open_packed(h, env, options ? *options : NULL);
     }
 
+    if (ret == AVERROR(ENOSPC)) {
+        ret = okhttp_open_legacy(h, env, options);
+    }
 
-    if (ff_check_interrupt(&h->interrupt_callback)){
-        av_log(c, AV_LOG_DEBUG, "okhttp_open interrupt\n");
-        ret = AVERROR_EXIT;
+    if (ret < 0) {
         goto done;
     }
 
+    opened = 1;
 
-    mime_type = (*env)->CallObjectMethod(env, c->thiz, c->jfields.okhttp_get_mime_method);
+    /* only trust the handshake, the legacy path does not report it */
+    if (c->content_length >= 0 || c->seekable) {
+        h->is_streamed = !c->seekable;
+    }
 
-    if(mime_type != NULL){
-        const char *m = (*env)->GetStringUTFChars(env,mime_type, NULL);
-        c->mime_type = av_strdup(m);
-        (*env)->ReleaseStringUTFChars(env, mime_type, m);
+    if (c->prefetch_size > 0) {
+        ret = okhttp_prefetch_start(h, env);
     }
 
     done:
 
-    (*env)->DeleteLocalRef(env, meta_map);
-    (*env)->DeleteLocalRef(env, array);
+    /* url_close() is not called for a connection that failed to open */
+    if (ret < 0) {
+        if (opened) {
+            (*env)->CallVoidMethod(env, c->thiz, c->jfields.okhttp_close_method);
+            ff_jni_exception_check(env, 1, c->thiz);
+        }
+        okhttp_release(c, env);
+    }
+
     (*env)->DeleteLocalRef(env, object);
-    (*env)->DeleteLocalRef(env, mime_type);
     (*env)->DeleteLocalRef(env, url);
     (*env)->DeleteLocalRef(env, headers);
 
@@ -330,12 +1063,14 @@ static int okhttp_read(URLContext *h, unsigned char *buf, int size)
 {
     OkhttpContext *c = h->priv_data;
     JNIEnv *env = NULL;
-    jsize bytes_read = 0;
-    int buffer_size = 0;
 
 
     //av_log(c, AV_LOG_DEBUG, "okhttp_read size: %d\n", size);
 
+    if (c->prefetch_started) {
+        return okhttp_prefetch_read(h, buf, size);
+    }
+
     env = ff_jni_get_env(h);
 
     if (!env) {
@@ -348,39 +1083,68 @@ static int okhttp_read(URLContext *h, unsigned char *buf, int size)
         return AVERROR_EXIT;
     }
 
-    //(*state->env)->SetByteArrayRegion(state->env, array, 0, buf_size, (jbyte *) buf);
+    return okhttp_read_internal(h, env, buf, size);
+}
 
-    buffer_size = size > SEGMENT_SIZE ? SEGMENT_SIZE : size;
+static int64_t okhttp_seek(URLContext *h, int64_t off, int whence)
+{
+    OkhttpContext *c = h->priv_data;
+    JNIEnv *env;
 
+    if (c->prefetch_started) {
+        return okhttp_prefetch_seek(h, off, whence);
+    }
 
-    bytes_read = (*env)->CallIntMethod(env, c->thiz,
-                                           c->jfields.okhttp_read_method, c->jarray, buffer_size);
+    env = ff_jni_get_env(h);
 
-    if (ff_jni_exception_check(env, 1, c->thiz) < 0) {
-        av_log(c, AV_LOG_ERROR, "okhttp_read, bytes_read exception\n");
+    if (!env) {
         return AVERROR(EINVAL);
     }
 
-    //av_log(c, AV_LOG_DEBUG, "okhttp_read, bytes_read: %d\n", bytes_read);
-
+    if (ff_check_interrupt(&h->interrupt_callback)) {
+        av_log(c, AV_LOG_DEBUG, "okhttp_read callback \n");
+        return AVERROR_EXIT;
+    }
 
-    if(bytes_read > 0) {
+    return okhttp_seek_internal(h, env, off, whence);
 
-       (*env)->GetByteArrayRegion(env, c->jarray, 0, bytes_read, buf);
+}
 
+int ff_http_averror(int status_code, int default_averror)
+{
+    switch (status_code) {
+        case 400: return AVERROR_HTTP_BAD_REQUEST;
+        case 401: return AVERROR_HTTP_UNAUTHORIZED;
+        case 403: return AVERROR_HTTP_FORBIDDEN;
+        case 404: return AVERROR_HTTP_NOT_FOUND;
+        case 429: return AVERROR_HTTP_TOO_MANY_REQUESTS;
+        default: break;
     }
+    if (status_code >= 400 && status_code <= 499)
+        return AVERROR_HTTP_OTHER_4XX;
+    else if (status_code >= 500)
+        return AVERROR_HTTP_SERVER_ERROR;
+    else
+        return default_averror;
+}
 
-    av_log(c, AV_LOG_DEBUG, "okhttp_read, bytes_read result: %d\n", bytes_read > 0 ? bytes_read : AVERROR_EOF);
-
-
-    return bytes_read > 0 ? bytes_read : AVERROR_EOF;
+int ff_http_do_new_request(URLContext *h, const char *uri)
+{
+    return ff_http_do_new_request2(h, uri, NULL);
 }
 
-static int64_t okhttp_seek(URLContext *h, int64_t off, int whence)
+int ff_http_do_new_request2(URLContext *h, const char *uri, AVDictionary **opts)
 {
     OkhttpContext *c = h->priv_data;
-    int64_t result = 0;
-    JNIEnv *env;
+    AVDictionary *empty = NULL;
+    JNIEnv *env = NULL;
+    jobject url = NULL;
+    jobject meta_map = NULL;
+    int ret = 0;
+
+    if (!c->thiz || !c->jfields.okhttp_new_request_method || (h->flags & AVIO_FLAG_WRITE)) {
+        return AVERROR(ENOSYS);
+    }
 
     env = ff_jni_get_env(h);
 
@@ -389,25 +1153,68 @@ static int64_t okhttp_seek(URLContext *h, int64_t off, int whence)
     }
 
     if (ff_check_interrupt(&h->interrupt_callback)) {
-        av_log(c, AV_LOG_DEBUG, "okhttp_read callback \n");
+        av_log(c, AV_LOG_DEBUG, "okhttp_new_request interrupt\n");
         return AVERROR_EXIT;
     }
 
-    result = (*env)->CallLongMethod(env, c->thiz,
-                                           c->jfields.okhttp_seek_method, off, whence);
+    if (opts) {
+        ret = av_opt_set_dict(c, opts);
+        if (ret < 0)
+            return ret;
+    }
 
-    if (ff_jni_exception_check(env, 1, c->thiz) < 0) {
-        return AVERROR(EINVAL);
+    av_log(c, AV_LOG_DEBUG, "okhttp_new_request %s\n", uri);
+
+    /* the Java object must not be used concurrently with the prefetch thread */
+    okhttp_prefetch_stop(h);
+
+    url = ff_jni_utf_chars_to_jstring(env, uri, c);
+
+    if (!url) {
+        ret = AVERROR_EXTERNAL;
+        goto done;
     }
 
+    meta_map = okhttp_get_options(c, env, opts ? opts : &empty);
 
-    if(result < 0)
-        result = AVERROR_EOF;
+    ret = (*env)->CallIntMethod(env, c->thiz, c->jfields.okhttp_new_request_method, url, meta_map);
 
-    //av_log(c, AV_LOG_DEBUG, "okhttp_seek %ld\n", result);
+    if (ff_jni_exception_check(env, 1, c) < 0) {
+        ret = AVERROR_EXTERNAL;
+        goto done;
+    }
 
-    return result;
+    if (ret < 0) {
+        ret = AVERROR(EINVAL);
+        goto done;
+    }
+
+    okhttp_update_mime_type(c, env);
+
+    /* okhttpNewRequest() does not report these, query the Java side again */
+    c->content_length = -1;
+
+    av_free(c->location);
+
+    c->location = av_strdup(uri);
 
+    if (!c->location) {
+        ret = AVERROR(ENOMEM);
+        goto done;
+    }
+
+    ret = 0;
+
+    if (c->prefetch_size > 0) {
+        ret = okhttp_prefetch_start(h, env);
+    }
+
+    done:
+
+    (*env)->DeleteLocalRef(env, meta_map);
+    (*env)->DeleteLocalRef(env, url);
+
+    return ret;
 }
 
 static const AVClass okhttp_context_class = {
@@ -164,6 +164,23 @@ typedef struct FFFormatContext {
      */
     int streams_initialized;
 
+    /**
+     * Set while av_interleaved_write_frames() is running; the output is
+     * then flushed once per batch instead of after every packet.
+     */
+    int in_write_batch;
+
+    /**
+     * Decoder threads used by avformat_find_stream_info() when
+     * AVFormatContext.probe_threads is set, NULL otherwise.
+     */
+    struct ProbeWorkers *probe_workers;
+
+    /**
+     * Probe result cache state, see AVFormatContext.probe_cache.
+     */
+    struct ProbeCacheState *probe_cache;
+
     /**
      * ID3v2 tag useful for MP3 demuxing
      */
@@ -715,6 +732,13 @@ int ff_copy_whiteblacklists(AVFormatContext *dst, const AVFormatContext *src);
  */
 int ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * Check whether AVFormatContext.io_open and io_close2 are still the
+ * callbacks set by avformat_alloc_context(). Only those may be called
+ * from threads other than the one using the context.
+ */
+int ff_format_io_is_default(const AVFormatContext *s);
+
 /**
  * Utility function to check if the file uses http or https protocol
  *
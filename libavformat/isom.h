@@ -164,6 +164,29 @@ typedef struct MOVIndexRange {
     int64_t end;
 } MOVIndexRange;
 
+/**
+ * On-demand sample lookup for tracks whose AVIndex is not built, see the
+ * compact_index option. Samples are resolved from the stts, stsc, stsz and
+ * stco tables; every MOV_COMPACT_STEP-th stts and stsc entry is checkpointed
+ * so that any sample can be found with a binary search.
+ */
+typedef struct MOVCompactIndex {
+    unsigned int nb_samples;
+    int key_off;          ///< offset of the stss sample numbers
+    int64_t *stts_first;  ///< first sample of the checkpointed stts entries
+    int64_t *stts_dts;    ///< dts of these samples
+    int64_t *stsc_first;  ///< first sample of the checkpointed stsc entries
+
+    /* last resolved sample, the next one is found without a search */
+    int64_t sample;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stsc_index;
+    unsigned int chunk;
+    unsigned int chunk_sample;
+    AVIndexEntry entry;
+} MOVCompactIndex;
+
 typedef struct MOVStreamContext {
     AVIOContext *pb;
     int refcount;
@@ -204,6 +227,7 @@ typedef struct MOVStreamContext {
     int64_t current_index;
     MOVIndexRange* index_ranges;
     MOVIndexRange* current_index_range;
+    MOVCompactIndex *compact; ///< set if the samples are not in the AVIndex
     unsigned int bytes_per_frame;
     unsigned int samples_per_frame;
     int dv_audio_container;
@@ -362,6 +386,8 @@ typedef struct MOVContext {
     int thmb_item_id;
     int64_t idat_offset;
     int interleaved_read;
+    int compact_index;
+    int frag_index_scan;
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
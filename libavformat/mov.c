@@ -84,6 +84,8 @@ typedef struct MOVParseTableEntry {
 
 static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom);
 static int mov_read_mfra(MOVContext *c, AVIOContext *f);
+static int mov_scan_fragments(MOVContext *c, AVIOContext *pb, int64_t offset);
+static int mov_switch_root(AVFormatContext *s, int64_t target, int index);
 static void mov_free_stream_context(AVFormatContext *s, AVStream *st);
 static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, unsigned int* allocated_size,
                               int count, int duration);
@@ -1553,6 +1555,14 @@ static int64_t get_frag_time(AVFormatContext *s, AVStream *dst_st,
         return frag_stream_info->sidx_pts;
     }
 
+    // Prefer the tfdt of the stream itself, as its index entries are
+    // derived from it.
+    frag_stream_info = get_frag_stream_info(frag_index, index, sc->id);
+    if (frag_stream_info &&
+        frag_stream_info->first_tfra_pts == AV_NOPTS_VALUE &&
+        frag_stream_info->tfdt_dts != AV_NOPTS_VALUE)
+        return frag_stream_info->tfdt_dts - sc->time_offset;
+
     for (i = 0; i < frag_index->item[index].nb_stream_info; i++) {
         AVStream *frag_stream = NULL;
         frag_stream_info = &frag_index->item[index].stream_info[i];
@@ -1678,24 +1688,48 @@ static int mov_read_moof(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     // Set by mov_read_tfhd(). mov_read_trun() will reject files missing tfhd.
     c->fragment.found_tfhd = 0;
 
-    if (!c->has_looked_for_mfra && c->use_mfra_for > 0) {
+    if (!c->has_looked_for_mfra && (c->use_mfra_for > 0 || c->frag_index_scan)) {
         c->has_looked_for_mfra = 1;
         if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
             int ret;
-            av_log(c->fc, AV_LOG_VERBOSE, "stream has moof boxes, will look "
-                    "for a mfra\n");
-            if ((ret = mov_read_mfra(c, pb)) < 0) {
-                av_log(c->fc, AV_LOG_VERBOSE, "found a moof box but failed to "
-                        "read the mfra (may be a live ismv)\n");
+            // The mfra times are only used for the samples with
+            // use_mfra_for, otherwise the fragments need a tfdt to be read
+            // out of order, which only the scan checks.
+            if (c->use_mfra_for > 0) {
+                av_log(c->fc, AV_LOG_VERBOSE, "stream has moof boxes, will look "
+                        "for a mfra\n");
+                if ((ret = mov_read_mfra(c, pb)) < 0) {
+                    av_log(c->fc, AV_LOG_VERBOSE, "found a moof box but failed to "
+                            "read the mfra (may be a live ismv)\n");
+                }
+            }
+            if (c->frag_index_scan && !c->frag_index.complete &&
+                (ret = mov_scan_fragments(c, pb, avio_tell(pb) - 8)) < 0) {
+                if (ret == AVERROR(ENOMEM))
+                    return ret;
+                av_log(c->fc, AV_LOG_VERBOSE, "failed to build the fragment "
+                       "index, fragments will be read in order\n");
             }
         } else {
             av_log(c->fc, AV_LOG_VERBOSE, "found a moof box but stream is not "
                     "seekable, can not look for mfra\n");
         }
     }
+    // With a complete fragment index, reading the root atoms stops at the
+    // mdat following this fragment, not in its headers.
+    if (c->frag_index.complete)
+        c->found_mdat = 0;
     c->fragment.moof_offset = c->fragment.implicit_offset = avio_tell(pb) - 8;
     av_log(c->fc, AV_LOG_TRACE, "moof offset %"PRIx64"\n", c->fragment.moof_offset);
     c->frag_index.current = update_frag_index(c, c->fragment.moof_offset);
+    // Fragments read out of order must not be indexed again when they are
+    // reached by reading the following root atoms.
+    if (c->found_moov && c->frag_index.current >= 0) {
+        MOVFragmentIndexItem *item = &c->frag_index.item[c->frag_index.current];
+        if (item->headers_read)
+            return 0;
+        item->headers_read = 1;
+    }
     return mov_read_default(c, pb, atom);
 }
 
@@ -3927,11 +3961,387 @@ static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, uns
     return *ctts_count;
 }
 
+/* stts and stsc entries between two checkpoints of a compact index */
+#define MOV_COMPACT_STEP 32
+
+/* Find the last checkpoint at or before sample. */
+static unsigned int compact_checkpoint(const int64_t *first, unsigned int nb_entries,
+                                       int64_t sample)
+{
+    unsigned int a = 0, b = (nb_entries + MOV_COMPACT_STEP - 1) / MOV_COMPACT_STEP;
+
+    while (b - a > 1) {
+        unsigned int m = (a + b) >> 1;
+        if (first[m] <= sample)
+            a = m;
+        else
+            b = m;
+    }
+    return a;
+}
+
+static int64_t compact_sample_dts(const MOVStreamContext *sc, int64_t sample,
+                                  unsigned int *stts_index, unsigned int *stts_sample)
+{
+    const MOVCompactIndex *ci = sc->compact;
+    unsigned int k = compact_checkpoint(ci->stts_first, sc->stts_count, sample);
+    unsigned int i = k * MOV_COMPACT_STEP;
+    int64_t first = ci->stts_first[k];
+    int64_t dts   = ci->stts_dts[k];
+
+    while (i + 1 < sc->stts_count && first + sc->stts_data[i].count <= sample) {
+        first += sc->stts_data[i].count;
+        dts   += sc->stts_data[i].count * (int64_t)sc->stts_data[i].duration;
+        i++;
+    }
+    *stts_index  = i;
+    *stts_sample = sample - first;
+    return dts + (sample - first) * sc->stts_data[i].duration;
+}
+
+static int compact_is_keyframe(const AVStream *st, const MOVStreamContext *sc,
+                               int64_t sample)
+{
+    int64_t key = sample + sc->compact->key_off;
+    unsigned int a = 0, b = sc->keyframe_count;
+
+    if (sc->keyframe_absent)
+        return st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || !sample;
+    if (!sc->keyframe_count)
+        return 1;
+
+    while (a < b) {
+        unsigned int m = (a + b) >> 1;
+        if (sc->keyframes[m] < key)
+            a = m + 1;
+        else if (sc->keyframes[m] > key)
+            b = m;
+        else
+            return 1;
+    }
+    return 0;
+}
+
+/**
+ * Resolve a sample of a track with a compact index. The returned entry is
+ * overwritten by the next call for the same track.
+ */
+static AVIndexEntry *mov_compact_entry(AVStream *st, unsigned int sample)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVCompactIndex *ci = sc->compact;
+    AVIndexEntry *e = &ci->entry;
+
+    if (sample == ci->sample)
+        return e;
+
+    if (ci->sample >= 0 && sample == ci->sample + 1) {
+        /* step to the next sample like mov_build_index() does */
+        e->pos       += e->size;
+        e->timestamp += sc->stts_data[ci->stts_index].duration;
+        if (++ci->stts_sample == sc->stts_data[ci->stts_index].count &&
+            ci->stts_index + 1 < sc->stts_count) {
+            ci->stts_index++;
+            ci->stts_sample = 0;
+        }
+        if (++ci->chunk_sample == sc->stsc_data[ci->stsc_index].count) {
+            ci->chunk++;
+            ci->chunk_sample = 0;
+            if (mov_stsc_index_valid(ci->stsc_index, sc->stsc_count) &&
+                ci->chunk + 1 == sc->stsc_data[ci->stsc_index + 1].first)
+                ci->stsc_index++;
+            e->pos = sc->chunk_offsets[ci->chunk];
+        }
+    } else {
+        unsigned int k = compact_checkpoint(ci->stsc_first, sc->stsc_count, sample);
+        unsigned int i = k * MOV_COMPACT_STEP;
+        int64_t first = ci->stsc_first[k];
+
+        e->timestamp = compact_sample_dts(sc, sample, &ci->stts_index, &ci->stts_sample);
+
+        while (mov_stsc_index_valid(i, sc->stsc_count) &&
+               first + mov_get_stsc_samples(sc, i) <= sample) {
+            first += mov_get_stsc_samples(sc, i);
+            i++;
+        }
+        ci->stsc_index   = i;
+        ci->chunk        = sc->stsc_data[i].first - 1 + (sample - first) / sc->stsc_data[i].count;
+        ci->chunk_sample =                              (sample - first) % sc->stsc_data[i].count;
+
+        e->pos = sc->chunk_offsets[ci->chunk];
+        if (sc->stsz_sample_size > 0)
+            e->pos += ci->chunk_sample * (int64_t)sc->stsz_sample_size;
+        else
+            for (unsigned int j = sample - ci->chunk_sample; j < sample; j++)
+                e->pos += sc->sample_sizes[j];
+    }
+
+    e->size  = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[sample];
+    e->flags = compact_is_keyframe(st, sc, sample) ? AVINDEX_KEYFRAME : 0;
+    ci->sample = sample;
+
+    return e;
+}
+
+static int mov_nb_samples(AVStream *st)
+{
+    const MOVStreamContext *sc = st->priv_data;
+    return sc->compact ? sc->compact->nb_samples : ffstream(st)->nb_index_entries;
+}
+
+/**
+ * Get an index entry of st, whether its index is compact or not.
+ */
+static AVIndexEntry *mov_get_sample(AVStream *st, unsigned int sample)
+{
+    const MOVStreamContext *sc = st->priv_data;
+    return sc->compact ? mov_compact_entry(st, sample) : &ffstream(st)->index_entries[sample];
+}
+
+/* Expand ctts entries such that we have a 1-1 mapping with samples. */
+static int mov_expand_ctts(MOVStreamContext *sc)
+{
+    MOVCtts *ctts_data_old = sc->ctts_data;
+    unsigned int ctts_count_old = sc->ctts_count;
+
+    if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
+        return AVERROR(ENOMEM);
+    sc->ctts_count = 0;
+    sc->ctts_allocated_size = 0;
+    sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
+                            sc->sample_count * sizeof(*sc->ctts_data));
+    if (!sc->ctts_data) {
+        av_free(ctts_data_old);
+        return AVERROR(ENOMEM);
+    }
+
+    memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
+
+    for (unsigned int i = 0; i < ctts_count_old &&
+                sc->ctts_count < sc->sample_count; i++)
+        for (unsigned int j = 0; j < ctts_data_old[i].count &&
+                    sc->ctts_count < sc->sample_count; j++)
+            add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
+                           &sc->ctts_allocated_size, 1,
+                           ctts_data_old[i].duration);
+    av_free(ctts_data_old);
+
+    return 0;
+}
+
+static void mov_free_compact_index(MOVStreamContext *sc)
+{
+    if (!sc->compact)
+        return;
+    av_freep(&sc->compact->stts_first);
+    av_freep(&sc->compact->stts_dts);
+    av_freep(&sc->compact->stsc_first);
+    av_freep(&sc->compact);
+}
+
+/**
+ * Build the AVIndex of a track with a compact index, for the code which
+ * needs all samples in it, like the fragment parsing.
+ */
+static int mov_expand_compact_index(AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    unsigned int nb_samples, distance = 0;
+    AVIndexEntry *entries;
+    int ret;
+
+    if (!sc->compact)
+        return 0;
+
+    nb_samples = sc->compact->nb_samples;
+    entries = av_malloc_array(nb_samples, sizeof(*entries));
+    if (!entries)
+        return AVERROR(ENOMEM);
+
+    for (unsigned int i = 0; i < nb_samples; i++) {
+        entries[i] = *mov_compact_entry(st, i);
+        if (entries[i].flags & AVINDEX_KEYFRAME)
+            distance = 0;
+        entries[i].min_distance = distance++;
+    }
+
+    if (sc->ctts_data) {
+        ret = mov_expand_ctts(sc);
+        if (ret < 0) {
+            av_free(entries);
+            return ret;
+        }
+        /* the expanded ctts has one entry per sample */
+        sc->ctts_index  = sc->current_sample;
+        sc->ctts_sample = 0;
+    }
+
+    av_free(sti->index_entries);
+    sti->index_entries = entries;
+    sti->nb_index_entries = nb_samples;
+    sti->index_entries_allocated_size = nb_samples * sizeof(*entries);
+    mov_free_compact_index(sc);
+
+    return 0;
+}
+
+/**
+ * Set up a compact index for st instead of building its AVIndex, if the
+ * compact_index option is set and the track can be demuxed from its sample
+ * tables alone. The per-sample checks of mov_build_index() are done here
+ * too, any track needing one of its fixups gets the full index.
+ *
+ * @return 1 if the track uses a compact index, 0 if the AVIndex must be built
+ */
+static int mov_build_compact_index(MOVContext *mov, AVStream *st, int64_t start_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVCompactIndex *ci;
+    int64_t nb_samples = 0, stream_size = 0;
+    int64_t first, dts, media_time, edit_duration = 0;
+    unsigned int stsc_index = 0, stts_index, stts_sample;
+    int single_edit = 0;
+
+    if (!mov->compact_index)
+        return 0;
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+        st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+        return 0;
+    if (sc->iamf || sc->stps_count ||
+        (sc->rap_group_count && sc->rap_group) ||
+        !sc->stts_count || !sc->stsc_count || !sc->chunk_count)
+        return 0;
+
+    /* Edit lists rewrite the index, except for a single edit starting at
+     * the first sample and covering all of them (checked below). */
+    if (sc->elst_count && !mov->ignore_editlist && mov->advanced_editlist) {
+        if (sc->elst_count != 1 || sc->elst_data[0].time || sc->ctts_data ||
+            mov->time_scale <= 0)
+            return 0;
+        get_edit_list_entry(mov, sc, 0, &media_time, &edit_duration, mov->time_scale);
+        single_edit = 1;
+    }
+
+    for (unsigned int i = 0; i < sc->stts_count; i++)
+        if (!sc->stts_data[i].count || (single_edit && !sc->stts_data[i].duration))
+            return 0;
+    for (unsigned int i = 0; i < sc->stsc_count; i++)
+        if (sc->stsc_data[i].count <= 0 ||
+            (i ? sc->stsc_data[i].first <= sc->stsc_data[i - 1].first : sc->stsc_data[i].first != 1) ||
+            (sc->pseudo_stream_id != -1 && sc->stsc_data[i].id - 1 != sc->pseudo_stream_id))
+            return 0;
+    for (unsigned int i = 1; i < sc->keyframe_count; i++)
+        if (sc->keyframes[i] <= sc->keyframes[i - 1])
+            return 0;
+
+    for (unsigned int i = 0; i < sc->chunk_count; i++) {
+        int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
+        int64_t current_offset = sc->chunk_offsets[i];
+        int64_t chunk_size = 0;
+        unsigned int count;
+
+        while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
+            i + 1 == sc->stsc_data[stsc_index + 1].first)
+            stsc_index++;
+        count = sc->stsc_data[stsc_index].count;
+
+        if ((next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+             count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) ||
+            (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size))
+            return 0;
+        if (count > sc->sample_count - nb_samples)
+            return 0;
+
+        if (sc->stsz_sample_size > 0) {
+            if (sc->stsz_sample_size > 0x3FFFFFFF)
+                return 0;
+            chunk_size = count * (int64_t)sc->stsz_sample_size;
+        } else {
+            for (unsigned int j = 0; j < count; j++) {
+                unsigned int sample_size = sc->sample_sizes[nb_samples + j];
+                if (sample_size > 0x3FFFFFFF)
+                    return 0;
+                chunk_size += sample_size;
+            }
+        }
+        if (current_offset > INT64_MAX - chunk_size)
+            return 0;
+
+        stream_size += chunk_size;
+        nb_samples  += count;
+    }
+    if (!nb_samples || nb_samples > INT_MAX)
+        return 0;
+
+    ci = av_mallocz(sizeof(*ci));
+    if (!ci)
+        return 0;
+    sc->compact = ci;
+    ci->stts_first  = av_malloc_array((sc->stts_count + MOV_COMPACT_STEP - 1) / MOV_COMPACT_STEP,
+                                      sizeof(*ci->stts_first));
+    ci->stts_dts    = av_malloc_array((sc->stts_count + MOV_COMPACT_STEP - 1) / MOV_COMPACT_STEP,
+                                      sizeof(*ci->stts_dts));
+    ci->stsc_first  = av_malloc_array((sc->stsc_count + MOV_COMPACT_STEP - 1) / MOV_COMPACT_STEP,
+                                      sizeof(*ci->stsc_first));
+    if (!ci->stts_first || !ci->stts_dts || !ci->stsc_first)
+        goto fail;
+
+    first = 0;
+    dts   = start_dts;
+    for (unsigned int i = 0; i < sc->stts_count; i++) {
+        if (!(i % MOV_COMPACT_STEP)) {
+            ci->stts_first[i / MOV_COMPACT_STEP] = first;
+            ci->stts_dts[i / MOV_COMPACT_STEP]    = dts;
+        }
+        first += sc->stts_data[i].count;
+        dts   += sc->stts_data[i].count * (int64_t)sc->stts_data[i].duration;
+    }
+    first = 0;
+    for (unsigned int i = 0; i < sc->stsc_count; i++) {
+        if (!(i % MOV_COMPACT_STEP))
+            ci->stsc_first[i / MOV_COMPACT_STEP] = first;
+        first += mov_get_stsc_samples(sc, i);
+    }
+
+    ci->nb_samples = nb_samples;
+    ci->key_off    = sc->keyframe_count && sc->keyframes[0] > 0;
+    ci->sample     = -1;
+
+    if (single_edit &&
+        (compact_sample_dts(sc, nb_samples - 1, &stts_index, &stts_sample) >= edit_duration ||
+         (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !compact_is_keyframe(st, sc, 0))))
+        goto fail;
+
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        for (unsigned int i = 0; i < FFMIN(nb_samples, 99); i++)
+            ff_rfps_add_frame(mov->fc, st, mov_compact_entry(st, i)->timestamp);
+    if (st->duration > 0)
+        st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
+
+    if (single_edit) {
+        /* what mov_fix_index() leaves for such an edit */
+        sc->min_corrected_pts = 0;
+        if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+            sti->skip_samples = 0;
+        sc->start_pad = sti->skip_samples;
+        st->start_time = 0;
+        st->duration = FFMIN(st->duration, edit_duration);
+    }
+
+    av_log(mov->fc, AV_LOG_DEBUG, "stream %d: compact index of %u samples\n",
+           st->index, ci->nb_samples);
+    return 1;
+fail:
+    mov_free_compact_index(sc);
+    return 0;
+}
+
 #define MAX_REORDER_DELAY 16
 static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
 {
     MOVStreamContext *msc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int ctts_ind = 0;
     int ctts_sample = 0;
     int64_t pts_buf[MAX_REORDER_DELAY + 1]; // Circular buffer to sort pts.
@@ -3944,14 +4354,14 @@ static void mov_estimate_video_delay(MOVContext *c, AVStream* st)
     if (st->codecpar->video_delay <= 0 && msc->ctts_data &&
         st->codecpar->codec_id == AV_CODEC_ID_H264) {
         st->codecpar->video_delay = 0;
-        for (int ind = 0; ind < sti->nb_index_entries && ctts_ind < msc->ctts_count; ++ind) {
+        for (int ind = 0; ind < mov_nb_samples(st) && ctts_ind < msc->ctts_count; ++ind) {
             // Point j to the last elem of the buffer and insert the current pts there.
             j = buf_start;
             buf_start = (buf_start + 1);
             if (buf_start == MAX_REORDER_DELAY + 1)
                 buf_start = 0;
 
-            pts_buf[j] = sti->index_entries[ind].timestamp + msc->ctts_data[ctts_ind].duration;
+            pts_buf[j] = mov_get_sample(st, ind)->timestamp + msc->ctts_data[ctts_ind].duration;
 
             // The timestamps that are already in the sorted buffer, and are greater than the
             // current pts, are exactly the timestamps that need to be buffered to output PTS
@@ -4424,8 +4834,6 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     unsigned int stps_index = 0;
     unsigned int i, j;
     uint64_t stream_size = 0;
-    MOVCtts *ctts_data_old = sc->ctts_data;
-    unsigned int ctts_count_old = sc->ctts_count;
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
@@ -4495,6 +4903,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
 
         if (!sc->sample_count || sti->nb_index_entries)
             return;
+        if (mov_build_compact_index(mov, st, current_dts))
+            goto index_built;
         if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
             return;
         if (av_reallocp_array(&sti->index_entries,
@@ -4505,30 +4915,8 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         }
         sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
 
-        if (ctts_data_old) {
-            // Expand ctts entries such that we have a 1-1 mapping with samples
-            if (sc->sample_count >= UINT_MAX / sizeof(*sc->ctts_data))
-                return;
-            sc->ctts_count = 0;
-            sc->ctts_allocated_size = 0;
-            sc->ctts_data = av_fast_realloc(NULL, &sc->ctts_allocated_size,
-                                    sc->sample_count * sizeof(*sc->ctts_data));
-            if (!sc->ctts_data) {
-                av_free(ctts_data_old);
-                return;
-            }
-
-            memset((uint8_t*)(sc->ctts_data), 0, sc->ctts_allocated_size);
-
-            for (i = 0; i < ctts_count_old &&
-                        sc->ctts_count < sc->sample_count; i++)
-                for (j = 0; j < ctts_data_old[i].count &&
-                            sc->ctts_count < sc->sample_count; j++)
-                    add_ctts_entry(&sc->ctts_data, &sc->ctts_count,
-                                   &sc->ctts_allocated_size, 1,
-                                   ctts_data_old[i].duration);
-            av_free(ctts_data_old);
-        }
+        if (sc->ctts_data && mov_expand_ctts(sc) < 0)
+            return;
 
         for (i = 0; i < sc->chunk_count; i++) {
             int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
@@ -4729,9 +5117,10 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         mov_fix_index(mov, st);
     }
 
+index_built:
     // Update start time of the stream.
-    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries > 0) {
-        st->start_time = sti->index_entries[0].timestamp + sc->dts_shift;
+    if (st->start_time == AV_NOPTS_VALUE && st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && mov_nb_samples(st) > 0) {
+        st->start_time = mov_get_sample(st, 0)->timestamp + sc->dts_shift;
         if (sc->ctts_data) {
             st->start_time += sc->ctts_data[0].duration;
         }
@@ -5032,11 +5421,13 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
+    /* Do not need those anymore, unless the samples are resolved from them. */
+    if (!sc->compact) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+    }
     av_freep(&sc->stps_data);
     av_freep(&sc->elst_data);
     av_freep(&sc->rap_group);
@@ -5516,7 +5907,7 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     unsigned entries, first_sample_flags = frag->flags;
     int flags, distance, i;
     int64_t prev_dts = AV_NOPTS_VALUE;
-    int next_frag_index = -1, index_entry_pos;
+    int next_frag_index = -1, index_entry_pos, ret;
     size_t requested_size;
     size_t old_ctts_allocated_size;
     AVIndexEntry *new_entries;
@@ -5543,6 +5934,11 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    // Fragment samples are inserted into the AVIndex.
+    ret = mov_expand_compact_index(st);
+    if (ret < 0)
+        return ret;
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -5895,7 +6291,11 @@ static int mov_read_sidx(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         pts += duration;
     }
 
-    st->duration = sc->track_end = pts;
+    // Once the fragment index is complete, a sidx read out of order must
+    // not shorten the stream.
+    if (!c->frag_index.complete || st->duration < pts)
+        st->duration = pts;
+    sc->track_end = pts;
 
     sc->has_sidx = 1;
 
@@ -8894,9 +9294,9 @@ static void mov_read_chapters(AVFormatContext *s)
 
         if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             st->disposition |= AV_DISPOSITION_ATTACHED_PIC | AV_DISPOSITION_TIMED_THUMBNAILS;
-            if (!st->attached_pic.data && sti->nb_index_entries) {
+            if (!st->attached_pic.data && mov_nb_samples(st)) {
                 // Retrieve the first frame, if possible
-                AVIndexEntry *sample = &sti->index_entries[0];
+                AVIndexEntry *sample = mov_get_sample(st, 0);
                 if (avio_seek(sc->pb, sample->pos, SEEK_SET) != sample->pos) {
                     av_log(s, AV_LOG_ERROR, "Failed to retrieve first frame\n");
                     goto finish;
@@ -8909,6 +9309,8 @@ static void mov_read_chapters(AVFormatContext *s)
             st->codecpar->codec_type = AVMEDIA_TYPE_DATA;
             st->codecpar->codec_id = AV_CODEC_ID_BIN_DATA;
             st->discard = AVDISCARD_ALL;
+            if (mov_expand_compact_index(st) < 0)
+                goto finish;
             for (int i = 0; i < sti->nb_index_entries; i++) {
                 AVIndexEntry *sample = &sti->index_entries[i];
                 int64_t end = i+1 < sti->nb_index_entries ? sti->index_entries[i+1].timestamp : st->duration;
@@ -9099,6 +9501,7 @@ static void mov_free_stream_context(AVFormatContext *s, AVStream *st)
     av_freep(&sc->open_key_samples);
     av_freep(&sc->display_matrix);
     av_freep(&sc->index_ranges);
+    mov_free_compact_index(sc);
 
     if (sc->extradata)
         for (int i = 0; i < sc->stsd_count; i++)
@@ -9304,6 +9707,140 @@ fail:
     return ret;
 }
 
+/**
+ * Read a box header at the current position of pb. On success a->size is
+ * set to the size of the box payload, which must end before end.
+ */
+static int scan_box_header(AVIOContext *pb, int64_t end, MOVAtom *a)
+{
+    int64_t pos = avio_tell(pb);
+    int64_t size = avio_rb32(pb), header = 8;
+
+    a->type = avio_rl32(pb);
+    if (size == 1) {
+        size   = avio_rb64(pb);
+        header = 16;
+    } else if (!size) {
+        size = end - pos;
+    }
+    if (avio_feof(pb) || size < header || size > end - pos)
+        return AVERROR_INVALIDDATA;
+    a->size = size - header;
+    return 0;
+}
+
+static int scan_traf(MOVContext *c, AVIOContext *pb, int index, int64_t end)
+{
+    MOVFragmentStreamInfo *frag_stream_info = NULL;
+    int64_t dts = AV_NOPTS_VALUE;
+    MOVAtom a;
+    int ret;
+
+    while (avio_tell(pb) <= end - 8) {
+        int64_t next;
+
+        if ((ret = scan_box_header(pb, end, &a)) < 0)
+            return ret;
+        next = avio_tell(pb) + a.size;
+        if (a.type == MKTAG('t','f','h','d') && a.size >= 8) {
+            avio_rb32(pb); /* version and flags */
+            frag_stream_info = get_frag_stream_info(&c->frag_index, index,
+                                                    avio_rb32(pb));
+        } else if (a.type == MKTAG('t','f','d','t') && a.size >= 8) {
+            int version = avio_r8(pb);
+            avio_rb24(pb); /* flags */
+            if (version && a.size < 12)
+                return AVERROR_INVALIDDATA;
+            dts = version ? avio_rb64(pb) : avio_rb32(pb);
+        }
+        if ((ret = avio_seek(pb, next, SEEK_SET)) < 0)
+            return ret;
+    }
+
+    // Tracks not exposed as streams do not matter, all others need a tfdt
+    // for their fragments to be read out of order.
+    if (!frag_stream_info)
+        return 0;
+    if (dts == AV_NOPTS_VALUE)
+        return AVERROR_INVALIDDATA;
+    frag_stream_info->tfdt_dts = dts;
+    return 0;
+}
+
+static int scan_moof(MOVContext *c, AVIOContext *pb, int64_t moof_offset, int64_t end)
+{
+    MOVAtom a;
+    int index, ret;
+
+    index = update_frag_index(c, moof_offset);
+    if (index < 0)
+        return index == -1 ? AVERROR(ENOMEM) : index;
+
+    while (avio_tell(pb) <= end - 8) {
+        int64_t next;
+
+        if ((ret = scan_box_header(pb, end, &a)) < 0)
+            return ret;
+        next = avio_tell(pb) + a.size;
+        if (a.type == MKTAG('t','r','a','f') &&
+            (ret = scan_traf(c, pb, index, next)) < 0)
+            return ret;
+        if ((ret = avio_seek(pb, next, SEEK_SET)) < 0)
+            return ret;
+    }
+    return 0;
+}
+
+/**
+ * Add all fragments from offset to the end of the file to the fragment
+ * index, reading only box headers and the tfhd, tfdt and sidx boxes, and
+ * mark the index complete if every fragment could be timed.
+ */
+static int mov_scan_fragments(MOVContext *c, AVIOContext *pb, int64_t offset)
+{
+    int64_t stream_size = avio_size(pb);
+    int64_t original_pos = avio_tell(pb);
+    int64_t seek_ret;
+    int nb_moof = 0, ret = 0;
+
+    if (stream_size <= 0)
+        return 0;
+
+    while (offset <= stream_size - 8) {
+        MOVAtom a;
+        int64_t next;
+
+        if ((seek_ret = avio_seek(pb, offset, SEEK_SET)) < 0) {
+            ret = seek_ret;
+            goto fail;
+        }
+        if ((ret = scan_box_header(pb, stream_size, &a)) < 0)
+            goto fail;
+        next = avio_tell(pb) + a.size;
+        if (a.type == MKTAG('m','o','o','f')) {
+            if ((ret = scan_moof(c, pb, offset, next)) < 0)
+                goto fail;
+            nb_moof++;
+        } else if (a.type == MKTAG('s','i','d','x') && !c->frag_index.complete) {
+            if ((ret = mov_read_sidx(c, pb, a)) < 0)
+                goto fail;
+        }
+        offset = next;
+    }
+
+    av_log(c->fc, AV_LOG_VERBOSE, "fragment index of %d fragments built "
+           "from box headers\n", nb_moof);
+    c->frag_index.complete = 1;
+fail:
+    seek_ret = avio_seek(pb, original_pos, SEEK_SET);
+    if (seek_ret < 0) {
+        av_log(c->fc, AV_LOG_ERROR,
+               "failed to seek back after scanning fragments\n");
+        ret = seek_ret;
+    }
+    return ret;
+}
+
 static int read_image_grid(AVFormatContext *s, const HEIFGrid *grid,
                            AVStreamGroupTileGrid *tile_grid)
 {
@@ -9537,6 +10074,37 @@ static int mov_parse_tiles(AVFormatContext *s)
     return 0;
 }
 
+/**
+ * Read the headers of the last fragment of a complete fragment index, so
+ * that the stream durations cover the whole file without reading the
+ * fragments in between.
+ */
+static int mov_read_last_fragment(AVFormatContext *s)
+{
+    MOVContext *mov = s->priv_data;
+    MOVFragment fragment = mov->fragment;
+    int64_t next_root_atom = mov->next_root_atom;
+    int64_t pos = avio_tell(s->pb);
+    int current = mov->frag_index.current;
+    int found_mdat = mov->found_mdat;
+    int last = mov->frag_index.nb_items - 1;
+    int ret;
+
+    if (last < 1 || mov->frag_index.item[last].headers_read)
+        return 0;
+
+    ret = mov_switch_root(s, -1, last);
+
+    mov->fragment           = fragment;
+    mov->next_root_atom     = next_root_atom;
+    mov->frag_index.current = current;
+    mov->found_mdat         = found_mdat;
+    if (avio_seek(s->pb, pos, SEEK_SET) < 0)
+        return AVERROR_INVALIDDATA;
+
+    return ret == AVERROR_EOF ? 0 : FFMIN(ret, 0);
+}
+
 static int mov_read_header(AVFormatContext *s)
 {
     MOVContext *mov = s->priv_data;
@@ -9578,6 +10146,12 @@ static int mov_read_header(AVFormatContext *s)
     }
     av_log(mov->fc, AV_LOG_TRACE, "on_parse_exit_offset=%"PRId64"\n", avio_tell(pb));
 
+    if (mov->frag_index_scan && mov->frag_index.complete &&
+        (pb->seekable & AVIO_SEEKABLE_NORMAL)) {
+        if ((err = mov_read_last_fragment(s)) < 0)
+            return err;
+    }
+
     if (mov->found_iloc && mov->found_iinf) {
         for (i = 0; i < mov->nb_heif_item; i++) {
             HEIFItem *item = &mov->heif_item[i];
@@ -9816,10 +10390,9 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     int no_interleave = !mov->interleaved_read || !(s->pb->seekable & AVIO_SEEKABLE_NORMAL);
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
-        FFStream *const avsti = ffstream(avst);
         MOVStreamContext *msc = avst->priv_data;
-        if (msc->pb && msc->current_sample < avsti->nb_index_entries) {
-            AVIndexEntry *current_sample = &avsti->index_entries[msc->current_sample];
+        if (msc->pb && msc->current_sample < mov_nb_samples(avst)) {
+            AVIndexEntry *current_sample = mov_get_sample(avst, msc->current_sample);
             int64_t dts = av_rescale(current_sample->timestamp, AV_TIME_BASE, msc->time_scale);
             uint64_t dtsdiff = best_dts > dts ? best_dts - (uint64_t)dts : ((uint64_t)dts - best_dts);
             av_log(s, AV_LOG_TRACE, "stream %d, sample %d, dts %"PRId64"\n", i, msc->current_sample, dts);
@@ -9865,7 +10438,6 @@ static int mov_switch_root(AVFormatContext *s, int64_t target, int index)
             mov->next_root_atom = mov->frag_index.item[index + 1].moof_offset;
         if (mov->frag_index.item[index].headers_read)
             return 0;
-        mov->frag_index.item[index].headers_read = 1;
     }
 
     mov->found_mdat = 0;
@@ -9945,8 +10517,8 @@ static int mov_finalize_packet(AVFormatContext *s, AVStream *st, AVIndexEntry *s
             sc->ctts_sample = 0;
         }
     } else {
-        int64_t next_dts = (sc->current_sample < ffstream(st)->nb_index_entries) ?
-            ffstream(st)->index_entries[sc->current_sample].timestamp : st->duration;
+        int64_t next_dts = (sc->current_sample < mov_nb_samples(st)) ?
+            mov_get_sample(st, sc->current_sample)->timestamp : st->duration;
 
         if (next_dts >= pkt->dts)
             pkt->duration = next_dts - pkt->dts;
@@ -9987,7 +10559,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVContext *mov = s->priv_data;
     MOVStreamContext *sc;
-    AVIndexEntry *sample;
+    AVIndexEntry *sample, compact_sample;
     AVStream *st = NULL;
     int64_t current_index;
     int ret;
@@ -10002,6 +10574,11 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         goto retry;
     }
     sc = st->priv_data;
+    if (sc->compact) {
+        /* the entry is reused when the next sample of the track is resolved */
+        compact_sample = *sample;
+        sample = &compact_sample;
+    }
     /* must be done just before reading, to avoid infinite loop on sample */
     current_index = sc->current_index;
     mov_current_sample_inc(sc);
@@ -10107,10 +10684,56 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     return 0;
 }
 
-static int mov_seek_fragment(AVFormatContext *s, AVStream *st, int64_t timestamp)
+/**
+ * Read the headers of a fragment if needed.
+ *
+ * @return 1 and the timestamp of the first sample of st in the fragment
+ *         that can be seeked to with flags, or INT64_MAX if there is none,
+ *         0 if st has no samples in it, < 0 on error
+ */
+static int mov_read_fragment_headers(AVFormatContext *s, AVStream *st, int index,
+                                     int flags, int64_t *timestamp)
 {
     MOVContext *mov = s->priv_data;
-    int index;
+    MOVStreamContext *sc = st->priv_data;
+    MOVFragmentStreamInfo *frag_stream_info, *next;
+    int first, end, i, ret;
+
+    if (!mov->frag_index.item[index].headers_read &&
+        (ret = mov_switch_root(s, -1, index)) < 0)
+        return ret;
+
+    frag_stream_info = get_frag_stream_info(&mov->frag_index, index, sc->id);
+    if (!frag_stream_info || frag_stream_info->index_entry < 0 ||
+        frag_stream_info->index_entry >= mov_nb_samples(st))
+        return 0;
+
+    first = frag_stream_info->index_entry;
+    end   = mov_nb_samples(st);
+    for (i = index + 1; i < mov->frag_index.nb_items; i++) {
+        next = get_frag_stream_info(&mov->frag_index, i, sc->id);
+        if (next && next->index_entry > first) {
+            end = FFMIN(end, next->index_entry);
+            break;
+        }
+    }
+
+    *timestamp = INT64_MAX;
+    for (i = first; i < end; i++) {
+        const AVIndexEntry *sample = mov_get_sample(st, i);
+        if ((flags & AVSEEK_FLAG_ANY) || (sample->flags & AVINDEX_KEYFRAME)) {
+            *timestamp = sample->timestamp;
+            break;
+        }
+    }
+    return 1;
+}
+
+static int mov_seek_fragment(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
+{
+    MOVContext *mov = s->priv_data;
+    int64_t frag_timestamp;
+    int index, i, missing, ret;
 
     if (!mov->frag_index.complete)
         return 0;
@@ -10118,10 +10741,46 @@ static int mov_seek_fragment(AVFormatContext *s, AVStream *st, int64_t timestamp
     index = search_frag_timestamp(s, &mov->frag_index, st, timestamp);
     if (index < 0)
         index = 0;
-    if (!mov->frag_index.item[index].headers_read)
-        return mov_switch_root(s, -1, index);
-    if (index + 1 < mov->frag_index.nb_items)
-        mov->next_root_atom = mov->frag_index.item[index + 1].moof_offset;
+
+    // The fragment time may be the one of another stream, and fragments
+    // need not start with a keyframe, so step back while this stream is
+    // missing from the fragment or has no keyframe before the timestamp in
+    // it. Streams missing from more fragments in a row than there are
+    // streams are assumed not to be fragmented.
+    for (missing = 0; index >= 0; index--) {
+        ret = mov_read_fragment_headers(s, st, index, flags, &frag_timestamp);
+        if (ret < 0)
+            return ret;
+        if (ret ? frag_timestamp <= timestamp : ++missing > s->nb_streams)
+            break;
+        if (ret)
+            missing = 0;
+    }
+    index = FFMAX(index, 0);
+
+    // The fragment times may be presentation times, so a later fragment can
+    // still hold a closer keyframe, and a forward seek may land on the first
+    // keyframe of a following fragment of this stream. Read on until a
+    // keyframe after the timestamp is indexed.
+    for (i = index + 1, missing = 0; i < mov->frag_index.nb_items; i++) {
+        ret = mov_read_fragment_headers(s, st, i, flags, &frag_timestamp);
+        if (ret < 0)
+            return ret;
+        if (!ret) {
+            if (++missing > s->nb_streams)
+                break;
+            continue;
+        }
+        missing = 0;
+        if (frag_timestamp != INT64_MAX) {
+            if (frag_timestamp > timestamp)
+                break;
+            index = i;
+        }
+    }
+
+    mov->next_root_atom = index + 1 < mov->frag_index.nb_items ?
+                          mov->frag_index.item[index + 1].moof_offset : 0;
 
     return 0;
 }
@@ -10146,7 +10805,6 @@ static int is_open_key_sample(const MOVStreamContext *sc, int sample)
 static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pts)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int64_t key_sample_dts, key_sample_pts;
 
     if (st->codecpar->codec_id != AV_CODEC_ID_HEVC)
@@ -10155,7 +10813,7 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     if (sample >= sc->sample_offsets_count)
         return 1;
 
-    key_sample_dts = sti->index_entries[sample].timestamp;
+    key_sample_dts = mov_get_sample(st, sample)->timestamp;
     key_sample_pts = key_sample_dts + sc->sample_offsets[sample] + sc->dts_shift;
 
     /*
@@ -10169,10 +10827,49 @@ static int can_seek_to_key_sample(AVStream *st, int sample, int64_t requested_pt
     return 1;
 }
 
+/**
+ * av_index_search_timestamp() for tracks with a compact index too.
+ */
+static int mov_search_timestamp(AVStream *st, int64_t wanted_timestamp, int flags)
+{
+    MOVStreamContext *sc = st->priv_data;
+    unsigned int stts_index, stts_sample;
+    int a, b, m, nb_samples;
+
+    if (!sc->compact)
+        return av_index_search_timestamp(st, wanted_timestamp, flags);
+
+    /* same search as ff_index_search_timestamp(), no sample is discarded */
+    nb_samples = sc->compact->nb_samples;
+    a = -1;
+    b = nb_samples;
+    if (compact_sample_dts(sc, b - 1, &stts_index, &stts_sample) < wanted_timestamp)
+        a = b - 1;
+
+    while (b - a > 1) {
+        int64_t timestamp;
+
+        m = (a + b) >> 1;
+        timestamp = compact_sample_dts(sc, m, &stts_index, &stts_sample);
+        if (timestamp >= wanted_timestamp)
+            b = m;
+        if (timestamp <= wanted_timestamp)
+            a = m;
+    }
+    m = (flags & AVSEEK_FLAG_BACKWARD) ? a : b;
+
+    if (!(flags & AVSEEK_FLAG_ANY))
+        while (m >= 0 && m < nb_samples && !compact_is_keyframe(st, sc, m))
+            m += (flags & AVSEEK_FLAG_BACKWARD) ? -1 : 1;
+
+    if (m == nb_samples)
+        return -1;
+    return m;
+}
+
 static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp, int flags)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
     int sample, time_sample, ret;
     unsigned int i;
 
@@ -10180,14 +10877,14 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     // can search over the DTS timeline.
     timestamp -= (sc->min_corrected_pts + sc->dts_shift);
 
-    ret = mov_seek_fragment(s, st, timestamp);
+    ret = mov_seek_fragment(s, st, timestamp, flags);
     if (ret < 0)
         return ret;
 
     for (;;) {
-        sample = av_index_search_timestamp(st, timestamp, flags);
+        sample = mov_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
-        if (sample < 0 && sti->nb_index_entries && timestamp < sti->index_entries[0].timestamp)
+        if (sample < 0 && mov_nb_samples(st) && timestamp < mov_get_sample(st, 0)->timestamp)
             sample = 0;
         if (sample < 0) /* not sure what to do */
             return AVERROR_INVALIDDATA;
@@ -10234,9 +10931,8 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
 static int64_t mov_get_skip_samples(AVStream *st, int sample)
 {
     MOVStreamContext *sc = st->priv_data;
-    FFStream *const sti = ffstream(st);
-    int64_t first_ts = sti->index_entries[0].timestamp;
-    int64_t ts = sti->index_entries[sample].timestamp;
+    int64_t first_ts = mov_get_sample(st, 0)->timestamp;
+    int64_t ts = mov_get_sample(st, sample)->timestamp;
     int64_t off;
 
     if (st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
@@ -10254,20 +10950,29 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
     AVStream *st;
     FFStream *sti;
     int sample;
-    int i;
+    int i, pass;
 
     if (stream_index >= s->nb_streams)
         return AVERROR_INVALIDDATA;
 
     st = s->streams[stream_index];
     sti = ffstream(st);
-    sample = mov_seek_stream(s, st, sample_time, flags);
-    if (sample < 0)
-        return sample;
 
-    if (mc->seek_individually) {
+    /* The fragments read for one stream may be inserted before the samples
+     * found for the streams seeked earlier, so with a fragment index the
+     * seek is repeated once all of them are indexed. */
+    for (pass = 0; pass < 1 + (mc->seek_individually && mc->frag_index.complete); pass++) {
+        int64_t seek_timestamp;
+
+        sample = mov_seek_stream(s, st, sample_time, flags);
+        if (sample < 0)
+            return sample;
+
+        if (!mc->seek_individually)
+            break;
+
         /* adjust seek timestamp to found sample timestamp */
-        int64_t seek_timestamp = sti->index_entries[sample].timestamp;
+        seek_timestamp = mov_get_sample(st, sample)->timestamp;
         sti->skip_samples = mov_get_skip_samples(st, sample);
 
         for (i = 0; i < s->nb_streams; i++) {
@@ -10283,7 +10988,9 @@ static int mov_read_seek(AVFormatContext *s, int stream_index, int64_t sample_ti
             if (sample >= 0)
                 sti->skip_samples = mov_get_skip_samples(st, sample);
         }
-    } else {
+    }
+
+    if (!mc->seek_individually) {
         for (i = 0; i < s->nb_streams; i++) {
             MOVStreamContext *sc;
             st = s->streams[i];
@@ -10355,6 +11062,8 @@ static const AVOption mov_options[] = {
         {.i64 = 0}, 0, 1, FLAGS },
     { "max_stts_delta", "treat offsets above this value as invalid", OFFSET(max_stts_delta), AV_OPT_TYPE_INT, {.i64 = UINT_MAX-48000*10 }, 0, UINT_MAX, .flags = AV_OPT_FLAG_DECODING_PARAM },
     { "interleaved_read", "Interleave packets from multiple tracks at demuxer level", OFFSET(interleaved_read), AV_OPT_TYPE_BOOL, {.i64 = 1 }, 0, 1, .flags = AV_OPT_FLAG_DECODING_PARAM },
+    { "compact_index", "Resolve samples from the sample tables instead of building a full index", OFFSET(compact_index), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, .flags = AV_OPT_FLAG_DECODING_PARAM },
+    { "frag_index_scan", "Build the complete fragment index when the first fragment is found", OFFSET(frag_index_scan), AV_OPT_TYPE_BOOL, {.i64 = 0 }, 0, 1, .flags = AV_OPT_FLAG_DECODING_PARAM },
 
     { NULL },
 };
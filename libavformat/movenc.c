@@ -23,6 +23,7 @@
 
 #include "config_components.h"
 
+#include <fcntl.h>
 #include <stdint.h>
 #include <inttypes.h>
 
@@ -57,22 +58,33 @@
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/random_seed.h"
 #include "libavutil/stereo3d.h"
 #include "libavutil/timecode.h"
 #include "libavutil/dovi_meta.h"
+#include "libavutil/file_open.h"
 #include "libavutil/uuid.h"
 #include "hevc.h"
 #include "rtpenc.h"
 #include "nal.h"
 #include "mov_chan.h"
+#include "os_support.h"
 #include "movenc_ttml.h"
 #include "mux.h"
 #include "rawutils.h"
 #include "ttmlenc.h"
+#include "url.h"
 #include "version.h"
 #include "vpcc.h"
 #include "vvc.h"
 
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_IO_H
+#include <io.h>
+#endif
+
 static const AVOption options[] = {
     { "brand",    "Override major brand", offsetof(MOVMuxContext, major_brand),   AV_OPT_TYPE_STRING, {.str = NULL}, .flags = AV_OPT_FLAG_ENCODING_PARAM },
     { "empty_hdlr_name", "write zero-length name string in hdlr atoms within mdia and minf atoms", offsetof(MOVMuxContext, empty_hdlr_name), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
@@ -94,6 +106,7 @@ static const AVOption options[] = {
       { "disable_chpl", "Disable Nero chapter atom", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_DISABLE_CHPL}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "empty_moov", "Make the initial moov atom empty", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_EMPTY_MOOV}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "faststart", "Run a second pass to put the index (moov atom) at the beginning of the file", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FASTSTART}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
+      { "faststart_spool", "Write the media data to a temporary file and output it after the index (moov atom), also for non-seekable output", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FASTSTART_SPOOL}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "frag_custom", "Flush fragments on caller requests", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_CUSTOM}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "frag_discont", "Signal that the next fragment is discontinuous from earlier ones", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_DISCONT}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
       { "frag_every_frame", "Fragment at every frame", 0, AV_OPT_TYPE_CONST, {.i64 = FF_MOV_FLAG_FRAG_EVERY_FRAME}, INT_MIN, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM, .unit = "movflags" },
@@ -117,6 +130,7 @@ static const AVOption options[] = {
     { "movie_timescale", "set movie timescale", offsetof(MOVMuxContext, movie_timescale), AV_OPT_TYPE_INT, {.i64 = MOV_TIMESCALE}, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
     FF_RTP_FLAG_OPTS(MOVMuxContext, rtp_flags),
     { "skip_iods", "Skip writing iods atom.", offsetof(MOVMuxContext, iods_skip), AV_OPT_TYPE_BOOL, {.i64 = 1}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
+    { "spool_dir", "Directory for the faststart_spool temporary file", offsetof(MOVMuxContext, spool_dir), AV_OPT_TYPE_STRING, {.str = NULL}, .flags = AV_OPT_FLAG_ENCODING_PARAM },
     { "use_editlist", "use edit list", offsetof(MOVMuxContext, use_editlist), AV_OPT_TYPE_BOOL, {.i64 = -1}, -1, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "use_stream_ids_as_track_ids", "use stream ids as track ids", offsetof(MOVMuxContext, use_stream_ids_as_track_ids), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM},
     { "video_track_timescale", "set timescale of all video tracks", offsetof(MOVMuxContext, video_track_timescale), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM},
@@ -6505,7 +6519,7 @@ static int check_pkt(AVFormatContext *s, MOVTrack *trk, AVPacket *pkt)
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt)
 {
     MOVMuxContext *mov = s->priv_data;
-    AVIOContext *pb = s->pb;
+    AVIOContext *pb = mov->spool_pb ? mov->spool_pb : s->pb;
     MOVTrack *trk;
     AVCodecParameters *par;
     AVProducerReferenceTime *prft;
@@ -7393,6 +7407,45 @@ static void enable_tracks(AVFormatContext *s)
     }
 }
 
+/**
+ * Create an empty file for faststart_spool, in spool_dir if set or in
+ * the usual temporary directory otherwise.
+ */
+static int mov_create_spool_file(AVFormatContext *s)
+{
+    MOVMuxContext *mov = s->priv_data;
+    int fd = -1;
+
+    if (!mov->spool_dir) {
+        fd = avpriv_tempfile("ffmovspool", &mov->spool_filename, 0, s);
+        if (fd < 0)
+            return fd;
+        close(fd);
+        return 0;
+    }
+
+    /* retry a few names in case another muxer picked the same one */
+    for (int i = 0; i < 16 && fd < 0; i++) {
+        av_freep(&mov->spool_filename);
+        mov->spool_filename = av_asprintf("%s/ffmovspool%08"PRIx32,
+                                          mov->spool_dir, av_get_random_seed());
+        if (!mov->spool_filename)
+            return AVERROR(ENOMEM);
+        fd = avpriv_open(mov->spool_filename, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0 && errno != EEXIST)
+            break;
+    }
+    if (fd < 0) {
+        int err = AVERROR(errno);
+        av_log(s, AV_LOG_ERROR, "Cannot create spool file %s: %s\n",
+               mov->spool_filename, av_err2str(err));
+        av_freep(&mov->spool_filename);
+        return err;
+    }
+    close(fd);
+    return 0;
+}
+
 static void mov_free(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
@@ -7400,6 +7453,12 @@ static void mov_free(AVFormatContext *s)
     for (int i = 0; i < s->nb_streams; i++)
         s->streams[i]->priv_data = NULL;
 
+    if (mov->spool_filename) {
+        avio_closep(&mov->spool_pb);
+        ffurl_delete(mov->spool_filename);
+        av_freep(&mov->spool_filename);
+    }
+
     if (!mov->tracks)
         return;
 
@@ -7648,6 +7707,16 @@ static int mov_init(AVFormatContext *s)
         mov->flags &= ~FF_MOV_FLAG_SKIP_SIDX;
     }
 
+    if (mov->flags & FF_MOV_FLAG_FASTSTART_SPOOL) {
+        if (mov->flags & FF_MOV_FLAG_FRAGMENT || mov->mode == MODE_AVIF) {
+            av_log(s, AV_LOG_ERROR,
+                   "faststart_spool is not supported with fragmented or AVIF output\n");
+            return AVERROR(EINVAL);
+        }
+        mov->flags &= ~FF_MOV_FLAG_FASTSTART;
+        mov->reserved_moov_size = 0;
+    }
+
     if (mov->flags & FF_MOV_FLAG_FASTSTART) {
         mov->reserved_moov_size = -1;
     }
@@ -7698,12 +7767,23 @@ static int mov_init(AVFormatContext *s)
     /* Non-seekable output is ok if using fragmentation. If ism_lookahead
      * is enabled, we don't support non-seekable output at all. */
     if (!(s->pb->seekable & AVIO_SEEKABLE_NORMAL) &&
-        (!(mov->flags & FF_MOV_FLAG_FRAGMENT) || mov->ism_lookahead ||
-         mov->mode == MODE_AVIF)) {
+        (!(mov->flags & (FF_MOV_FLAG_FRAGMENT | FF_MOV_FLAG_FASTSTART_SPOOL)) ||
+         mov->ism_lookahead || mov->mode == MODE_AVIF)) {
         av_log(s, AV_LOG_ERROR, "muxer does not support non seekable output\n");
         return AVERROR(EINVAL);
     }
 
+    if (mov->flags & FF_MOV_FLAG_FASTSTART_SPOOL) {
+        if ((ret = mov_create_spool_file(s)) < 0)
+            return ret;
+        ret = avio_open(&mov->spool_pb, mov->spool_filename, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            av_log(s, AV_LOG_ERROR, "Cannot open spool file %s\n",
+                   mov->spool_filename);
+            return ret;
+        }
+    }
+
     /* AVIF output must have at most two video streams (one for YUV and one for
      * alpha). */
     if (mov->mode == MODE_AVIF) {
@@ -8164,7 +8244,7 @@ static int mov_write_header(AVFormatContext *s)
     } else if (mov->mode != MODE_AVIF) {
         if (mov->flags & FF_MOV_FLAG_FASTSTART)
             mov->reserved_header_pos = avio_tell(pb);
-        mov_write_mdat_tag(pb, mov);
+        mov_write_mdat_tag(mov->spool_pb ? mov->spool_pb : pb, mov);
     }
 
     ff_parse_creation_time_metadata(s, &mov->time, 1);
@@ -8311,10 +8391,60 @@ static int shift_data(AVFormatContext *s)
     return ff_format_shift_data(s, mov->reserved_header_pos, moov_size);
 }
 
+#define SPOOL_COPY_SIZE (1 << 20)
+
+/**
+ * Write the moov atom to the output, followed by the first size bytes of
+ * the spool file (the mdat).
+ */
+static int mov_write_spooled(AVFormatContext *s, int64_t size)
+{
+    MOVMuxContext *mov = s->priv_data;
+    AVIOContext *spool = NULL;
+    uint8_t *buf = NULL;
+    int i, ret;
+
+    if ((ret = avio_closep(&mov->spool_pb)) < 0)
+        return ret;
+
+    for (i = 0; i < mov->nb_tracks; i++)
+        mov->tracks[i].data_offset += avio_tell(s->pb);
+    if ((ret = compute_moov_size(s)) < 0)
+        return ret;
+    if ((ret = mov_write_moov_tag(s->pb, mov, s)) < 0)
+        return ret;
+
+    av_log(s, AV_LOG_VERBOSE, "Copying %"PRId64" bytes of spooled media data\n", size);
+    ret = avio_open(&spool, mov->spool_filename, AVIO_FLAG_READ);
+    if (ret < 0)
+        return ret;
+    buf = av_malloc(SPOOL_COPY_SIZE);
+    if (!buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    while (size > 0) {
+        ret = avio_read(spool, buf, FFMIN(size, SPOOL_COPY_SIZE));
+        if (ret <= 0) {
+            av_log(s, AV_LOG_ERROR, "Short read from spool file %s\n",
+                   mov->spool_filename);
+            ret = ret < 0 ? ret : AVERROR(EIO);
+            goto end;
+        }
+        avio_write(s->pb, buf, ret);
+        size -= ret;
+    }
+    ret = s->pb->error;
+end:
+    av_free(buf);
+    avio_close(spool);
+    return ret;
+}
+
 static int mov_write_trailer(AVFormatContext *s)
 {
     MOVMuxContext *mov = s->priv_data;
-    AVIOContext *pb = s->pb;
+    AVIOContext *pb = mov->spool_pb ? mov->spool_pb : s->pb;
     int res = 0;
     int i;
     int64_t moov_pos;
@@ -8403,7 +8533,11 @@ static int mov_write_trailer(AVFormatContext *s)
         }
         avio_seek(pb, mov->reserved_moov_size > 0 ? mov->reserved_header_pos : moov_pos, SEEK_SET);
 
-        if (mov->flags & FF_MOV_FLAG_FASTSTART) {
+        if (mov->spool_pb) {
+            res = mov_write_spooled(s, moov_pos);
+            if (res < 0)
+                return res;
+        } else if (mov->flags & FF_MOV_FLAG_FASTSTART) {
             av_log(s, AV_LOG_INFO, "Starting second pass: moving the moov atom to the beginning of the file\n");
             res = shift_data(s);
             if (res < 0)
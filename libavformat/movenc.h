@@ -223,6 +223,10 @@ typedef struct MOVMuxContext {
     int reserved_moov_size; ///< 0 for disabled, -1 for automatic, size otherwise
     int64_t reserved_header_pos;
 
+    AVIOContext *spool_pb;  ///< side file holding the mdat with faststart_spool
+    char *spool_filename;
+    char *spool_dir;
+
     char *major_brand;
 
     int per_stream_grouping;
@@ -284,6 +288,7 @@ typedef struct MOVMuxContext {
 #define FF_MOV_FLAG_CMAF                  (1 << 22)
 #define FF_MOV_FLAG_PREFER_ICC            (1 << 23)
 #define FF_MOV_FLAG_HYBRID_FRAGMENTED     (1 << 24)
+#define FF_MOV_FLAG_FASTSTART_SPOOL       (1 << 25)
 
 int ff_mov_write_packet(AVFormatContext *s, AVPacket *pkt);
 
@@ -62,6 +62,9 @@
 #define PROBE_PACKET_MAX_BUF 8192
 #define PROBE_PACKET_MARGIN 5
 
+/* maximum number of packets whose sync bytes are checked in one go */
+#define PACKET_RUN_MAX 256
+
 enum MpegTSFilterType {
     MPEGTS_PES,
     MPEGTS_SECTION,
@@ -2975,12 +2978,41 @@ static void finished_reading_packet(AVFormatContext *s, int raw_packet_size)
         avio_skip(pb, skip);
 }
 
+/**
+ * Find the packets at the current position that can be handled in place,
+ * in the memory mapping of the input if there is one, or else in the IO
+ * buffer. The sync bytes of the whole run are checked at once.
+ *
+ * @param mapped set to whether the run is in the memory mapping
+ * @return the number of complete packets starting with a sync byte at *run
+ */
+static int packet_run(AVIOContext *pb, int raw_packet_size,
+                      const uint8_t **run, int *mapped)
+{
+    int size = ffio_peek_mapped(pb, run);
+    int nb_packets, i;
+
+    *mapped = size >= 0;
+    if (!*mapped) {
+        *run = pb->buf_ptr;
+        size = pb->write_flag ? 0 : pb->buf_end - pb->buf_ptr;
+    }
+
+    nb_packets = FFMIN(size / raw_packet_size, PACKET_RUN_MAX);
+    for (i = 0; i < nb_packets; i++)
+        if ((*run)[i * raw_packet_size] != 0x47)
+            break;
+    return i;
+}
+
 static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
 {
     AVFormatContext *s = ts->stream;
+    AVIOContext *pb = s->pb;
     uint8_t packet[TS_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE];
-    const uint8_t *data;
+    const uint8_t *data, *run = NULL;
     int64_t packet_num;
+    int nb_run = 0, run_mapped = 0, mapped_size = 0;
     int ret = 0;
 
     if (avio_tell(s->pb) != ts->last_pos) {
@@ -3016,6 +3048,37 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ts->stop_parse > 0)
             break;
 
+        /* Packets are handled in place where possible, which saves copying
+         * them and reading them one by one. Nothing called from
+         * handle_packet() touches the IO context. */
+        if (!nb_run) {
+            if (mapped_size) {
+                ret = ffio_skip_mapped(pb, mapped_size);
+                mapped_size = 0;
+                if (ret < 0)
+                    break;
+            }
+            nb_run = packet_run(pb, ts->raw_packet_size, &run, &run_mapped);
+        }
+        if (nb_run) {
+            int64_t pos;
+
+            data = run;
+            run += ts->raw_packet_size;
+            nb_run--;
+            if (run_mapped) {
+                mapped_size += ts->raw_packet_size;
+                pos = avio_tell(pb) + mapped_size;
+            } else {
+                pb->buf_ptr += ts->raw_packet_size;
+                pos = avio_tell(pb);
+            }
+            ret = handle_packet(ts, data, pos - ts->raw_packet_size + TS_PACKET_SIZE);
+            if (ret != 0)
+                break;
+            continue;
+        }
+
         ret = read_packet(s, packet, ts->raw_packet_size, &data);
         if (ret != 0)
             break;
@@ -3024,6 +3087,11 @@ static int handle_packets(MpegTSContext *ts, int64_t nb_packets)
         if (ret != 0)
             break;
     }
+    if (mapped_size) {
+        int err = ffio_skip_mapped(pb, mapped_size);
+        if (err < 0)
+            ret = err;
+    }
     ts->last_pos = avio_tell(s->pb);
     return ret;
 }
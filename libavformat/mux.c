@@ -767,7 +767,8 @@ static int write_packet(AVFormatContext *s, AVPacket *pkt)
     }
 
     if (s->pb && ret >= 0) {
-        flush_if_needed(s);
+        if (!si->in_write_batch)
+            flush_if_needed(s);
         if (s->pb->error < 0)
             ret = s->pb->error;
     }
@@ -1292,6 +1293,32 @@ int av_interleaved_write_frame(AVFormatContext *s, AVPacket *pkt)
     }
 }
 
+int av_interleaved_write_frames(AVFormatContext *s, AVPacket **pkts, int nb_pkts)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    int i, ret = 0;
+
+    if (nb_pkts < 0)
+        return AVERROR(EINVAL);
+
+    si->in_write_batch = 1;
+    for (i = 0; i < nb_pkts && ret >= 0; i++) {
+        ret = write_packets_common(s, pkts[i], 1/*interleaved*/);
+        if (ret < 0)
+            av_packet_unref(pkts[i]);
+    }
+    for (; i < nb_pkts; i++)
+        av_packet_unref(pkts[i]);
+    si->in_write_batch = 0;
+
+    if (s->pb) {
+        flush_if_needed(s);
+        if (ret >= 0 && s->pb->error < 0)
+            ret = s->pb->error;
+    }
+    return ret;
+}
+
 int av_write_trailer(AVFormatContext *s)
 {
     FFFormatContext *const si = ffformatcontext(s);
@@ -0,0 +1,544 @@
+/*
+ * Parallel ranged input protocol
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ * Based on libavformat/cache.c and libavformat/async.c
+ */
+
+/**
+ * @file
+ * Split a seekable resource of known size into fixed size chunks and fetch
+ * the chunks ahead of the read position over several connections at once.
+ * Every connection is a separate instance of the inner protocol, so with
+ * http(s) each worker owns its own FFmpegOkhttp object.
+ *
+ * Chunks are kept in an AVTreeNode index keyed by their offset, like the
+ * cache protocol does for its ranges, and handed out in order through the
+ * normal url_read/url_seek interface.
+ */
+
+#include "libavutil/avassert.h"
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/tree.h"
+#include "url.h"
+
+#define MAX_CONNECTIONS 16
+
+typedef struct RangeChunk {
+    int64_t offset;
+    uint8_t *data;
+    int size;
+    int ready;
+    int error;
+    /* removed from the index while still being fetched, the worker frees it */
+    int abandoned;
+} RangeChunk;
+
+typedef struct ParallelWorker {
+    URLContext *h;
+    URLContext *inner;
+    int64_t inner_pos;
+    pthread_t thread;
+    int thread_started;
+} ParallelWorker;
+
+typedef struct ParallelContext {
+    AVClass *class;
+    char *url;
+    AVDictionary *inner_opts;
+    int inner_flags;
+
+    /* single stream fallback when the resource size is unknown */
+    URLContext *inner;
+
+    struct AVTreeNode *root;
+    int64_t logical_pos;
+    int64_t logical_size;
+    int64_t fetch_pos;
+    int nb_chunks;
+
+    ParallelWorker workers[MAX_CONNECTIONS];
+    int nb_workers;
+
+    int abort_request;
+    AVIOInterruptCB interrupt_callback;
+
+    pthread_cond_t cond_wakeup_main;
+    pthread_cond_t cond_wakeup_background;
+    pthread_mutex_t mutex;
+
+    int64_t chunk_hit, chunk_wait;
+
+    /* options */
+    int connections;
+    int chunk_size;
+    int window;
+} ParallelContext;
+
+static int cmp(const void *key, const void *node)
+{
+    return FFDIFFSIGN(*(const int64_t *)key, ((const RangeChunk *) node)->offset);
+}
+
+static int parallel_check_interrupt(void *arg)
+{
+    URLContext *h      = arg;
+    ParallelContext *c = h->priv_data;
+
+    if (c->abort_request)
+        return 1;
+
+    if (ff_check_interrupt(&c->interrupt_callback))
+        c->abort_request = 1;
+
+    return c->abort_request;
+}
+
+static void chunk_free(RangeChunk *chunk)
+{
+    if (chunk) {
+        av_free(chunk->data);
+        av_free(chunk);
+    }
+}
+
+static void chunk_remove(ParallelContext *c, RangeChunk *chunk)
+{
+    struct AVTreeNode *node = NULL;
+
+    av_tree_insert(&c->root, chunk, cmp, &node);
+    av_free(node);
+    c->nb_chunks--;
+
+    if (chunk->ready)
+        chunk_free(chunk);
+    else
+        chunk->abandoned = 1;
+}
+
+typedef struct EvictState {
+    ParallelContext *c;
+    RangeChunk *stale[128];
+    int nb_stale;
+} EvictState;
+
+static int enu_stale(void *opaque, void *elem)
+{
+    EvictState *s      = opaque;
+    ParallelContext *c = s->c;
+    RangeChunk *chunk  = elem;
+    int64_t cur        = c->logical_pos - c->logical_pos % c->chunk_size;
+
+    /* keep the previous chunk around for short backward seeks */
+    if ((chunk->offset < cur - c->chunk_size ||
+         chunk->offset >= cur + (int64_t)c->window * c->chunk_size) &&
+        s->nb_stale < FF_ARRAY_ELEMS(s->stale))
+        s->stale[s->nb_stale++] = chunk;
+
+    return 0;
+}
+
+/* must be called with the mutex held */
+static void evict_stale_chunks(ParallelContext *c)
+{
+    EvictState s = { .c = c };
+
+    av_tree_enumerate(c->root, &s, NULL, enu_stale);
+    for (int i = 0; i < s.nb_stale; i++)
+        chunk_remove(c, s.stale[i]);
+}
+
+/* must be called with the mutex held, returns NULL if there is nothing to fetch */
+static RangeChunk *schedule_chunk(ParallelContext *c)
+{
+    int64_t cur = c->logical_pos - c->logical_pos % c->chunk_size;
+    int64_t end = FFMIN(c->logical_size, cur + (int64_t)c->window * c->chunk_size);
+    struct AVTreeNode *node;
+    RangeChunk *chunk;
+
+    if (c->fetch_pos < cur || c->fetch_pos > end)
+        c->fetch_pos = cur;
+
+    while (c->fetch_pos < end &&
+           av_tree_find(c->root, &c->fetch_pos, cmp, NULL))
+        c->fetch_pos += c->chunk_size;
+
+    if (c->fetch_pos >= end || c->nb_chunks >= c->window + 1)
+        return NULL;
+
+    chunk = av_mallocz(sizeof(*chunk));
+    node  = av_tree_node_alloc();
+    if (chunk)
+        chunk->data = av_malloc(c->chunk_size);
+    if (!chunk || !node || !chunk->data) {
+        chunk_free(chunk);
+        av_free(node);
+        return NULL;
+    }
+
+    chunk->offset = c->fetch_pos;
+    chunk->size   = FFMIN(c->chunk_size, c->logical_size - c->fetch_pos);
+    av_tree_insert(&c->root, chunk, cmp, &node);
+    c->nb_chunks++;
+    c->fetch_pos += c->chunk_size;
+
+    return chunk;
+}
+
+static int worker_open(ParallelWorker *w)
+{
+    URLContext *h      = w->h;
+    ParallelContext *c = h->priv_data;
+    AVIOInterruptCB interrupt_callback = { .callback = parallel_check_interrupt, .opaque = h };
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_dict_copy(&opts, c->inner_opts, 0);
+    ret = ffurl_open_whitelist(&w->inner, c->url, c->inner_flags, &interrupt_callback,
+                               &opts, h->protocol_whitelist, h->protocol_blacklist, h);
+    av_dict_free(&opts);
+    w->inner_pos = 0;
+
+    return ret;
+}
+
+static int worker_fetch(ParallelWorker *w, RangeChunk *chunk)
+{
+    int64_t r;
+    int pos = 0;
+
+    if (w->inner_pos != chunk->offset) {
+        r = ffurl_seek(w->inner, chunk->offset, SEEK_SET);
+        if (r < 0)
+            return r;
+        w->inner_pos = r;
+    }
+
+    while (pos < chunk->size) {
+        r = ffurl_read(w->inner, chunk->data + pos, chunk->size - pos);
+        if (r == AVERROR_EOF)
+            break;
+        if (r < 0)
+            return r;
+        pos          += r;
+        w->inner_pos += r;
+    }
+
+    chunk->size = pos;
+
+    return 0;
+}
+
+static void *parallel_worker_task(void *arg)
+{
+    ParallelWorker *w  = arg;
+    URLContext *h      = w->h;
+    ParallelContext *c = h->priv_data;
+    RangeChunk *chunk;
+    int ret;
+
+    ff_thread_setname("parallel");
+
+    pthread_mutex_lock(&c->mutex);
+    while (!parallel_check_interrupt(h)) {
+        chunk = schedule_chunk(c);
+        if (!chunk) {
+            pthread_cond_wait(&c->cond_wakeup_background, &c->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&c->mutex);
+
+        if (!w->inner && (ret = worker_open(w)) < 0) {
+            /* let the connections that did open pick the chunk up again */
+            av_log(h, AV_LOG_WARNING, "Failed to open an additional connection: %s\n",
+                   av_err2str(ret));
+            pthread_mutex_lock(&c->mutex);
+            if (!chunk->abandoned)
+                chunk_remove(c, chunk);
+            chunk_free(chunk);
+            break;
+        }
+
+        ret = worker_fetch(w, chunk);
+
+        pthread_mutex_lock(&c->mutex);
+        if (chunk->abandoned) {
+            chunk_free(chunk);
+        } else {
+            chunk->error = ret;
+            chunk->ready = 1;
+        }
+        pthread_cond_broadcast(&c->cond_wakeup_main);
+    }
+    pthread_cond_broadcast(&c->cond_wakeup_main);
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+static int parallel_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
+{
+    ParallelContext *c = h->priv_data;
+    AVIOInterruptCB interrupt_callback = { .callback = parallel_check_interrupt, .opaque = h };
+    int ret;
+
+    av_strstart(arg, "parallel:", &arg);
+
+    c->url = av_strdup(arg);
+    if (!c->url)
+        return AVERROR(ENOMEM);
+    if (options)
+        av_dict_copy(&c->inner_opts, *options, 0);
+    c->inner_flags        = flags;
+    c->interrupt_callback = h->interrupt_callback;
+
+    /* the first connection tells whether ranged fetching is possible at all */
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &interrupt_callback,
+                               options, h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0)
+        goto fail;
+
+    c->logical_size = ffurl_size(c->inner);
+    h->is_streamed  = c->inner->is_streamed;
+
+    if (c->inner->is_streamed || c->logical_size <= 0) {
+        av_log(h, AV_LOG_VERBOSE, "Resource is not seekable, using a single connection\n");
+        return 0;
+    }
+
+    ret = pthread_mutex_init(&c->mutex, NULL);
+    if (ret != 0) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    ret = pthread_cond_init(&c->cond_wakeup_main, NULL);
+    if (ret != 0) {
+        ret = AVERROR(ret);
+        goto cond_wakeup_main_fail;
+    }
+
+    ret = pthread_cond_init(&c->cond_wakeup_background, NULL);
+    if (ret != 0) {
+        ret = AVERROR(ret);
+        goto cond_wakeup_background_fail;
+    }
+
+    c->window = FFMAX(c->window, c->connections);
+
+    /* worker 0 takes over the probing connection */
+    c->workers[0].inner = c->inner;
+    c->inner            = NULL;
+
+    for (int i = 0; i < c->connections; i++) {
+        ParallelWorker *w = &c->workers[i];
+
+        w->h = h;
+        ret = pthread_create(&w->thread, NULL, parallel_worker_task, w);
+        if (ret) {
+            ret = AVERROR(ret);
+            av_log(h, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(ret));
+            break;
+        }
+        w->thread_started = 1;
+        c->nb_workers++;
+    }
+
+    if (!c->nb_workers)
+        goto thread_fail;
+
+    return 0;
+
+thread_fail:
+    ffurl_closep(&c->workers[0].inner);
+    pthread_cond_destroy(&c->cond_wakeup_background);
+cond_wakeup_background_fail:
+    pthread_cond_destroy(&c->cond_wakeup_main);
+cond_wakeup_main_fail:
+    pthread_mutex_destroy(&c->mutex);
+fail:
+    ffurl_closep(&c->inner);
+    av_dict_free(&c->inner_opts);
+    av_freep(&c->url);
+    return ret;
+}
+
+static int enu_free(void *opaque, void *elem)
+{
+    RangeChunk *chunk = elem;
+
+    if (chunk->ready)
+        chunk_free(chunk);
+    else
+        chunk->abandoned = 1;
+    return 0;
+}
+
+static int parallel_close(URLContext *h)
+{
+    ParallelContext *c = h->priv_data;
+
+    if (c->nb_workers) {
+        pthread_mutex_lock(&c->mutex);
+        c->abort_request = 1;
+        pthread_cond_broadcast(&c->cond_wakeup_background);
+        pthread_mutex_unlock(&c->mutex);
+
+        for (int i = 0; i < MAX_CONNECTIONS; i++) {
+            ParallelWorker *w = &c->workers[i];
+            if (w->thread_started)
+                pthread_join(w->thread, NULL);
+            ffurl_closep(&w->inner);
+        }
+
+        av_log(h, AV_LOG_VERBOSE, "Statistics, chunk hits:%"PRId64" chunk waits:%"PRId64"\n",
+               c->chunk_hit, c->chunk_wait);
+
+        av_tree_enumerate(c->root, NULL, NULL, enu_free);
+        av_tree_destroy(c->root);
+        pthread_cond_destroy(&c->cond_wakeup_background);
+        pthread_cond_destroy(&c->cond_wakeup_main);
+        pthread_mutex_destroy(&c->mutex);
+    }
+
+    ffurl_closep(&c->inner);
+    av_dict_free(&c->inner_opts);
+    av_freep(&c->url);
+
+    return 0;
+}
+
+static int parallel_read(URLContext *h, unsigned char *buf, int size)
+{
+    ParallelContext *c = h->priv_data;
+    int64_t cur;
+    RangeChunk *chunk;
+    int waited = 0;
+    int ret;
+
+    if (!c->nb_workers)
+        return ffurl_read(c->inner, buf, size);
+
+    if (c->logical_pos >= c->logical_size)
+        return AVERROR_EOF;
+
+    cur = c->logical_pos - c->logical_pos % c->chunk_size;
+
+    pthread_mutex_lock(&c->mutex);
+    while (1) {
+        if (parallel_check_interrupt(h)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+
+        chunk = av_tree_find(c->root, &cur, cmp, NULL);
+        if (chunk && chunk->ready) {
+            int in_chunk_pos = c->logical_pos - chunk->offset;
+
+            if (chunk->error < 0) {
+                ret = chunk->error;
+                chunk_remove(c, chunk);
+            } else if (in_chunk_pos >= chunk->size) {
+                ret = AVERROR_EOF;
+            } else {
+                ret = FFMIN(size, chunk->size - in_chunk_pos);
+                memcpy(buf, chunk->data + in_chunk_pos, ret);
+                c->logical_pos += ret;
+            }
+            break;
+        }
+
+        waited = 1;
+        pthread_cond_broadcast(&c->cond_wakeup_background);
+        pthread_cond_wait(&c->cond_wakeup_main, &c->mutex);
+    }
+
+    if (waited)
+        c->chunk_wait++;
+    else
+        c->chunk_hit++;
+
+    evict_stale_chunks(c);
+    pthread_cond_broadcast(&c->cond_wakeup_background);
+    pthread_mutex_unlock(&c->mutex);
+
+    return ret;
+}
+
+static int64_t parallel_seek(URLContext *h, int64_t pos, int whence)
+{
+    ParallelContext *c = h->priv_data;
+
+    if (!c->nb_workers)
+        return ffurl_seek(c->inner, pos, whence);
+
+    if (whence == AVSEEK_SIZE)
+        return c->logical_size;
+    else if (whence == SEEK_CUR)
+        pos += c->logical_pos;
+    else if (whence == SEEK_END)
+        pos += c->logical_size;
+    else if (whence != SEEK_SET)
+        return AVERROR(EINVAL);
+
+    if (pos < 0 || pos > c->logical_size)
+        return AVERROR(EINVAL);
+
+    /* chunks are rescheduled around the new position on the next read */
+    pthread_mutex_lock(&c->mutex);
+    c->logical_pos = pos;
+    evict_stale_chunks(c);
+    pthread_cond_broadcast(&c->cond_wakeup_background);
+    pthread_mutex_unlock(&c->mutex);
+
+    return pos;
+}
+
+#define OFFSET(x) offsetof(ParallelContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+
+static const AVOption options[] = {
+    { "connections", "Number of concurrent connections", OFFSET(connections), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, MAX_CONNECTIONS, D },
+    { "chunk_size", "Size in bytes of the range fetched per request", OFFSET(chunk_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, INT_MAX, D },
+    { "window", "Number of chunks fetched ahead of the read position", OFFSET(window), AV_OPT_TYPE_INT, { .i64 = 8 }, 1, 64, D },
+    {NULL},
+};
+
+#undef D
+#undef OFFSET
+
+static const AVClass parallel_context_class = {
+    .class_name = "parallel",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+const URLProtocol ff_parallel_protocol = {
+    .name                = "parallel",
+    .url_open2           = parallel_open,
+    .url_read            = parallel_read,
+    .url_seek            = parallel_seek,
+    .url_close           = parallel_close,
+    .priv_data_size      = sizeof(ParallelContext),
+    .priv_data_class     = &parallel_context_class,
+};
@@ -0,0 +1,686 @@
+/*
+ * Probe result cache
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Cache of the results of input format probing and stream analysis.
+ *
+ * An entry is keyed by the SHA-1 of the URL, the input size, the options
+ * affecting probing and the first HEADER_SIZE bytes of the input. Entries
+ * are kept in a process wide table with probe_cache=memory, or as one file
+ * per entry in the probe_cache directory. Both hold the same serialization:
+ *
+ *   "FFPROBE1", key, be32 size of the rest
+ *   be32 probe score, be32 name length, input format name
+ *   be64 start time, duration, bit rate, be32 duration estimation method
+ *   be32 number of streams, per stream:
+ *     be32 id, disposition, codec_info_nb_frames
+ *     time base, average and real frame rate, sample aspect ratio
+ *     be64 start time, duration, number of frames
+ *     codec parameters, see write_codecpar()
+ *
+ * with every rational stored as be32 num, be32 den.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#if HAVE_IO_H
+#include <io.h>
+#endif
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+
+#include "libavutil/bprint.h"
+#include "libavutil/file_open.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "libavutil/sha.h"
+#include "libavutil/thread.h"
+#include "libavcodec/bytestream.h"
+#include "avformat.h"
+#include "avio_internal.h"
+#include "demux.h"
+#include "internal.h"
+#include "os_support.h"
+#include "probecache.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define CACHE_MAGIC "FFPROBE1"
+#define CACHE_SUFFIX ".probe"
+#define KEY_HASH_SIZE 20
+#define PREFIX_SIZE (8 + KEY_HASH_SIZE + 4)
+#define HEADER_SIZE 65536
+#define MEMORY_ENTRIES 32
+
+typedef struct ProbeCacheState {
+    uint8_t key[KEY_HASH_SIZE];
+    char *filename;     ///< entry file, NULL with the memory cache
+    uint8_t *blob;      ///< serialized entry for key, NULL on a miss
+    int blob_size;
+    int applied;        ///< stream analysis was replaced by the entry
+} ProbeCacheState;
+
+typedef struct MemoryEntry {
+    uint8_t key[KEY_HASH_SIZE];
+    uint8_t *blob;
+    int blob_size;
+    uint64_t last_use;
+} MemoryEntry;
+
+static AVMutex memory_lock = AV_MUTEX_INITIALIZER;
+static MemoryEntry memory_cache[MEMORY_ENTRIES];
+static uint64_t memory_clock;
+
+typedef struct CachedStream {
+    int id, disposition, codec_info_nb_frames;
+    AVRational time_base, avg_frame_rate, r_frame_rate, sample_aspect_ratio;
+    int64_t start_time, duration, nb_frames;
+    AVCodecParameters *par;
+} CachedStream;
+
+static int use_memory(const AVFormatContext *s)
+{
+    return !strcmp(s->probe_cache, "memory");
+}
+
+static void put_be32(AVBPrint *bp, uint32_t v)
+{
+    uint8_t b[4];
+    AV_WB32(b, v);
+    av_bprint_append_data(bp, b, 4);
+}
+
+static void put_be64(AVBPrint *bp, uint64_t v)
+{
+    uint8_t b[8];
+    AV_WB64(b, v);
+    av_bprint_append_data(bp, b, 8);
+}
+
+static void put_rational(AVBPrint *bp, AVRational q)
+{
+    put_be32(bp, q.num);
+    put_be32(bp, q.den);
+}
+
+static AVRational get_rational(GetByteContext *gb)
+{
+    AVRational q;
+    q.num = bytestream2_get_be32(gb);
+    q.den = bytestream2_get_be32(gb);
+    return q;
+}
+
+static void sha_update_be64(struct AVSHA *sha, uint64_t v)
+{
+    uint8_t b[8];
+    AV_WB64(b, v);
+    av_sha_update(sha, b, 8);
+}
+
+static int compute_key(AVFormatContext *s, uint8_t *key)
+{
+    AVIOContext *pb = s->pb;
+    int64_t pos = avio_tell(pb);
+    struct AVSHA *sha = av_sha_alloc();
+    uint8_t *buf = av_malloc(HEADER_SIZE);
+    int64_t seek_ret;
+    int len, ret;
+
+    if (!sha || !buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = ffio_ensure_seekback(pb, HEADER_SIZE);
+    if (ret < 0)
+        goto end;
+    len = avio_read(pb, buf, HEADER_SIZE);
+    seek_ret = avio_seek(pb, pos, SEEK_SET);
+    if (seek_ret < 0) {
+        ret = seek_ret;
+        goto end;
+    }
+    if (len < 0 && len != AVERROR_EOF) {
+        ret = len;
+        goto end;
+    }
+
+    av_sha_init(sha, 8 * KEY_HASH_SIZE);
+    av_sha_update(sha, s->url, strlen(s->url) + 1);
+    sha_update_be64(sha, avio_size(pb));
+    sha_update_be64(sha, s->probesize);
+    sha_update_be64(sha, s->max_analyze_duration);
+    sha_update_be64(sha, s->fps_probe_size);
+    sha_update_be64(sha, s->format_probesize);
+    sha_update_be64(sha, s->skip_initial_bytes);
+    av_sha_update(sha, buf, FFMAX(len, 0));
+    av_sha_final(sha, key);
+    ret = 0;
+end:
+    av_free(sha);
+    av_free(buf);
+    return ret;
+}
+
+static void memory_load(ProbeCacheState *pc)
+{
+    ff_mutex_lock(&memory_lock);
+    for (int i = 0; i < MEMORY_ENTRIES; i++) {
+        MemoryEntry *e = &memory_cache[i];
+        if (e->blob && !memcmp(e->key, pc->key, KEY_HASH_SIZE)) {
+            pc->blob = av_memdup(e->blob, e->blob_size);
+            if (pc->blob)
+                pc->blob_size = e->blob_size;
+            e->last_use = ++memory_clock;
+            break;
+        }
+    }
+    ff_mutex_unlock(&memory_lock);
+}
+
+static void memory_store(ProbeCacheState *pc, uint8_t *blob, int size)
+{
+    MemoryEntry *e = NULL;
+
+    ff_mutex_lock(&memory_lock);
+    for (int i = 0; i < MEMORY_ENTRIES && !e; i++)
+        if (memory_cache[i].blob && !memcmp(memory_cache[i].key, pc->key, KEY_HASH_SIZE))
+            e = &memory_cache[i];
+    for (int i = 0; i < MEMORY_ENTRIES && !e; i++)
+        if (!memory_cache[i].blob)
+            e = &memory_cache[i];
+    if (!e) {
+        e = &memory_cache[0];
+        for (int i = 1; i < MEMORY_ENTRIES; i++)
+            if (memory_cache[i].last_use < e->last_use)
+                e = &memory_cache[i];
+    }
+    av_free(e->blob);
+    memcpy(e->key, pc->key, KEY_HASH_SIZE);
+    e->blob      = blob;
+    e->blob_size = size;
+    e->last_use  = ++memory_clock;
+    ff_mutex_unlock(&memory_lock);
+}
+
+static void file_load(ProbeCacheState *pc)
+{
+    struct stat st;
+    int fd = avpriv_open(pc->filename, O_RDONLY | O_BINARY);
+
+    if (fd < 0)
+        return;
+    if (!fstat(fd, &st) && st.st_size >= PREFIX_SIZE && st.st_size <= INT_MAX &&
+        (pc->blob = av_malloc(st.st_size))) {
+        if (read(fd, pc->blob, st.st_size) == st.st_size)
+            pc->blob_size = st.st_size;
+        else
+            av_freep(&pc->blob);
+    }
+    close(fd);
+}
+
+static int file_store(ProbeCacheState *pc, const uint8_t *blob, int size)
+{
+    char *tmp = av_asprintf("%s.tmp", pc->filename);
+    int fd, ret = 0;
+
+    if (!tmp)
+        return AVERROR(ENOMEM);
+
+    /* replace the entry atomically, a reader never sees a partial one */
+    fd = avpriv_open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (fd < 0) {
+        ret = AVERROR(errno);
+    } else {
+        if (write(fd, blob, size) != size)
+            ret = AVERROR(EIO);
+        if (close(fd) < 0 && !ret)
+            ret = AVERROR(errno);
+    }
+    if (!ret && rename(tmp, pc->filename) < 0) {
+        /* rename() does not replace existing files everywhere */
+        unlink(pc->filename);
+        if (rename(tmp, pc->filename) < 0)
+            ret = AVERROR(errno);
+    }
+    if (ret < 0)
+        unlink(tmp);
+    av_free(tmp);
+    return ret;
+}
+
+/**
+ * Check the prefix of the entry and read the input format fields.
+ */
+static int read_entry_header(GetByteContext *gb, const ProbeCacheState *pc,
+                             int *score, char *name, int name_size)
+{
+    unsigned size;
+    int len;
+
+    if (bytestream2_get_bytes_left(gb) < PREFIX_SIZE ||
+        memcmp(gb->buffer, CACHE_MAGIC, 8) ||
+        memcmp(gb->buffer + 8, pc->key, KEY_HASH_SIZE))
+        return AVERROR_INVALIDDATA;
+    bytestream2_skip(gb, 8 + KEY_HASH_SIZE);
+    size = bytestream2_get_be32(gb);
+    if (size != bytestream2_get_bytes_left(gb))
+        return AVERROR_INVALIDDATA;
+
+    *score = bytestream2_get_be32(gb);
+    len    = bytestream2_get_be32(gb);
+    if (len <= 0 || len >= name_size || bytestream2_get_bytes_left(gb) < len)
+        return AVERROR_INVALIDDATA;
+    bytestream2_get_bufferu(gb, name, len);
+    name[len] = 0;
+    return 0;
+}
+
+static const AVInputFormat *find_demuxer(const char *name)
+{
+    const AVInputFormat *fmt;
+    void *i = NULL;
+
+    while ((fmt = av_demuxer_iterate(&i)))
+        if (!strcmp(fmt->name, name))
+            return fmt;
+    return NULL;
+}
+
+int ff_probe_cache_lookup(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    ProbeCacheState *pc;
+    const AVInputFormat *fmt;
+    GetByteContext gb;
+    char name[64];
+    int score, ret;
+
+    if (!s->probe_cache || !*s->probe_cache || !s->pb || si->probe_cache)
+        return 0;
+
+    pc = av_mallocz(sizeof(*pc));
+    if (!pc)
+        return AVERROR(ENOMEM);
+    si->probe_cache = pc;
+
+    ret = compute_key(s, pc->key);
+    if (ret < 0)
+        return ret;
+
+    if (use_memory(s)) {
+        memory_load(pc);
+    } else {
+        char hex[2 * KEY_HASH_SIZE + 1];
+
+        ff_data_to_hex(hex, pc->key, KEY_HASH_SIZE, 1);
+        hex[2 * KEY_HASH_SIZE] = 0;
+        pc->filename = av_asprintf("%s/%s"CACHE_SUFFIX, s->probe_cache, hex);
+        if (!pc->filename)
+            return AVERROR(ENOMEM);
+        file_load(pc);
+    }
+    if (!pc->blob) {
+        av_log(s, AV_LOG_DEBUG, "Probe cache miss\n");
+        return 0;
+    }
+
+    bytestream2_init(&gb, pc->blob, pc->blob_size);
+    if (read_entry_header(&gb, pc, &score, name, sizeof(name)) < 0 ||
+        !(fmt = find_demuxer(name)) || (s->iformat && s->iformat != fmt)) {
+        av_log(s, AV_LOG_VERBOSE, "Discarding unusable probe cache entry\n");
+        av_freep(&pc->blob);
+        return 0;
+    }
+    if (s->iformat)
+        return 0;
+
+    av_log(s, AV_LOG_VERBOSE, "Input format %s from the probe cache\n", name);
+    s->iformat = fmt;
+    return score;
+}
+
+static void write_codecpar(AVBPrint *bp, const AVCodecParameters *par)
+{
+    const AVChannelLayout *ch = &par->ch_layout;
+    /* custom channel maps are not kept, only their channel count */
+    int order = ch->order == AV_CHANNEL_ORDER_CUSTOM ? AV_CHANNEL_ORDER_UNSPEC : ch->order;
+
+    put_be32(bp, par->codec_type);
+    put_be32(bp, par->codec_id);
+    put_be32(bp, par->codec_tag);
+    put_be32(bp, par->format);
+    put_be64(bp, par->bit_rate);
+    put_be32(bp, par->bits_per_coded_sample);
+    put_be32(bp, par->bits_per_raw_sample);
+    put_be32(bp, par->profile);
+    put_be32(bp, par->level);
+    put_be32(bp, par->width);
+    put_be32(bp, par->height);
+    put_rational(bp, par->sample_aspect_ratio);
+    put_rational(bp, par->framerate);
+    put_be32(bp, par->field_order);
+    put_be32(bp, par->color_range);
+    put_be32(bp, par->color_primaries);
+    put_be32(bp, par->color_trc);
+    put_be32(bp, par->color_space);
+    put_be32(bp, par->chroma_location);
+    put_be32(bp, par->video_delay);
+    put_be32(bp, order);
+    put_be32(bp, ch->nb_channels);
+    put_be64(bp, order == AV_CHANNEL_ORDER_UNSPEC ? 0 : ch->u.mask);
+    put_be32(bp, par->sample_rate);
+    put_be32(bp, par->block_align);
+    put_be32(bp, par->frame_size);
+    put_be32(bp, par->initial_padding);
+    put_be32(bp, par->trailing_padding);
+    put_be32(bp, par->seek_preroll);
+
+    put_be32(bp, par->extradata_size);
+    av_bprint_append_data(bp, par->extradata, par->extradata_size);
+    put_be32(bp, par->nb_coded_side_data);
+    for (int i = 0; i < par->nb_coded_side_data; i++) {
+        const AVPacketSideData *sd = &par->coded_side_data[i];
+        put_be32(bp, sd->type);
+        put_be32(bp, sd->size);
+        av_bprint_append_data(bp, sd->data, sd->size);
+    }
+}
+
+static int read_codecpar(GetByteContext *gb, AVCodecParameters *par)
+{
+    int order, nb_channels, size, nb_side_data;
+    uint64_t mask;
+
+    par->codec_type            = (int32_t)bytestream2_get_be32(gb);
+    par->codec_id              = bytestream2_get_be32(gb);
+    par->codec_tag             = bytestream2_get_be32(gb);
+    par->format                = (int32_t)bytestream2_get_be32(gb);
+    par->bit_rate              = bytestream2_get_be64(gb);
+    par->bits_per_coded_sample = bytestream2_get_be32(gb);
+    par->bits_per_raw_sample   = bytestream2_get_be32(gb);
+    par->profile               = (int32_t)bytestream2_get_be32(gb);
+    par->level                 = (int32_t)bytestream2_get_be32(gb);
+    par->width                 = bytestream2_get_be32(gb);
+    par->height                = bytestream2_get_be32(gb);
+    par->sample_aspect_ratio   = get_rational(gb);
+    par->framerate             = get_rational(gb);
+    par->field_order           = bytestream2_get_be32(gb);
+    par->color_range           = bytestream2_get_be32(gb);
+    par->color_primaries       = bytestream2_get_be32(gb);
+    par->color_trc             = bytestream2_get_be32(gb);
+    par->color_space           = bytestream2_get_be32(gb);
+    par->chroma_location       = bytestream2_get_be32(gb);
+    par->video_delay           = bytestream2_get_be32(gb);
+    order                      = bytestream2_get_be32(gb);
+    nb_channels                = bytestream2_get_be32(gb);
+    mask                       = bytestream2_get_be64(gb);
+    par->sample_rate           = bytestream2_get_be32(gb);
+    par->block_align           = bytestream2_get_be32(gb);
+    par->frame_size            = bytestream2_get_be32(gb);
+    par->initial_padding       = bytestream2_get_be32(gb);
+    par->trailing_padding      = bytestream2_get_be32(gb);
+    par->seek_preroll          = bytestream2_get_be32(gb);
+
+    if (nb_channels < 0)
+        return AVERROR_INVALIDDATA;
+    av_channel_layout_uninit(&par->ch_layout);
+    par->ch_layout.nb_channels = nb_channels;
+    switch (order) {
+    case AV_CHANNEL_ORDER_UNSPEC:
+        par->ch_layout.order  = AV_CHANNEL_ORDER_UNSPEC;
+        break;
+    case AV_CHANNEL_ORDER_NATIVE:
+    case AV_CHANNEL_ORDER_AMBISONIC:
+        par->ch_layout.order  = order;
+        par->ch_layout.u.mask = mask;
+        break;
+    default:
+        return AVERROR_INVALIDDATA;
+    }
+    if (nb_channels && !av_channel_layout_check(&par->ch_layout))
+        return AVERROR_INVALIDDATA;
+
+    size = bytestream2_get_be32(gb);
+    if (size < 0 || size > bytestream2_get_bytes_left(gb))
+        return AVERROR_INVALIDDATA;
+    if (size) {
+        par->extradata = av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!par->extradata)
+            return AVERROR(ENOMEM);
+        par->extradata_size = size;
+        bytestream2_get_bufferu(gb, par->extradata, size);
+    }
+
+    nb_side_data = bytestream2_get_be32(gb);
+    if (nb_side_data < 0 || nb_side_data > bytestream2_get_bytes_left(gb) / 8)
+        return AVERROR_INVALIDDATA;
+    for (int i = 0; i < nb_side_data; i++) {
+        int type = bytestream2_get_be32(gb);
+        AVPacketSideData *sd;
+
+        size = bytestream2_get_be32(gb);
+        if (type < 0 || type >= AV_PKT_DATA_NB ||
+            size < 0 || size > bytestream2_get_bytes_left(gb))
+            return AVERROR_INVALIDDATA;
+        sd = av_packet_side_data_new(&par->coded_side_data, &par->nb_coded_side_data,
+                                     type, size, 0);
+        if (!sd)
+            return AVERROR(ENOMEM);
+        bytestream2_get_bufferu(gb, sd->data, size);
+    }
+    return 0;
+}
+
+static void free_streams(CachedStream *cs, int nb_streams)
+{
+    for (int i = 0; i < nb_streams; i++)
+        avcodec_parameters_free(&cs[i].par);
+    av_free(cs);
+}
+
+int ff_probe_cache_apply(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    ProbeCacheState *const pc = si->probe_cache;
+    CachedStream *cs = NULL;
+    GetByteContext gb;
+    int64_t start_time, duration, bit_rate;
+    int duration_estimation_method, nb_streams = 0, score;
+    char name[64];
+    int ret = AVERROR_INVALIDDATA;
+
+    if (!pc || !pc->blob)
+        return 0;
+
+    bytestream2_init(&gb, pc->blob, pc->blob_size);
+    if (read_entry_header(&gb, pc, &score, name, sizeof(name)) < 0 ||
+        strcmp(name, s->iformat->name))
+        goto fail;
+    start_time                 = bytestream2_get_be64(&gb);
+    duration                   = bytestream2_get_be64(&gb);
+    bit_rate                   = bytestream2_get_be64(&gb);
+    duration_estimation_method = bytestream2_get_be32(&gb);
+    nb_streams                 = bytestream2_get_be32(&gb);
+    /* streams created later on, e.g. with AVFMTCTX_NOHEADER, cannot be
+     * recreated from the cache */
+    if (nb_streams != s->nb_streams) {
+        ret = 0;
+        goto fail;
+    }
+
+    cs = av_calloc(nb_streams, sizeof(*cs));
+    if (!cs) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (int i = 0; i < nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+        CachedStream *c = &cs[i];
+
+        c->id                   = bytestream2_get_be32(&gb);
+        c->disposition          = bytestream2_get_be32(&gb);
+        c->codec_info_nb_frames = bytestream2_get_be32(&gb);
+        c->time_base            = get_rational(&gb);
+        c->avg_frame_rate       = get_rational(&gb);
+        c->r_frame_rate         = get_rational(&gb);
+        c->sample_aspect_ratio  = get_rational(&gb);
+        c->start_time           = bytestream2_get_be64(&gb);
+        c->duration             = bytestream2_get_be64(&gb);
+        c->nb_frames            = bytestream2_get_be64(&gb);
+        if (!(c->par = avcodec_parameters_alloc())) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        if ((ret = read_codecpar(&gb, c->par)) < 0)
+            goto fail;
+
+        /* Analysis may refine the codec id, e.g. MPEG-1 to MPEG-2 video.
+         * A pending codec probe however must not have changed it when the
+         * entry was made, nor have started yet. */
+        if (c->id != st->id || av_cmp_q(c->time_base, st->time_base) ||
+            c->par->codec_type != st->codecpar->codec_type ||
+            (cffstream(st)->request_probe > 0 &&
+             (c->par->codec_id != st->codecpar->codec_id ||
+              cffstream(st)->probe_data.buf))) {
+            ret = 0;
+            goto fail;
+        }
+    }
+    if (bytestream2_get_bytes_left(&gb)) {
+        ret = AVERROR_INVALIDDATA;
+        goto fail;
+    }
+
+    for (int i = 0; i < nb_streams; i++) {
+        AVStream *const st  = s->streams[i];
+        FFStream *const sti = ffstream(st);
+        const CachedStream *c = &cs[i];
+
+        if ((ret = avcodec_parameters_copy(st->codecpar, c->par)) < 0)
+            goto fail;
+        st->disposition         = c->disposition;
+        st->avg_frame_rate      = c->avg_frame_rate;
+        st->r_frame_rate        = c->r_frame_rate;
+        st->sample_aspect_ratio = c->sample_aspect_ratio;
+        st->start_time          = c->start_time;
+        st->duration            = c->duration;
+        st->nb_frames           = c->nb_frames;
+        sti->codec_info_nb_frames = c->codec_info_nb_frames;
+        sti->need_context_update  = 1;
+        if (sti->request_probe > 0)
+            sti->request_probe = -1;
+    }
+    s->start_time                 = start_time;
+    s->duration                   = duration;
+    s->bit_rate                   = bit_rate;
+    s->duration_estimation_method = duration_estimation_method;
+
+    free_streams(cs, nb_streams);
+    pc->applied = 1;
+    av_log(s, AV_LOG_VERBOSE, "Stream parameters from the probe cache\n");
+    return 1;
+
+fail:
+    free_streams(cs, cs ? nb_streams : 0);
+    av_freep(&pc->blob);
+    av_log(s, AV_LOG_VERBOSE, "Probe cache entry does not match the input\n");
+    return ret == AVERROR(ENOMEM) ? ret : 0;
+}
+
+void ff_probe_cache_store(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    ProbeCacheState *const pc = si->probe_cache;
+    AVBPrint bp;
+    char *blob;
+    int ret;
+
+    if (!pc || pc->applied)
+        return;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprint_append_data(&bp, CACHE_MAGIC, 8);
+    av_bprint_append_data(&bp, pc->key, KEY_HASH_SIZE);
+    put_be32(&bp, 0);
+    put_be32(&bp, s->probe_score);
+    put_be32(&bp, strlen(s->iformat->name));
+    av_bprintf(&bp, "%s", s->iformat->name);
+    put_be64(&bp, s->start_time);
+    put_be64(&bp, s->duration);
+    put_be64(&bp, s->bit_rate);
+    put_be32(&bp, s->duration_estimation_method);
+    put_be32(&bp, s->nb_streams);
+    for (unsigned i = 0; i < s->nb_streams; i++) {
+        const AVStream *st = s->streams[i];
+
+        put_be32(&bp, st->id);
+        put_be32(&bp, st->disposition);
+        put_be32(&bp, cffstream(st)->codec_info_nb_frames);
+        put_rational(&bp, st->time_base);
+        put_rational(&bp, st->avg_frame_rate);
+        put_rational(&bp, st->r_frame_rate);
+        put_rational(&bp, st->sample_aspect_ratio);
+        put_be64(&bp, st->start_time);
+        put_be64(&bp, st->duration);
+        put_be64(&bp, st->nb_frames);
+        write_codecpar(&bp, st->codecpar);
+    }
+    if (!av_bprint_is_complete(&bp) || bp.len > INT_MAX) {
+        av_bprint_finalize(&bp, NULL);
+        return;
+    }
+    AV_WB32(bp.str + 8 + KEY_HASH_SIZE, bp.len - PREFIX_SIZE);
+
+    if (use_memory(s)) {
+        int size = bp.len;
+        if (av_bprint_finalize(&bp, &blob) >= 0)
+            memory_store(pc, (uint8_t *)blob, size);
+        return;
+    }
+
+    ret = file_store(pc, (uint8_t *)bp.str, bp.len);
+    if (ret < 0)
+        av_log(s, AV_LOG_WARNING, "Could not write probe cache entry %s: %s\n",
+               pc->filename, av_err2str(ret));
+    av_bprint_finalize(&bp, NULL);
+}
+
+void ff_probe_cache_free(AVFormatContext *s)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    ProbeCacheState *const pc = si->probe_cache;
+
+    if (!pc)
+        return;
+    av_free(pc->blob);
+    av_free(pc->filename);
+    av_freep(&si->probe_cache);
+}
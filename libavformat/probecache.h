@@ -0,0 +1,56 @@
+/*
+ * Probe result cache
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_PROBECACHE_H
+#define AVFORMAT_PROBECACHE_H
+
+#include "avformat.h"
+
+/**
+ * Look up the cached probe result for the input of s, see
+ * AVFormatContext.probe_cache. s->pb must be at the start of the input and
+ * is left there.
+ *
+ * On a hit, s->iformat is set to the cached input format unless the caller
+ * forced one, and the stream parameters are kept for
+ * ff_probe_cache_apply().
+ *
+ * @return the cached probe score if s->iformat was set, 0 otherwise
+ */
+int ff_probe_cache_lookup(AVFormatContext *s);
+
+/**
+ * Replace the results of stream analysis with the cached ones, if the
+ * streams created by the demuxer match the cached stream list.
+ *
+ * @return 1 if avformat_find_stream_info() can skip stream analysis,
+ *         0 if it has to run it, < 0 on error
+ */
+int ff_probe_cache_apply(AVFormatContext *s);
+
+/**
+ * Store the results of avformat_find_stream_info() for later opens of the
+ * same input. Does nothing if they were taken from the cache.
+ */
+void ff_probe_cache_store(AVFormatContext *s);
+
+void ff_probe_cache_free(AVFormatContext *s);
+
+#endif /* AVFORMAT_PROBECACHE_H */
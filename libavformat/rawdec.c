@@ -23,6 +23,7 @@
 #include "config_components.h"
 
 #include "avformat.h"
+#include "avio_internal.h"
 #include "demux.h"
 #include "internal.h"
 #include "rawdec.h"
@@ -37,6 +38,17 @@ int ff_raw_read_partial_packet(AVFormatContext *s, AVPacket *pkt)
 
     size = raw->raw_packet_size;
 
+    /* nothing writes to raw packets, so they can stay in the I/O buffer */
+    pkt->pos = avio_tell(s->pb);
+    ret = ffio_read_ref(s->pb, size, 1, &pkt->buf, &pkt->data);
+    if (ret != AVERROR(ENOSYS)) {
+        if (ret < 0)
+            return ret;
+        pkt->size = ret;
+        pkt->stream_index = 0;
+        return ret;
+    }
+
     if ((ret = av_new_packet(pkt, size)) < 0)
         return ret;
 
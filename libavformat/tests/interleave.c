@@ -0,0 +1,181 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Mux the same packets with av_interleaved_write_frame() and with
+ * av_interleaved_write_frames() in batches, and check that the output
+ * is identical while the batches are flushed less often.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/channel_layout.h"
+#include "libavutil/md5.h"
+#include "libavutil/mem.h"
+
+#include "libavformat/avformat.h"
+
+#define NB_VIDEO 30
+#define NB_AUDIO 50
+#define BATCH    8
+
+typedef struct Output {
+    struct AVMD5 *md5;
+    int writes;
+    uint8_t hash[16];
+} Output;
+
+static int write_cb(void *opaque, const uint8_t *buf, int size)
+{
+    Output *out = opaque;
+
+    av_md5_update(out->md5, buf, size);
+    out->writes++;
+    return size;
+}
+
+static int make_packet(AVPacket *pkt, int n)
+{
+    int video = n < NB_VIDEO, i = video ? n : n - NB_VIDEO;
+    int ret = av_new_packet(pkt, video ? 500 + 37 * i : 200 + i);
+
+    if (ret < 0)
+        return ret;
+    memset(pkt->data, n, pkt->size);
+    pkt->stream_index = !video;
+    pkt->duration     = video ? 1 : 1024;
+    pkt->pts          = pkt->dts = i * pkt->duration;
+    pkt->flags        = AV_PKT_FLAG_KEY;
+    return 0;
+}
+
+static int mux(Output *out, int batched)
+{
+    AVFormatContext *s = NULL;
+    AVPacket *pkts[BATCH] = { NULL };
+    uint8_t *iobuf = NULL;
+    int ret, n, i;
+
+    ret = avformat_alloc_output_context2(&s, NULL, "framecrc", NULL);
+    if (ret < 0)
+        return ret;
+    s->flags |= AVFMT_FLAG_BITEXACT;
+    for (i = 0; i < 2; i++) {
+        AVStream *st = avformat_new_stream(s, NULL);
+        if (!st) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        st->codecpar->codec_type = i ? AVMEDIA_TYPE_AUDIO : AVMEDIA_TYPE_VIDEO;
+        st->codecpar->codec_id   = i ? AV_CODEC_ID_AAC    : AV_CODEC_ID_MPEG4;
+        st->time_base            = i ? (AVRational){ 1, 44100 } : (AVRational){ 1, 25 };
+        if (i) {
+            st->codecpar->sample_rate = 44100;
+            av_channel_layout_default(&st->codecpar->ch_layout, 2);
+        } else {
+            st->codecpar->width  = 64;
+            st->codecpar->height = 48;
+        }
+    }
+    for (i = 0; i < BATCH; i++) {
+        if (!(pkts[i] = av_packet_alloc())) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    out->md5 = av_md5_alloc();
+    iobuf    = av_malloc(4096);
+    if (!out->md5 || !iobuf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    av_md5_init(out->md5);
+    s->pb = avio_alloc_context(iobuf, 4096, 1, out, NULL, write_cb, NULL);
+    if (!s->pb) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    iobuf = NULL;
+    s->flush_packets = 1;
+
+    if ((ret = avformat_write_header(s, NULL)) < 0)
+        goto end;
+
+    /* alternate between the streams, which is not dts order */
+    for (n = 0; n < NB_VIDEO + NB_AUDIO; n += BATCH) {
+        int nb = 0;
+
+        for (i = n; i < n + BATCH && i < NB_VIDEO + NB_AUDIO; i++) {
+            int idx = i >= 2 * NB_VIDEO ? i :
+                      i & 1             ? NB_VIDEO + i / 2 : i / 2;
+            if ((ret = make_packet(pkts[nb++], idx)) < 0)
+                goto end;
+        }
+        if (batched) {
+            ret = av_interleaved_write_frames(s, pkts, nb);
+        } else {
+            for (i = 0; i < nb && ret >= 0; i++)
+                ret = av_interleaved_write_frame(s, pkts[i]);
+        }
+        if (ret < 0)
+            goto end;
+    }
+
+    ret = av_write_trailer(s);
+    av_md5_final(out->md5, out->hash);
+
+end:
+    for (i = 0; i < BATCH; i++)
+        av_packet_free(&pkts[i]);
+    if (s->pb)
+        av_freep(&s->pb->buffer);
+    avio_context_free(&s->pb);
+    avformat_free_context(s);
+    av_freep(&out->md5);
+    av_free(iobuf);
+    return ret;
+}
+
+static void print_output(const char *name, const Output *out)
+{
+    printf("%-11s %3d writes, md5 ", name, out->writes);
+    for (int i = 0; i < 16; i++)
+        printf("%02x", out->hash[i]);
+    printf("\n");
+}
+
+int main(void)
+{
+    Output single = { 0 }, batched = { 0 };
+    int ret;
+
+    if ((ret = mux(&single, 0)) < 0 || (ret = mux(&batched, 1)) < 0) {
+        fprintf(stderr, "muxing failed: %s\n", av_err2str(ret));
+        return 1;
+    }
+
+    print_output("per packet:", &single);
+    print_output("batched:", &batched);
+
+    if (memcmp(single.hash, batched.hash, sizeof(single.hash)) ||
+        batched.writes >= single.writes)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/common.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavformat/avio.h"
+
+/* The chunks are fetched over file:, which checks the splitting, ordering
+ * and seeking logic but not ranged HTTP requests: the http protocol in
+ * this tree is JNI only and cannot be run here, so parallel:http is not
+ * covered by any test. */
+
+#define DATA_SIZE (1000 * 1000 + 123)
+
+static uint8_t *reference;
+
+static int write_reference(const char *path)
+{
+    AVIOContext *pb = NULL;
+    unsigned state = 1;
+    int ret;
+
+    reference = av_malloc(DATA_SIZE);
+    if (!reference)
+        return AVERROR(ENOMEM);
+    for (int i = 0; i < DATA_SIZE; i++) {
+        state = state * 1664525 + 1013904223;
+        reference[i] = state >> 24;
+    }
+
+    ret = avio_open(&pb, path, AVIO_FLAG_WRITE);
+    if (ret < 0)
+        return ret;
+    avio_write(pb, reference, DATA_SIZE);
+    return avio_closep(&pb);
+}
+
+static int check_read(AVIOContext *pb, int64_t pos, int size, uint8_t *buf)
+{
+    int ret;
+
+    if (avio_seek(pb, pos, SEEK_SET) != pos)
+        return -1;
+    ret = avio_read(pb, buf, size);
+    if (ret != FFMIN(size, DATA_SIZE - pos))
+        return -1;
+    return memcmp(buf, reference + pos, ret) ? -1 : 0;
+}
+
+static void test_parallel(const char *path, const char *connections,
+                          const char *chunk_size, const char *window)
+{
+    static const int64_t seeks[] = { 0, 500000, 499000, 999000, 4096, 1000100, 12345 };
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    char url[1024];
+    uint8_t *buf;
+    int64_t size, total = 0;
+    int ret, ok = 1;
+
+    buf = av_malloc(DATA_SIZE);
+    if (!buf)
+        return;
+
+    snprintf(url, sizeof(url), "parallel:file:%s", path);
+    av_dict_set(&opts, "connections", connections, 0);
+    av_dict_set(&opts, "chunk_size", chunk_size, 0);
+    av_dict_set(&opts, "window", window, 0);
+
+    ret = avio_open2(&pb, url, AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        printf("connections=%s chunk_size=%s window=%s: open failed: %s\n",
+               connections, chunk_size, window, av_err2str(ret));
+        av_free(buf);
+        return;
+    }
+
+    size = avio_size(pb);
+
+    /* sequential read in odd sized pieces */
+    while ((ret = avio_read(pb, buf + total, FFMIN(7777, DATA_SIZE - total))) > 0)
+        total += ret;
+    if (total != DATA_SIZE || memcmp(buf, reference, DATA_SIZE))
+        ok = 0;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(seeks); i++)
+        if (check_read(pb, seeks[i], 65536, buf) < 0)
+            ok = 0;
+
+    printf("connections=%s chunk_size=%s window=%s: size %"PRId64" read %"PRId64" %s\n",
+           connections, chunk_size, window, size, total, ok ? "ok" : "mismatch");
+
+    avio_closep(&pb);
+    av_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "parallel-test.data";
+    int ret;
+
+    ret = write_reference(path);
+    if (ret < 0) {
+        printf("could not write %s: %s\n", path, av_err2str(ret));
+        return 1;
+    }
+
+    test_parallel(path, "1", "4096",    "1");
+    test_parallel(path, "4", "65536",   "8");
+    test_parallel(path, "8", "10000",   "3");
+    test_parallel(path, "3", "1048576", "4");
+
+    av_free(reference);
+    remove(path);
+
+    return 0;
+}
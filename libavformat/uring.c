@@ -0,0 +1,631 @@
+/*
+ * io_uring file protocol
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Regular file access through a Linux io_uring, driven with the raw
+ * syscalls so no extra library is needed.
+ *
+ * Reading keeps up to depth block_size reads in flight ahead of the read
+ * position, in buffers registered with the ring. url_read only waits if the
+ * block it needs has not completed yet.
+ *
+ * Writing copies each block into a free buffer, submits it and returns
+ * without waiting, so a muxer only blocks when all buffers are still being
+ * written out. Completions are collected on later calls; a failed write is
+ * reported by the next write, seek or close. Seeking and closing wait for
+ * the queued writes, so overlapping writes never run concurrently.
+ */
+
+#define _GNU_SOURCE /* syscall(), MAP_POPULATE */
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/file_open.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "os_support.h"
+#include "url.h"
+
+enum URingSlotState {
+    SLOT_FREE,
+    SLOT_PENDING,
+    SLOT_DONE,
+    SLOT_STALE,   ///< dropped from the read queue while still in flight
+};
+
+typedef struct URingSlot {
+    enum URingSlotState state;
+    int64_t offset;
+    int size;         ///< bytes requested
+    int res;          ///< read: completion result
+    int pos;          ///< read: bytes consumed, write: bytes written
+} URingSlot;
+
+typedef struct URingContext {
+    const AVClass *class;
+    int depth;
+    int block_size;
+    int trunc;
+
+    int fd;
+    int ring_fd;
+    int write;
+    int fixed;        ///< buffers are registered with the ring
+
+    uint8_t *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+
+    uint8_t *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    uint8_t *buffers;
+    URingSlot *slots;
+    int inflight;
+
+    /* read queue: slots head .. head + queued - 1, in file order */
+    int head;
+    int queued;
+    int64_t next_offset;
+
+    int64_t pos;
+    int error;
+} URingContext;
+
+static int uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                       unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, const void *arg,
+                          unsigned nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* IORING_OP_READ and IORING_OP_WRITE came with kernel 5.6, later than
+ * the fixed buffer variants */
+static int op_supported(int ring_fd, int op)
+{
+    struct io_uring_probe *probe;
+    int ret;
+
+    probe = av_mallocz(sizeof(*probe) + 256 * sizeof(*probe->ops));
+    if (!probe)
+        return AVERROR(ENOMEM);
+    ret = uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) >= 0 &&
+          op <= probe->last_op && probe->ops[op].flags & IO_URING_OP_SUPPORTED;
+    av_free(probe);
+    return ret;
+}
+
+static unsigned load_acquire(const unsigned *p)
+{
+    unsigned v = *(const volatile unsigned *)p;
+    atomic_thread_fence(memory_order_acquire);
+    return v;
+}
+
+static void store_release(unsigned *p, unsigned v)
+{
+    atomic_thread_fence(memory_order_release);
+    *(volatile unsigned *)p = v;
+}
+
+static uint8_t *slot_data(URingContext *c, int i)
+{
+    return c->buffers + (size_t)i * c->block_size;
+}
+
+static int submit(URingContext *c)
+{
+    unsigned pending;
+
+    /* at most depth requests are in flight, so the completion queue
+     * of twice that size never overflows and submission cannot stall */
+    while ((pending = *c->sq_tail - load_acquire(c->sq_head))) {
+        int ret = uring_enter(c->ring_fd, pending, 0, 0);
+        if (ret < 0 && errno != EINTR)
+            return AVERROR(errno);
+    }
+    return 0;
+}
+
+static void queue_sqe(URingContext *c, int slot, int64_t offset, int size, int pos)
+{
+    unsigned tail = *c->sq_tail;
+    unsigned idx  = tail & *c->sq_mask;
+    struct io_uring_sqe *sqe = &c->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (c->fixed) {
+        sqe->opcode    = c->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = slot;
+    } else {
+        sqe->opcode    = c->write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd        = c->fd;
+    sqe->off       = offset + pos;
+    sqe->addr      = (uintptr_t)(slot_data(c, slot) + pos);
+    sqe->len       = size - pos;
+    sqe->user_data = slot;
+
+    c->sq_array[idx] = idx;
+    store_release(c->sq_tail, tail + 1);
+}
+
+static void complete(URingContext *c, int i, int res)
+{
+    URingSlot *s = &c->slots[i];
+
+    if (c->write) {
+        if (res > 0 && s->pos + res < s->size) {
+            /* short write, queue the rest */
+            s->pos += res;
+            queue_sqe(c, i, s->offset, s->size, s->pos);
+            return;
+        }
+        if (res <= 0 && !c->error)
+            c->error = res < 0 ? AVERROR(-res) : AVERROR(EIO);
+        s->state = SLOT_FREE;
+    } else {
+        s->res   = res;
+        s->state = s->state == SLOT_STALE ? SLOT_FREE : SLOT_DONE;
+    }
+    c->inflight--;
+}
+
+/**
+ * Process the available completions, waiting for at least one if wait is set.
+ */
+static int reap(URingContext *c, int wait)
+{
+    unsigned head = *c->cq_head;
+    unsigned tail = load_acquire(c->cq_tail);
+    int ret;
+
+    if (wait && head == tail) {
+        ret = uring_enter(c->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR)
+            return AVERROR(errno);
+        tail = load_acquire(c->cq_tail);
+    }
+
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &c->cqes[head & *c->cq_mask];
+        complete(c, cqe->user_data, cqe->res);
+    }
+    store_release(c->cq_head, head);
+
+    /* short writes may have queued new requests */
+    return submit(c);
+}
+
+static int drain(URingContext *c)
+{
+    while (c->inflight) {
+        int ret = reap(c, 1);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static int read_ahead(URingContext *c)
+{
+    int n = 0;
+
+    while (c->queued < c->depth) {
+        int i = (c->head + c->queued) % c->depth;
+        URingSlot *s = &c->slots[i];
+
+        if (s->state != SLOT_FREE)
+            break;
+        s->state  = SLOT_PENDING;
+        s->offset = c->next_offset;
+        s->size   = c->block_size;
+        s->pos    = 0;
+        queue_sqe(c, i, s->offset, s->size, 0);
+        c->next_offset += c->block_size;
+        c->queued++;
+        c->inflight++;
+        n++;
+    }
+    return n ? submit(c) : 0;
+}
+
+/**
+ * Drop the read queue and restart it at the current position. Reads still
+ * in flight are left to complete into their buffers and reused afterwards.
+ */
+static void drop_queue(URingContext *c)
+{
+    for (; c->queued; c->queued--) {
+        URingSlot *s = &c->slots[c->head];
+        s->state = s->state == SLOT_PENDING ? SLOT_STALE : SLOT_FREE;
+        c->head  = (c->head + 1) % c->depth;
+    }
+    c->next_offset = c->pos;
+}
+
+static int uring_read(URLContext *h, unsigned char *buf, int size)
+{
+    URingContext *c = h->priv_data;
+    int retried = 0;
+
+    for (;;) {
+        URingSlot *s = &c->slots[c->head];
+        int ret, len;
+
+        ret = read_ahead(c);
+        if (ret < 0)
+            return ret;
+        if (!c->queued || s->state == SLOT_PENDING) {
+            ret = reap(c, 1);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+
+        if (s->res < 0) {
+            ret = AVERROR(-s->res);
+            drop_queue(c);
+            return ret;
+        }
+
+        if (s->pos < s->res) {
+            len = FFMIN(size, s->res - s->pos);
+            memcpy(buf, slot_data(c, c->head) + s->pos, len);
+            s->pos += len;
+            c->pos += len;
+            if (s->pos == s->size) {
+                s->state = SLOT_FREE;
+                c->head  = (c->head + 1) % c->depth;
+                c->queued--;
+                read_ahead(c);
+            }
+            return len;
+        }
+
+        /* a short read, at the end of the file unless it grew since */
+        len = s->res;
+        drop_queue(c);
+        if (!len || retried)
+            return AVERROR_EOF;
+        retried = 1;
+    }
+}
+
+static int uring_write(URLContext *h, const unsigned char *buf, int size)
+{
+    URingContext *c = h->priv_data;
+    int done = 0;
+
+    while (done < size) {
+        URingSlot *s = NULL;
+        int i, ret;
+
+        if (c->error)
+            return c->error;
+
+        for (i = 0; i < c->depth; i++) {
+            if (c->slots[i].state == SLOT_FREE) {
+                s = &c->slots[i];
+                break;
+            }
+        }
+        if (!s) {
+            ret = reap(c, 1);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+
+        s->state  = SLOT_PENDING;
+        s->offset = c->pos;
+        s->size   = FFMIN(size - done, c->block_size);
+        s->pos    = 0;
+        memcpy(slot_data(c, i), buf + done, s->size);
+        queue_sqe(c, i, s->offset, s->size, 0);
+        c->inflight++;
+        c->pos += s->size;
+        done   += s->size;
+
+        ret = submit(c);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* pick up completions without blocking */
+    if (c->inflight) {
+        int ret = reap(c, 0);
+        if (ret < 0)
+            return ret;
+    }
+    return size;
+}
+
+static int64_t uring_seek(URLContext *h, int64_t pos, int whence)
+{
+    URingContext *c = h->priv_data;
+    struct stat st;
+    int ret;
+
+    if (c->write) {
+        ret = drain(c);
+        if (ret < 0)
+            return ret;
+        if (c->error)
+            return c->error;
+    }
+
+    switch (whence) {
+    case AVSEEK_SIZE:
+        return fstat(c->fd, &st) < 0 ? AVERROR(errno) : st.st_size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += c->pos;
+        break;
+    case SEEK_END:
+        if (fstat(c->fd, &st) < 0)
+            return AVERROR(errno);
+        pos += st.st_size;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    if (!c->write) {
+        /* keep the queued blocks from the one containing pos on */
+        while (c->queued) {
+            URingSlot *s = &c->slots[c->head];
+            if (pos >= s->offset && pos < s->offset + s->size) {
+                s->pos = pos - s->offset;
+                break;
+            }
+            s->state = s->state == SLOT_PENDING ? SLOT_STALE : SLOT_FREE;
+            c->head  = (c->head + 1) % c->depth;
+            c->queued--;
+        }
+        if (!c->queued)
+            c->next_offset = pos;
+    }
+    c->pos = pos;
+    return pos;
+}
+
+static int uring_get_handle(URLContext *h)
+{
+    URingContext *c = h->priv_data;
+    return c->fd;
+}
+
+static int map_ring(URingContext *c, const struct io_uring_params *p)
+{
+    c->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    c->cq_ring_size = p->cq_off.cqes  + p->cq_entries * sizeof(struct io_uring_cqe);
+    if (p->features & IORING_FEAT_SINGLE_MMAP)
+        c->sq_ring_size = c->cq_ring_size = FFMAX(c->sq_ring_size, c->cq_ring_size);
+
+    c->sq_ring = mmap(NULL, c->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, c->ring_fd, IORING_OFF_SQ_RING);
+    if (c->sq_ring == MAP_FAILED) {
+        c->sq_ring = NULL;
+        return AVERROR(errno);
+    }
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        c->cq_ring = c->sq_ring;
+    } else {
+        c->cq_ring = mmap(NULL, c->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, c->ring_fd, IORING_OFF_CQ_RING);
+        if (c->cq_ring == MAP_FAILED) {
+            c->cq_ring = NULL;
+            return AVERROR(errno);
+        }
+    }
+
+    c->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    c->sqes = mmap(NULL, c->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, c->ring_fd, IORING_OFF_SQES);
+    if (c->sqes == MAP_FAILED) {
+        c->sqes = NULL;
+        return AVERROR(errno);
+    }
+
+    c->sq_head  = (unsigned *)(c->sq_ring + p->sq_off.head);
+    c->sq_tail  = (unsigned *)(c->sq_ring + p->sq_off.tail);
+    c->sq_mask  = (unsigned *)(c->sq_ring + p->sq_off.ring_mask);
+    c->sq_array = (unsigned *)(c->sq_ring + p->sq_off.array);
+    c->cq_head  = (unsigned *)(c->cq_ring + p->cq_off.head);
+    c->cq_tail  = (unsigned *)(c->cq_ring + p->cq_off.tail);
+    c->cq_mask  = (unsigned *)(c->cq_ring + p->cq_off.ring_mask);
+    c->cqes     = (struct io_uring_cqe *)(c->cq_ring + p->cq_off.cqes);
+    return 0;
+}
+
+static int uring_close(URLContext *h)
+{
+    URingContext *c = h->priv_data;
+    int ret = 0;
+
+    if (c->ring_fd >= 0 && c->cqes) {
+        ret = drain(c);
+        if (!ret)
+            ret = c->error;
+    }
+
+    if (c->sqes)
+        munmap(c->sqes, c->sqes_size);
+    if (c->cq_ring && c->cq_ring != c->sq_ring)
+        munmap(c->cq_ring, c->cq_ring_size);
+    if (c->sq_ring)
+        munmap(c->sq_ring, c->sq_ring_size);
+    if (c->ring_fd >= 0)
+        close(c->ring_fd);
+    if (c->fd >= 0 && close(c->fd) < 0 && !ret)
+        ret = AVERROR(errno);
+
+    av_freep(&c->buffers);
+    av_freep(&c->slots);
+    return ret;
+}
+
+static int uring_open(URLContext *h, const char *filename, int flags)
+{
+    URingContext *c = h->priv_data;
+    struct io_uring_params p = { 0 };
+    struct iovec *iov;
+    struct stat st;
+    int access, ret;
+
+    c->fd = c->ring_fd = -1;
+    c->write = !!(flags & AVIO_FLAG_WRITE);
+    if (c->write && flags & AVIO_FLAG_READ) {
+        av_log(h, AV_LOG_ERROR, "Opening for both reading and writing is not supported\n");
+        return AVERROR(EINVAL);
+    }
+
+    av_strstart(filename, "uring:", &filename);
+
+    access = c->write ? O_CREAT | O_WRONLY : O_RDONLY;
+    if (c->write && c->trunc)
+        access |= O_TRUNC;
+    c->fd = avpriv_open(filename, access, 0666);
+    if (c->fd == -1)
+        return AVERROR(errno);
+
+    if (fstat(c->fd, &st) < 0) {
+        ret = AVERROR(errno);
+        goto fail;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        av_log(h, AV_LOG_ERROR, "%s is not a regular file\n", filename);
+        ret = AVERROR(EINVAL);
+        goto fail;
+    }
+
+    c->ring_fd = uring_setup(c->depth, &p);
+    if (c->ring_fd < 0) {
+        ret = AVERROR(errno);
+        av_log(h, AV_LOG_ERROR, "io_uring is not available: %s\n", av_err2str(ret));
+        goto fail;
+    }
+    ret = map_ring(c, &p);
+    if (ret < 0)
+        goto fail;
+
+    c->buffers = av_malloc((size_t)c->depth * c->block_size);
+    c->slots   = av_calloc(c->depth, sizeof(*c->slots));
+    iov        = av_calloc(c->depth, sizeof(*iov));
+    if (!c->buffers || !c->slots || !iov) {
+        av_free(iov);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    /* registration counts against RLIMIT_MEMLOCK on older kernels, plain
+     * reads and writes on the same buffers work without it */
+    for (int i = 0; i < c->depth; i++) {
+        iov[i].iov_base = slot_data(c, i);
+        iov[i].iov_len  = c->block_size;
+    }
+    c->fixed = uring_register(c->ring_fd, IORING_REGISTER_BUFFERS, iov, c->depth) >= 0;
+    if (!c->fixed)
+        av_log(h, AV_LOG_VERBOSE, "Could not register buffers: %s\n",
+               av_err2str(AVERROR(errno)));
+    av_free(iov);
+
+    if (!c->fixed) {
+        ret = op_supported(c->ring_fd, c->write ? IORING_OP_WRITE : IORING_OP_READ);
+        if (!ret) {
+            av_log(h, AV_LOG_ERROR, "Could not register buffers and the kernel "
+                   "does not support io_uring %s without them\n",
+                   c->write ? "writes" : "reads");
+            ret = AVERROR(ENOSYS);
+        }
+        if (ret < 0)
+            goto fail;
+    }
+
+    /* a full AVIOContext buffer maps to one queued write */
+    if (c->write)
+        h->min_packet_size = h->max_packet_size = c->block_size;
+
+    return 0;
+fail:
+    uring_close(h);
+    return ret;
+}
+
+#define OFFSET(x) offsetof(URingContext, x)
+#define D AV_OPT_FLAG_DECODING_PARAM
+#define E AV_OPT_FLAG_ENCODING_PARAM
+static const AVOption options[] = {
+    { "depth", "number of reads or writes kept in flight", OFFSET(depth), AV_OPT_TYPE_INT, { .i64 = 8 }, 1, 256, D|E },
+    { "block_size", "size of each read or write in bytes", OFFSET(block_size), AV_OPT_TYPE_INT, { .i64 = 65536 }, 4096, 16 << 20, D|E },
+    { "truncate", "truncate existing files on write", OFFSET(trunc), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, E },
+    { NULL }
+};
+
+static const AVClass uring_context_class = {
+    .class_name = "uring",
+    .item_name  = av_default_item_name,
+    .option     = options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
+const URLProtocol ff_uring_protocol = {
+    .name                = "uring",
+    .url_open            = uring_open,
+    .url_read            = uring_read,
+    .url_write           = uring_write,
+    .url_seek            = uring_seek,
+    .url_close           = uring_close,
+    .url_get_file_handle = uring_get_handle,
+    .priv_data_size      = sizeof(URingContext),
+    .priv_data_class     = &uring_context_class,
+    .default_whitelist   = "uring,file,crypto,data",
+};
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -74,6 +75,13 @@ typedef struct URLProtocol {
      */
     int     (*url_read)( URLContext *h, unsigned char *buf, int size);
     int     (*url_write)(URLContext *h, const unsigned char *buf, int size);
+    /**
+     * Write the nb_bufs buffers in order, like url_write() on their
+     * concatenation. May write less than the total size, the caller
+     * handles short writes like it does for url_write().
+     */
+    int     (*url_writev)(URLContext *h, const uint8_t *const *bufs,
+                          const int *sizes, int nb_bufs);
     int64_t (*url_seek)( URLContext *h, int64_t pos, int whence);
     int     (*url_close)(URLContext *h);
     int (*url_read_pause)(void *urlcontext, int pause);
@@ -83,6 +91,7 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    int (*url_get_mapping)(URLContext *h, AVBufferRef **buf);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
@@ -204,6 +213,16 @@ static inline int ffurl_write(URLContext *h, const uint8_t *buf, int size)
     return ffurl_write2(h, buf, size);
 }
 
+/**
+ * Write the concatenation of nb_bufs buffers to the resource accessed by
+ * urlcontext, with a single call to the protocol where possible. The total
+ * size must not exceed INT_MAX.
+ *
+ * @return the number of bytes written, or a negative AVERROR code
+ */
+int ffurl_writev2(void *urlcontext, const uint8_t *const *bufs,
+                  const int *sizes, int nb_bufs);
+
 int64_t ffurl_seek2(void *urlcontext, int64_t pos, int whence);
 /**
  * Change the position that will be used by the next read/write
@@ -263,6 +282,15 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(void *urlcontext);
 
+/**
+ * Return a new reference to a read-only memory mapping of the whole
+ * resource, if the protocol provides one. The mapping is followed by
+ * AV_INPUT_BUFFER_PADDING_SIZE zero bytes.
+ *
+ * @return 0 on success or <0 on error.
+ */
+int ffurl_get_mapping(URLContext *h, AVBufferRef **buf);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
@@ -101,6 +101,15 @@ FF_ENABLE_DEPRECATION_WARNINGS
 #endif
     pkt->pos  = avio_tell(s);
 
+    if (ffiocontext(s)->zero_copy_packets) {
+        int ret = ffio_read_ref(s, size, 0, &pkt->buf, &pkt->data);
+        if (ret != AVERROR(ENOSYS)) {
+            if (ret >= 0)
+                pkt->size = ret;
+            return ret;
+        }
+    }
+
     return append_packet_chunked(s, pkt, size);
 }
 
@@ -134,6 +134,55 @@ probegaplessinfo(){
     tail -n 9 "$framefile1"
 }
 
+probestreams(){
+    run ffprobe${PROGSUF}${EXECSUF} -bitexact -of compact -show_entries stream=codec_name,profile,width,height,pix_fmt,has_b_frames,sample_fmt,sample_rate,channel_layout,r_frame_rate,avg_frame_rate,start_time,duration,bit_rate:format=start_time,duration,bit_rate "$@"
+}
+
+probestreams_opts(){
+    filename="$1"
+    shift
+    file1="${outdir}/${test}.1.out"
+    file2="${outdir}/${test}.2.out"
+    cleanfiles="$cleanfiles $file1 $file2"
+    probestreams "$filename" > $file1 || return
+    probestreams "$@" "$filename" > $file2 || return
+    cmp $file1 $file2 || return
+    cat $file2
+}
+
+# run framecrc on the remaining arguments without and with the input
+# options in $1, check that both outputs are identical and print the second
+framecrc_opts(){
+    opts=$1
+    shift
+    file1="${outdir}/${test}.1.out"
+    file2="${outdir}/${test}.2.out"
+    cleanfiles="$cleanfiles $file1 $file2"
+    framecrc "$@" > $file1 || return
+    framecrc $opts "$@" > $file2 || return
+    cmp $file1 $file2 || return
+    cat $file2
+}
+
+probestreams_reuse(){
+    opt=$1
+    filename="$2"
+    dir="${outdir}/${test}.dir"
+    file1="${outdir}/${test}.1.out"
+    file2="${outdir}/${test}.2.out"
+    file3="${outdir}/${test}.3.out"
+    cleanfiles="$cleanfiles $file1 $file2 $file3"
+    rm -rf "$dir" && mkdir -p "$dir" || return
+    probestreams "$filename" > $file1 || return
+    probestreams -$opt $(target_path $dir) "$filename" > $file2 || return
+    test -n "$(ls "$dir")" || return
+    probestreams -$opt $(target_path $dir) "$filename" > $file3 || return
+    cmp $file1 $file2 || return
+    cmp $file1 $file3 || return
+    rm -rf "$dir"
+    cat $file3
+}
+
 ffmpeg(){
     dec_opts="-hwaccel $hwaccel -threads $threads -thread_type $thread_type"
     ffmpeg_args="-nostdin -nostats -noauto_conversion_filters -cpuflags $cpuflags"
@@ -184,6 +233,38 @@ pcm(){
     ffmpeg -auto_conversion_filters "$@" -vn -f s16le -
 }
 
+# mux $1 with +faststart and with +faststart_spool to a pipe, check that
+# both files are identical and print their md5
+faststart_spool(){
+    srcfile=$1
+    shift
+    file1="${outdir}/${test}.faststart.mp4"
+    file2="${outdir}/${test}.spool.mp4"
+    cleanfiles="$cleanfiles $file1 $file2"
+    ffmpeg -i $srcfile "$@" -fflags +bitexact -movflags +faststart \
+        -f mp4 -y $(target_path $file1) || return
+    ffmpeg -i $srcfile "$@" -fflags +bitexact -movflags +faststart_spool \
+        -spool_dir $(target_path $outdir) -f mp4 - > $file2 || return
+    cmp $file1 $file2 || return
+    do_md5sum $file1 | awk '{print $1}'
+}
+
+seek_reuse(){
+    opt=$1
+    shift
+    dir="${outdir}/${test}.dir"
+    file1="${outdir}/${test}.1.out"
+    file2="${outdir}/${test}.2.out"
+    cleanfiles="$cleanfiles $file1 $file2"
+    rm -rf "$dir" && mkdir -p "$dir" || return
+    run libavformat/tests/seek${EXECSUF} "$@" -$opt $(target_path $dir) > $file1 || return
+    test -n "$(ls "$dir")" || return
+    run libavformat/tests/seek${EXECSUF} "$@" -$opt $(target_path $dir) > $file2 || return
+    cmp $file1 $file2 || return
+    rm -rf "$dir"
+    cat $file2
+}
+
 fmtstdout(){
     fmt=$1
     shift 1
@@ -0,0 +1,24 @@
+# a video and an audio representation in fragments of one second
+DASH_RENDITIONS_DEPS = DASH_MUXER DASH_DEMUXER MP4_MUXER MOV_DEMUXER \
+                       LAVFI_INDEV TESTSRC_FILTER SINE_FILTER \
+                       MPEG4_ENCODER MPEG4_DECODER MP2_ENCODER MP2_DECODER \
+                       FILE_PROTOCOL
+
+tests/data/dash_renditions.mpd: TAG = GEN
+tests/data/dash_renditions.mpd: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc=size=160x120:rate=25:duration=4 -f lavfi -i sine=duration=4 \
+        -map 0:v -map 1:a -c:v mpeg4 -g 25 -qscale:v 10 -c:a mp2 -threads 1 \
+        -sws_flags +accurate_rnd+bitexact -flags +bitexact -fflags +bitexact \
+        -f dash -seg_duration 1 -use_template 1 -use_timeline 1 \
+        -init_seg_name 'dash_renditions_init_$$RepresentationID$$.m4s' \
+        -media_seg_name 'dash_renditions_$$RepresentationID$$_$$Number%03d$$.m4s' \
+        -y $(TARGET_PATH)/$@ 2>/dev/null
+
+# fragments downloaded ahead must be demuxed exactly as when read serially
+FATE_DASHENC-$(call ALLYES, $(DASH_RENDITIONS_DEPS) FRAMECRC_MUXER) += fate-dash-prefetch-fragments
+fate-dash-prefetch-fragments: tests/data/dash_renditions.mpd
+fate-dash-prefetch-fragments: CMD = framecrc_opts "-prefetch_fragments 2" -i $(TARGET_PATH)/tests/data/dash_renditions.mpd -map 0 -c copy
+
+FATE_FFMPEG += $(FATE_DASHENC-yes)
+fate-dashenc: $(FATE_DASHENC-yes)
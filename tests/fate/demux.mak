@@ -160,8 +160,26 @@ fate-ts-demux: CMD = ffprobe_demux $(TARGET_SAMPLES)/ac3/mp3ac325-4864-small.ts
 FATE_FFPROBE_DEMUX-$(CONFIG_MPEGTS_DEMUXER) += fate-ts-timed-id3-demux
 fate-ts-timed-id3-demux: CMD = ffprobe_demux $(TARGET_SAMPLES)/mpegts/id3.ts
 
+# packets referencing the I/O buffer must not change the demuxed data
+FATE_DEMUX-$(call DEMDEC, WAV, PCM_S16LE) += fate-wav-buffer_refs
+fate-wav-buffer_refs: fate-lavf-wav
+fate-wav-buffer_refs: CMD = framecrc_opts "-buffer_refs 1" -i $(TARGET_PATH)/tests/data/lavf/lavf.wav -c copy
+
+tests/data/buffer_refs.m4v: TAG = GEN
+tests/data/buffer_refs.m4v: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc=size=320x240:rate=25:duration=1 -fflags +bitexact -flags +bitexact \
+        -c:v mpeg4 -qscale 2 -threads 1 -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_DEMUX-$(call DEMDEC, M4V, MPEG4, LAVFI_INDEV TESTSRC_FILTER MPEG4_ENCODER M4V_MUXER) += fate-m4v-buffer_refs
+fate-m4v-buffer_refs: tests/data/buffer_refs.m4v
+fate-m4v-buffer_refs: CMD = framecrc_opts "-buffer_refs 1" -i $(TARGET_PATH)/tests/data/buffer_refs.m4v -c copy
+
+FATE_DEMUX += $(FATE_DEMUX-yes)
+FATE_FFMPEG += $(FATE_DEMUX)
+
 FATE_SAMPLES_DEMUX += $(FATE_SAMPLES_DEMUX-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_SAMPLES_DEMUX)
 FATE_FFPROBE_DEMUX   += $(FATE_FFPROBE_DEMUX-yes)
 FATE_SAMPLES_FFPROBE += $(FATE_FFPROBE_DEMUX)
-fate-demux: $(FATE_SAMPLES_DEMUX) $(FATE_FFPROBE_DEMUX)
+fate-demux: $(FATE_DEMUX) $(FATE_SAMPLES_DEMUX) $(FATE_FFPROBE_DEMUX)
@@ -109,6 +109,34 @@ FATE_HLSENC_PROBE-$(call ALLYES, HLS_DEMUXER EAC3_DEMUXER) += fate-hls-fmp4_ac3
 fate-hls-fmp4_ac3: tests/data/hls_fmp4_ac3.m3u8
 fate-hls-fmp4_ac3: CMD = probeaudiostream $(TARGET_PATH)/tests/data/now_ac3.mp4
 
+# a video variant and an audio rendition group, without external samples
+HLS_RENDITIONS_DEPS = HLS_MUXER HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER \
+                      LAVFI_INDEV TESTSRC_FILTER SINE_FILTER \
+                      MPEG2VIDEO_ENCODER MPEG2VIDEO_DECODER MPEGVIDEO_PARSER \
+                      MP2_ENCODER MP2_DECODER MPEGAUDIO_PARSER FILE_PROTOCOL
+
+tests/data/hls_renditions.m3u8: TAG = GEN
+tests/data/hls_renditions.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i testsrc=size=160x120:rate=25:duration=4 -f lavfi -i sine=duration=4 \
+        -map 0:v -map 1:a -c:v mpeg2video -g 25 -qscale:v 10 -c:a mp2 -threads 1 \
+        -sws_flags +accurate_rnd+bitexact -flags +bitexact -fflags +bitexact \
+        -f hls -hls_time 1 -hls_playlist_type vod -master_pl_name hls_renditions.m3u8 \
+        -var_stream_map "v:0,agroup:aud a:0,agroup:aud" \
+        -hls_segment_filename $(TARGET_PATH)/tests/data/hls_renditions_%v_%03d.ts \
+        -y $(TARGET_PATH)/tests/data/hls_renditions_%v.m3u8 2>/dev/null
+
+# segments downloaded ahead must be demuxed exactly as when read serially
+FATE_HLSENC_RENDITIONS-$(call ALLYES, $(HLS_RENDITIONS_DEPS) FRAMECRC_MUXER) += fate-hls-prefetch-segments
+fate-hls-prefetch-segments: tests/data/hls_renditions.m3u8
+fate-hls-prefetch-segments: CMD = framecrc_opts "-prefetch_segments 2" -i $(TARGET_PATH)/tests/data/hls_renditions.m3u8 -map 0 -c copy
+
+FATE_HLSENC_RENDITIONS_PROBE-$(call ALLYES, $(HLS_RENDITIONS_DEPS)) += fate-hls-probe-once
+fate-hls-probe-once: tests/data/hls_renditions.m3u8
+fate-hls-probe-once: CMD = probestreams_opts $(TARGET_PATH)/tests/data/hls_renditions.m3u8 -probe_once 1
+
+FATE_FFMPEG += $(FATE_HLSENC_RENDITIONS-yes)
+FATE_FFMPEG_FFPROBE += $(FATE_HLSENC_RENDITIONS_PROBE-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_HLSENC-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_HLSENC_PROBE-yes)
-fate-hlsenc: $(FATE_HLSENC-yes) $(FATE_HLSENC_PROBE-yes)
+fate-hlsenc: $(FATE_HLSENC-yes) $(FATE_HLSENC_PROBE-yes) $(FATE_HLSENC_RENDITIONS-yes) $(FATE_HLSENC_RENDITIONS_PROBE-yes)
@@ -6,7 +6,7 @@ FATE_LAVF_CONTAINER-$(call ENCDEC,  RAWVIDEO,              FILMSTRIP)          +
 FATE_LAVF_CONTAINER-$(call ENCDEC2, MPEG2VIDEO, PCM_S16LE, GXF)                += gxf gxf_pal gxf_ntsc
 FATE_LAVF_CONTAINER-$(call ENCDEC2, MPEG4,      MP2,       MATROSKA)           += mkv mkv_attachment
 FATE_LAVF_CONTAINER-$(call ENCDEC2, MPEG4,      PCM_ALAW,  MOV)                += mov mov_rtphint mov_hybrid_frag ismv
-FATE_LAVF_CONTAINER-$(call ENCDEC,  MPEG4,                 MOV)                += mp4
+FATE_LAVF_CONTAINER-$(call ENCDEC,  MPEG4,                 MOV)                += mp4 mp4_dash
 FATE_LAVF_CONTAINER-$(call ENCDEC2, MPEG1VIDEO, MP2,       MPEG1SYSTEM MPEGPS) += mpg
 FATE_LAVF_CONTAINER-$(call ENCDEC , FFV1,                  MXF)                += mxf_ffv1
 FATE_LAVF_CONTAINER-$(call ENCDEC2, MPEG2VIDEO, PCM_S16LE, MXF)                += mxf
@@ -53,6 +53,7 @@ fate-lavf-mov: CMD = lavf_container_timecode "-movflags +faststart -c:a pcm_alaw
 fate-lavf-mov_rtphint: CMD = lavf_container "" "-movflags +rtphint -c:a pcm_alaw -c:v mpeg4 -threads 1 -f mov"
 fate-lavf-mov_hybrid_frag: CMD = lavf_container "" "-movflags +hybrid_fragmented -c:a pcm_alaw -c:v mpeg4 -threads 1 -f mov"
 fate-lavf-mp4: CMD = lavf_container_timecode "-c:v mpeg4 -an -threads 1"
+fate-lavf-mp4_dash: CMD = lavf_container "" "-movflags +dash+frag_keyframe -c:v mpeg4 -an -threads 1 -f mp4"
 fate-lavf-mpg: CMD = lavf_container_timecode "-ar 44100 -threads 1"
 fate-lavf-mxf: CMD = lavf_container_timecode "-af aresample=48000:tsf=s16p -bf 2 -threads 1"
 fate-lavf-mxf_d10: CMD = lavf_container "-ar 48000 -ac 2" "-r 25 -vf scale=720:576,pad=720:608:0:32,setfield=tff -c:v mpeg2video -g 0 -flags +ildct+low_delay -dc 10 -non_linear_quant 1 -intra_vlc 1 -qscale 1 -ps 1 -qmin 1 -rc_max_vbv_use 1 -rc_min_vbv_use 1 -pix_fmt yuv422p -minrate 30000k -maxrate 30000k -b 30000k -bufsize 1200000 -rc_init_occupancy 1200000 -qmax 12 -f mxf_d10"
@@ -71,6 +72,26 @@ fate-lavf-wtv: CMD = lavf_container "" "-c:a mp2 -threads 1"
 FATE_AVCONV += $(FATE_LAVF_CONTAINER)
 fate-lavf-container fate-lavf: $(FATE_LAVF_CONTAINER)
 
+# stream parameters probed with options, which must not change them
+
+FATE_LAVF_CONTAINER_PROBE-$(call DEMDEC, MATROSKA, MPEG4 MP2) += mkv-probe_threads
+FATE_LAVF_CONTAINER_PROBE-$(call DEMDEC, MATROSKA, MPEG4 MP2) += mkv-probe_cache
+
+FATE_LAVF_CONTAINER_PROBE = $(FATE_LAVF_CONTAINER_PROBE-yes:%=fate-lavf-%)
+FATE_LAVF_CONTAINER_PROBE := $(filter $(addsuffix -%,$(FATE_LAVF_CONTAINER)),$(FATE_LAVF_CONTAINER_PROBE))
+
+$(FATE_LAVF_CONTAINER_PROBE): REF = $(SRC_PATH)/tests/ref/lavf/$(@:fate-lavf-%=%)
+fate-lavf-mkv: KEEP_FILES ?= 1
+
+fate-lavf-mkv-probe_threads: fate-lavf-mkv
+fate-lavf-mkv-probe_threads: CMD = probestreams_opts $(TARGET_PATH)/tests/data/lavf/lavf.mkv -probe_threads 2
+# the second run with the same directory reads what the first one stored
+fate-lavf-mkv-probe_cache: fate-lavf-mkv
+fate-lavf-mkv-probe_cache: CMD = probestreams_reuse probe_cache $(TARGET_PATH)/tests/data/lavf/lavf.mkv
+
+FATE_FFMPEG_FFPROBE += $(FATE_LAVF_CONTAINER_PROBE)
+fate-lavf-container fate-lavf: $(FATE_LAVF_CONTAINER_PROBE)
+
 FATE_LAVF_CONTAINER_FATE-$(call ALLYES, IVF_DEMUXER AV1_DECODER AV1_PARSER MOV_MUXER)      += av1.mp4
 FATE_LAVF_CONTAINER_FATE-$(call ALLYES, IVF_DEMUXER AV1_DECODER AV1_PARSER MATROSKA_MUXER) += av1.mkv
 FATE_LAVF_CONTAINER_FATE-$(call ALLYES, EVC_DEMUXER EVC_PARSER MOV_MUXER)      += evc.mp4
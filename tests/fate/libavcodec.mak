@@ -108,5 +108,9 @@ FATE_LIBAVCODEC-yes += fate-libavcodec-htmlsubtitles
 fate-libavcodec-htmlsubtitles: libavcodec/tests/htmlsubtitles$(EXESUF)
 fate-libavcodec-htmlsubtitles: CMD = run libavcodec/tests/htmlsubtitles$(EXESUF)
 
+FATE_LIBAVCODEC-$(CONFIG_RAWVIDEO_DECODER) += fate-svgutils
+fate-svgutils: libavcodec/tests/svgutils$(EXESUF)
+fate-svgutils: CMD = run libavcodec/tests/svgutils$(EXESUF)
+
 FATE-$(CONFIG_AVCODEC) += $(FATE_LIBAVCODEC-yes)
 fate-libavcodec: $(FATE_LIBAVCODEC-yes)
@@ -2,10 +2,18 @@
 #fate-async: libavformat/tests/async$(EXESUF)
 #fate-async: CMD = run libavformat/tests/async
 
+FATE_LIBAVFORMAT-$(CONFIG_FRAMECRC_MUXER) += fate-interleave
+fate-interleave: libavformat/tests/interleave$(EXESUF)
+fate-interleave: CMD = run libavformat/tests/interleave$(EXESUF)
+
 FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
 
+FATE_LIBAVFORMAT-$(call ALLYES, FILE_PROTOCOL PARALLEL_PROTOCOL) += fate-parallel
+fate-parallel: libavformat/tests/parallel$(EXESUF)
+fate-parallel: CMD = run libavformat/tests/parallel$(EXESUF) $(TARGET_PATH)/tests/data/fate/parallel.data
+
 FATE_LIBAVFORMAT-$(CONFIG_FFRTMPCRYPT_PROTOCOL) += fate-rtmpdh
 fate-rtmpdh: libavformat/tests/rtmpdh$(EXESUF)
 fate-rtmpdh: CMD = run libavformat/tests/rtmpdh$(EXESUF)
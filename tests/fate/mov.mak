@@ -218,6 +218,13 @@ fate-mov-pcm-remux: CMD = md5 -i $(TARGET_PATH)/tests/data/asynth-44100-1.wav -m
 fate-mov-pcm-remux: CMP = oneline
 fate-mov-pcm-remux: REF = e76115bc392d702da38f523216bba165
 
+# faststart_spool must produce the same file as faststart, even to a pipe
+FATE_MOV_FFMPEG-$(call REMUX, MP4 WAV) += fate-mov-faststart-spool
+fate-mov-faststart-spool: tests/data/asynth-44100-1.wav
+fate-mov-faststart-spool: CMD = faststart_spool $(TARGET_PATH)/tests/data/asynth-44100-1.wav -map 0 -c copy
+fate-mov-faststart-spool: CMP = oneline
+fate-mov-faststart-spool: REF = 692d6e3d061854db691a07d2f8e1bd54
+
 FATE_MOV_FFMPEG-$(call TRANSCODE, RAWVIDEO, MOV, TESTSRC_FILTER SETPTS_FILTER) += fate-mov-vfr
 fate-mov-vfr: CMD = md5 -filter_complex testsrc=size=2x2:duration=1,setpts=N*N -c rawvideo -fflags +bitexact -f mov
 fate-mov-vfr: CMP = oneline
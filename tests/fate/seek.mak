@@ -136,7 +136,8 @@ FATE_SEEK += $(FATE_SEEK_LAVF_AUDIO)
 
 # files from fate-lavf-container
 
-FATE_SEEK_LAVF_CONTAINER += asf avi dv flv gxf mkv mov mpg    \
+FATE_SEEK_LAVF_CONTAINER += asf avi dv flv gxf ismv mkv mov  \
+                            mp4_dash mpg                      \
                             mxf mxf_d10 mxf_dv25 mxf_dvcpro50 \
                             mxf_opatom mxf_opatom_audio       \
                             nut swf ts wtv
@@ -178,6 +179,81 @@ FATE_SEEK_LAVF_IMAGE2PIPE := $(filter $(subst fate-,fate-seek-,$(FATE_LAVF_IMAGE
 $(FATE_SEEK_LAVF_IMAGE2PIPE): SRC = lavf/$(@:fate-seek-lavf-%pipe=%)pipe.$(@:fate-seek-lavf-%pipe=%)
 FATE_SEEK += $(FATE_SEEK_LAVF_IMAGE2PIPE)
 
+# files from fate-lavf-container read with demuxer options, which must not
+# change the results
+
+FATE_SEEK_OPTS-$(CONFIG_MOV_DEMUXER) += fate-seek-lavf-ismv-frag_index_scan
+FATE_SEEK_OPTS-$(CONFIG_MOV_DEMUXER) += fate-seek-lavf-mp4_dash-frag_index_scan
+
+fate-seek-lavf-ismv-frag_index_scan: fate-lavf-ismv
+fate-seek-lavf-ismv-frag_index_scan: SRC = lavf/lavf.ismv
+fate-seek-lavf-ismv-frag_index_scan: OPTS = -frag_index_scan 1
+fate-seek-lavf-ismv-frag_index_scan: REF = $(SRC_PATH)/tests/ref/seek/lavf-ismv
+fate-seek-lavf-mp4_dash-frag_index_scan: fate-lavf-mp4_dash
+fate-seek-lavf-mp4_dash-frag_index_scan: SRC = lavf/lavf.mp4_dash
+fate-seek-lavf-mp4_dash-frag_index_scan: OPTS = -frag_index_scan 1
+fate-seek-lavf-mp4_dash-frag_index_scan: REF = $(SRC_PATH)/tests/ref/seek/lavf-mp4_dash
+
+FATE_SEEK_OPTS-$(CONFIG_MOV_DEMUXER) += fate-seek-lavf-mov-compact_index
+fate-seek-lavf-mov-compact_index: fate-lavf-mov
+fate-seek-lavf-mov-compact_index: SRC = lavf/lavf.mov
+fate-seek-lavf-mov-compact_index: OPTS = -compact_index 1
+fate-seek-lavf-mov-compact_index: REF = $(SRC_PATH)/tests/ref/seek/lavf-mov
+
+# read in small blocks to have several reads in flight
+FATE_SEEK_OPTS-$(call ALLYES, URING_PROTOCOL MATROSKA_DEMUXER) += fate-seek-lavf-mkv-uring
+fate-seek-lavf-mkv-uring: fate-lavf-mkv
+fate-seek-lavf-mkv-uring: SRC = lavf/lavf.mkv
+fate-seek-lavf-mkv-uring: PROTO = uring:
+fate-seek-lavf-mkv-uring: OPTS = -block_size 4096 -depth 4
+fate-seek-lavf-mkv-uring: REF = $(SRC_PATH)/tests/ref/seek/lavf-mkv
+
+FATE_SEEK_OPTS-$(CONFIG_FILE_PROTOCOL) += fate-seek-lavf-mkv-mmap fate-seek-lavf-ts-mmap
+fate-seek-lavf-mkv-mmap: fate-lavf-mkv
+fate-seek-lavf-mkv-mmap: SRC = lavf/lavf.mkv
+fate-seek-lavf-mkv-mmap: OPTS = -mmap 1
+fate-seek-lavf-mkv-mmap: REF = $(SRC_PATH)/tests/ref/seek/lavf-mkv
+fate-seek-lavf-ts-mmap: fate-lavf-ts
+fate-seek-lavf-ts-mmap: SRC = lavf/lavf.ts
+fate-seek-lavf-ts-mmap: OPTS = -mmap 1
+fate-seek-lavf-ts-mmap: REF = $(SRC_PATH)/tests/ref/seek/lavf-ts
+
+# let the read buffer shrink to the smallest size
+FATE_SEEK_OPTS-$(CONFIG_FILE_PROTOCOL) += fate-seek-lavf-mkv-adaptive_buffer fate-seek-lavf-ts-adaptive_buffer
+fate-seek-lavf-mkv-adaptive_buffer: fate-lavf-mkv
+fate-seek-lavf-mkv-adaptive_buffer: SRC = lavf/lavf.mkv
+fate-seek-lavf-mkv-adaptive_buffer: OPTS = -adaptive_buffer 1 -adaptive_buffer_min 512
+fate-seek-lavf-mkv-adaptive_buffer: REF = $(SRC_PATH)/tests/ref/seek/lavf-mkv
+fate-seek-lavf-ts-adaptive_buffer: fate-lavf-ts
+fate-seek-lavf-ts-adaptive_buffer: SRC = lavf/lavf.ts
+fate-seek-lavf-ts-adaptive_buffer: OPTS = -adaptive_buffer 1 -adaptive_buffer_min 512
+fate-seek-lavf-ts-adaptive_buffer: REF = $(SRC_PATH)/tests/ref/seek/lavf-ts
+
+FATE_SEEK_OPTS-$(CONFIG_WAV_DEMUXER) += fate-seek-lavf-wav-buffer_refs
+fate-seek-lavf-wav-buffer_refs: fate-lavf-wav
+fate-seek-lavf-wav-buffer_refs: SRC = lavf/lavf.wav
+fate-seek-lavf-wav-buffer_refs: OPTS = -buffer_refs 1
+fate-seek-lavf-wav-buffer_refs: REF = $(SRC_PATH)/tests/ref/seek/lavf-wav
+
+FATE_SEEK_OPTS := $(filter $(addsuffix -%,$(FATE_SEEK)),$(FATE_SEEK_OPTS-yes))
+$(FATE_SEEK_OPTS): libavformat/tests/seek$(EXESUF)
+$(FATE_SEEK_OPTS): CMD = run libavformat/tests/seek$(EXESUF) $(PROTO)$(TARGET_PATH)/tests/data/$(SRC) $(OPTS)
+
+# run twice with the option naming the same new directory, the second run
+# reads what the first one stored there
+
+FATE_SEEK_REUSE-$(call ALLYES, CACHE_PROTOCOL MATROSKA_DEMUXER) += fate-seek-lavf-mkv-cache_dir
+
+fate-seek-lavf-mkv-cache_dir: fate-lavf-mkv
+fate-seek-lavf-mkv-cache_dir: SRC = lavf/lavf.mkv
+fate-seek-lavf-mkv-cache_dir: PROTO = cache:
+fate-seek-lavf-mkv-cache_dir: OPT = cache_dir
+fate-seek-lavf-mkv-cache_dir: REF = $(SRC_PATH)/tests/ref/seek/lavf-mkv
+
+FATE_SEEK_REUSE := $(filter $(addsuffix -%,$(FATE_SEEK)),$(FATE_SEEK_REUSE-yes))
+$(FATE_SEEK_REUSE): libavformat/tests/seek$(EXESUF)
+$(FATE_SEEK_REUSE): CMD = seek_reuse $(OPT) $(PROTO)$(TARGET_PATH)/tests/data/$(SRC)
+
 # extra files
 
 FATE_SEEK_EXTRA-$(CONFIG_MP3_DEMUXER)   += fate-seek-extra-mp3
@@ -205,6 +281,6 @@ $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 $(subst fate-seek-,fate-,$(FATE_SAMPLES_SEEK) $(FATE_SEEK)): KEEP_FILES ?= 1
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_OPTS) $(FATE_SEEK_REUSE)
 FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+fate-seek:     $(FATE_SEEK) $(FATE_SEEK_OPTS) $(FATE_SEEK_REUSE) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)